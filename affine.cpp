@@ -1,5 +1,9 @@
 #include "affine.h"
 #include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "metrics.h"
+#include "execution_plan.h"
+#include "parallel.h"
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -9,6 +13,8 @@
 #include <random>
 #include <stdexcept>
 #include <cstdint>
+#include <span>
+#include <algorithm>
 
 using namespace std;
 
@@ -110,145 +116,168 @@ bool generateAffineKeys(uint64_t& a, uint64_t& b, bool forText, uint64_t min_a,
     return true;
 }
 
-wstring affineEncryptWide(const wstring& text, uint64_t a, uint64_t b) {
-    wstring result = L"";
-
-    for (wchar_t c : text) {
-        if (c == L' ') {
-            result += L' ';
-            continue;
-        }
-        
-        if (c >= L'А' && c <= L'Я') {
-            uint64_t x = static_cast<uint64_t>(c - L'А');
-            uint64_t encrypted = (a * x + b) % 32;
-            result += static_cast<wchar_t>(L'А' + encrypted);
-        }
-        else if (c >= L'а' && c <= L'я') {
-            uint64_t x = static_cast<uint64_t>(c - L'а');
-            uint64_t encrypted = (a * x + b) % 32;
-            result += static_cast<wchar_t>(L'а' + encrypted);
-        }
-        else if (c >= L'A' && c <= L'Z') {
-            uint64_t x = static_cast<uint64_t>(c - L'A');
-            uint64_t encrypted = (a * x + b) % 26;
-            result += static_cast<wchar_t>(L'A' + encrypted);
-        }
-        else if (c >= L'a' && c <= L'z') {
-            uint64_t x = static_cast<uint64_t>(c - L'a');
-            uint64_t encrypted = (a * x + b) % 26;
-            result += static_cast<wchar_t>(L'a' + encrypted);
-        }
-        else if (c >= L'0' && c <= L'9') {
-            uint64_t x = static_cast<uint64_t>(c - L'0');
-            uint64_t encrypted = (a * x + b) % 10;
-            result += static_cast<wchar_t>(L'0' + encrypted);
+static wchar_t affineEncryptChar(wchar_t c, uint64_t a, uint64_t b) {
+    if (c == L' ') {
+        return L' ';
+    }
+    
+    if (c >= L'А' && c <= L'Я') {
+        uint64_t x = static_cast<uint64_t>(c - L'А');
+        uint64_t encrypted = (a * x + b) % 32;
+        return static_cast<wchar_t>(L'А' + encrypted);
+    }
+    else if (c >= L'а' && c <= L'я') {
+        uint64_t x = static_cast<uint64_t>(c - L'а');
+        uint64_t encrypted = (a * x + b) % 32;
+        return static_cast<wchar_t>(L'а' + encrypted);
+    }
+    else if (c >= L'A' && c <= L'Z') {
+        uint64_t x = static_cast<uint64_t>(c - L'A');
+        uint64_t encrypted = (a * x + b) % 26;
+        return static_cast<wchar_t>(L'A' + encrypted);
+    }
+    else if (c >= L'a' && c <= L'z') {
+        uint64_t x = static_cast<uint64_t>(c - L'a');
+        uint64_t encrypted = (a * x + b) % 26;
+        return static_cast<wchar_t>(L'a' + encrypted);
+    }
+    else if (c >= L'0' && c <= L'9') {
+        uint64_t x = static_cast<uint64_t>(c - L'0');
+        uint64_t encrypted = (a * x + b) % 10;
+        return static_cast<wchar_t>(L'0' + encrypted);
+    }
+    else if (isSpecialSymbolWide(c)) {
+        uint64_t symbol_index = getSpecialSymbolIndex(c);
+        if (symbol_index != static_cast<uint64_t>(-1)) {
+            uint64_t encrypted_index = (a * symbol_index + b) % 33;
+            return getSpecialSymbolFromIndex(encrypted_index);
         }
-        else if (isSpecialSymbolWide(c)) {
+    }
+    return c;
+}
+
+struct AffineWideInverse {
+    int64_t rus;
+    int64_t eng;
+    int64_t dig;
+    int64_t sym;
+};
+
+static AffineWideInverse affineWideInverse(uint64_t a) {
+    return { modInverse(a, 32), modInverse(a, 26), modInverse(a, 10), modInverse(a, 33) };
+}
+
+static wchar_t affineDecryptChar(wchar_t c, const AffineWideInverse& inv, uint64_t b) {
+    if (c == L' ') {
+        return L' ';
+    }
+    if (c >= L'А' && c <= L'Я') {
+        uint64_t y = static_cast<uint64_t>(c - L'А');
+        int64_t decrypted = (inv.rus * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 32)) % 32;
+        if (decrypted < 0) decrypted += 32;
+        return static_cast<wchar_t>(L'А' + decrypted);
+    }
+    else if (c >= L'а' && c <= L'я') {
+        uint64_t y = static_cast<uint64_t>(c - L'а');
+        int64_t decrypted = (inv.rus * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 32)) % 32;
+        if (decrypted < 0) decrypted += 32;
+        return static_cast<wchar_t>(L'а' + decrypted);
+    }
+    else if (c >= L'A' && c <= L'Z') {
+        uint64_t y = static_cast<uint64_t>(c - L'A');
+        int64_t decrypted = (inv.eng * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 26)) % 26;
+        if (decrypted < 0) decrypted += 26;
+        return static_cast<wchar_t>(L'A' + decrypted);
+    }
+    else if (c >= L'a' && c <= L'z') {
+        uint64_t y = static_cast<uint64_t>(c - L'a');
+        int64_t decrypted = (inv.eng * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 26)) % 26;
+        if (decrypted < 0) decrypted += 26;
+        return static_cast<wchar_t>(L'a' + decrypted);
+    }
+    else if (c >= L'0' && c <= L'9') {
+        uint64_t y = static_cast<uint64_t>(c - L'0');
+        int64_t decrypted = (inv.dig * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 10)) % 10;
+        if (decrypted < 0) decrypted += 10;
+        return static_cast<wchar_t>(L'0' + decrypted);
+    }
+    else if (isSpecialSymbolWide(c)) {
+        if (inv.sym != -1) {
             uint64_t symbol_index = getSpecialSymbolIndex(c);
-            if (symbol_index != static_cast<uint64_t>(-1)) {
-                uint64_t encrypted_index = (a * symbol_index + b) % 33;
-                wchar_t encrypted_char = getSpecialSymbolFromIndex(encrypted_index);
-                result += encrypted_char;
-            } else {
-                result += c;
-            }
-        }
-        else {
-            result += c;
+            int64_t decrypted_index = (inv.sym * (static_cast<int64_t>(symbol_index) - static_cast<int64_t>(b) + 33)) % 33;
+            if (decrypted_index < 0) decrypted_index += 33;
+            return getSpecialSymbolFromIndex(static_cast<uint64_t>(decrypted_index));
         }
     }
-    return result;
+    return c;
 }
 
-wstring affineDecryptWide(const wstring& text, uint64_t a, uint64_t b) {
-    wstring result = L"";
+static void checkAffineOutput(size_t inputSize, size_t outputSize) {
+    if (outputSize < inputSize) {
+        throw length_error("affine: output buffer is too small");
+    }
+}
+
+void affineEncryptWide(span<const wchar_t> text, span<wchar_t> result, uint64_t a, uint64_t b) {
+    checkAffineOutput(text.size(), result.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        result[i] = affineEncryptChar(text[i], a, b);
+    }
+}
 
-    int64_t a_inv_rus = modInverse(a, 32);
-    int64_t a_inv_eng = modInverse(a, 26);
-    int64_t a_inv_dig = modInverse(a, 10);
-    int64_t a_inv_sym = modInverse(a, 33);
+void affineDecryptWide(span<const wchar_t> text, span<wchar_t> result, uint64_t a, uint64_t b) {
+    checkAffineOutput(text.size(), result.size());
+    AffineWideInverse inv = affineWideInverse(a);
+    for (size_t i = 0; i < text.size(); i++) {
+        result[i] = affineDecryptChar(text[i], inv, b);
+    }
+}
 
-    for (wchar_t c : text) {
-        if (c == L' ') {
-            result += L' ';
-            continue;
-        }
-        if (c >= L'А' && c <= L'Я') {
-            uint64_t y = static_cast<uint64_t>(c - L'А');
-            int64_t decrypted = (a_inv_rus * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 32)) % 32;
-            if (decrypted < 0) decrypted += 32;
-            result += static_cast<wchar_t>(L'А' + decrypted);
-        }
-        else if (c >= L'а' && c <= L'я') {
-            uint64_t y = static_cast<uint64_t>(c - L'а');
-            int64_t decrypted = (a_inv_rus * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 32)) % 32;
-            if (decrypted < 0) decrypted += 32;
-            result += static_cast<wchar_t>(L'а' + decrypted);
-        }
-        else if (c >= L'A' && c <= L'Z') {
-            uint64_t y = static_cast<uint64_t>(c - L'A');
-            int64_t decrypted = (a_inv_eng * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 26)) % 26;
-            if (decrypted < 0) decrypted += 26;
-            result += static_cast<wchar_t>(L'A' + decrypted);
-        }
-        else if (c >= L'a' && c <= L'z') {
-            uint64_t y = static_cast<uint64_t>(c - L'a');
-            int64_t decrypted = (a_inv_eng * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 26)) % 26;
-            if (decrypted < 0) decrypted += 26;
-            result += static_cast<wchar_t>(L'a' + decrypted);
-        }
-        else if (c >= L'0' && c <= L'9') {
-            uint64_t y = static_cast<uint64_t>(c - L'0');
-            int64_t decrypted = (a_inv_dig * (static_cast<int64_t>(y) - static_cast<int64_t>(b) + 10)) % 10;
-            if (decrypted < 0) decrypted += 10;
-            result += static_cast<wchar_t>(L'0' + decrypted);
-        }
-        else if (isSpecialSymbolWide(c)) {
-            if (a_inv_sym != -1) {
-                uint64_t symbol_index = getSpecialSymbolIndex(c);
-                int64_t decrypted_index = (a_inv_sym * (static_cast<int64_t>(symbol_index) - static_cast<int64_t>(b) + 33)) % 33;
-                if (decrypted_index < 0) decrypted_index += 33;
-                wchar_t decrypted_char = getSpecialSymbolFromIndex(static_cast<uint64_t>(decrypted_index));
-                result += decrypted_char;
-            } else {
-                result += c;
-            }
-        }
-        else {
-            result += c;
+void affineEncryptBinary(span<const unsigned char> data, span<unsigned char> result, uint64_t a, uint64_t b) {
+    checkAffineOutput(data.size(), result.size());
+    // (a * x + b) % 256 зависит только от младших байтов a и b
+    unsigned char a8 = static_cast<unsigned char>(a);
+    unsigned char b8 = static_cast<unsigned char>(b);
+    cipherKernels().affineBytes(data.data(), result.data(), data.size(), a8, b8);
+}
+
+void affineDecryptBinary(span<const unsigned char> data, span<unsigned char> result, uint64_t a, uint64_t b) {
+    checkAffineOutput(data.size(), result.size());
+    int64_t a_inv = modInverse(a, 256);
+    if (a_inv == -1) {
+        if (data.data() != result.data()) {
+            copy(data.begin(), data.end(), result.begin());
         }
+        return;
     }
+
+    // a_inv * (y - b) = a_inv * y + (-a_inv * b) - то же ядро, что и для шифрования
+    unsigned char inv8 = static_cast<unsigned char>(a_inv);
+    unsigned char shift = static_cast<unsigned char>(-(inv8 * static_cast<unsigned char>(b)));
+    cipherKernels().affineBytes(data.data(), result.data(), data.size(), inv8, shift);
+}
+
+wstring affineEncryptWide(const wstring& text, uint64_t a, uint64_t b) {
+    wstring result(text.size(), L' ');
+    affineEncryptWide(span<const wchar_t>(text), span<wchar_t>(result), a, b);
+    return result;
+}
+
+wstring affineDecryptWide(const wstring& text, uint64_t a, uint64_t b) {
+    wstring result(text.size(), L' ');
+    affineDecryptWide(span<const wchar_t>(text), span<wchar_t>(result), a, b);
     return result;
 }
 
 vector<unsigned char> affineEncryptBinary(const vector<unsigned char>& data, uint64_t a, uint64_t b) {
-    vector<unsigned char> result;
-    result.reserve(data.size());
-    
-    for (unsigned char byte : data) {
-        uint64_t encrypted = (a * static_cast<uint64_t>(byte) + b) % 256;
-        result.push_back(static_cast<unsigned char>(encrypted));
-    }
-    
+    vector<unsigned char> result(data.size());
+    affineEncryptBinary(span<const unsigned char>(data), span<unsigned char>(result), a, b);
     return result;
 }
 
 vector<unsigned char> affineDecryptBinary(const vector<unsigned char>& data, uint64_t a, uint64_t b) {
-    vector<unsigned char> result;
-    result.reserve(data.size());
-    
-    int64_t a_inv = modInverse(a, 256);
-    if (a_inv == -1) {
-        return data; 
-    }
-    
-    for (unsigned char byte : data) {
-        int64_t decrypted = (a_inv * (static_cast<int64_t>(byte) - static_cast<int64_t>(b) + 256)) % 256;
-        if (decrypted < 0) decrypted += 256;
-        result.push_back(static_cast<unsigned char>(decrypted));
-    }
-    
+    vector<unsigned char> result(data.size());
+    affineDecryptBinary(span<const unsigned char>(data), span<unsigned char>(result), a, b);
     return result;
 }
 
@@ -332,13 +361,19 @@ void affine() {
                 wstring decryptedFilename;
                 getline(wcin, decryptedFilename);
 
+                OperationMetrics metrics("affine.text_file");
+                WorkerThreadsScope threads(planTextThreads("affine.text_file", inputFilename, ContainerCipher::AFFINE, true));
                 wstring originalText = readTextFile(inputFilename);
                 if (originalText.empty()) {
                     wcout << L"Не удалось прочитать файл или файл пуст." << endl;
                     break;
                 }
 
-                wstring encryptedText = affineEncryptWide(originalText, a, b);
+                wstring encryptedText;
+                {
+                    StageTimer timer(MetricStage::ENCRYPT, originalText.size() * sizeof(wchar_t));
+                    encryptedText = affineEncryptWide(originalText, a, b);
+                }
                 if (writeTextFile(encryptedFilename, encryptedText)) {
                     wcout << L"Текст успешно зашифрован и записан в: " << encryptedFilename << endl;
                 } else {
@@ -346,7 +381,11 @@ void affine() {
                     break;
                 }
 
-                wstring decryptedText = affineDecryptWide(encryptedText, a, b);
+                wstring decryptedText;
+                {
+                    StageTimer timer(MetricStage::DECRYPT, encryptedText.size() * sizeof(wchar_t));
+                    decryptedText = affineDecryptWide(encryptedText, a, b);
+                }
                 if (writeTextFile(decryptedFilename, decryptedText)) {
                     wcout << L"Текст успешно расшифрован и записан в: " << decryptedFilename << endl;
                 } else {
@@ -374,22 +413,24 @@ void affine() {
                 wstring decryptedImage;
                 getline(wcin, decryptedImage);
 
-                vector<unsigned char> originalData = readBinaryFile(inputImage);
-                if (originalData.empty()) {
+                OperationMetrics metrics("affine.image_file");
+                CipherKey cipherKey;
+                cipherKey.cipher = ContainerCipher::AFFINE;
+                cipherKey.a = a;
+                cipherKey.b = b;
+                FileResult result = transformBinaryFile("affine.image_file", inputImage, encryptedImage, cipherKey, true);
+                if (result == FileResult::READ_FAILED) {
                     wcout << L"Не удалось прочитать изображение или файл пуст." << endl;
                     break;
                 }
-
-                vector<unsigned char> encryptedData = affineEncryptBinary(originalData, a, b);
-                if (writeBinaryFile(encryptedImage, encryptedData)) {
+                if (result == FileResult::OK) {
                     wcout << L"Изображение зашифровано и записано в: " << encryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи зашифрованного изображения." << endl;
                     break;
                 }
 
-                vector<unsigned char> decryptedData = affineDecryptBinary(encryptedData, a, b);
-                if (writeBinaryFile(decryptedImage, decryptedData)) {
+                if (transformBinaryFile("affine.image_file", encryptedImage, decryptedImage, cipherKey, false) == FileResult::OK) {
                     wcout << L"Изображение расшифровано и записано в: " << decryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи расшифрованного изображения." << endl;
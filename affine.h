@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <span>
 
 uint64_t gcd(uint64_t a, uint64_t b);
 int64_t modInverse(uint64_t a, uint64_t m);
@@ -17,6 +18,13 @@ std::wstring affineDecryptWide(const std::wstring& text, uint64_t a, uint64_t b)
 std::vector<unsigned char> affineEncryptBinary(const std::vector<unsigned char>& data, uint64_t a, uint64_t b);
 std::vector<unsigned char> affineDecryptBinary(const std::vector<unsigned char>& data, uint64_t a, uint64_t b);
 
+// Варианты без выделения памяти: result должен быть не короче входа,
+// result может совпадать со входом (шифрование на месте).
+void affineEncryptWide(std::span<const wchar_t> text, std::span<wchar_t> result, uint64_t a, uint64_t b);
+void affineDecryptWide(std::span<const wchar_t> text, std::span<wchar_t> result, uint64_t a, uint64_t b);
+void affineEncryptBinary(std::span<const unsigned char> data, std::span<unsigned char> result, uint64_t a, uint64_t b);
+void affineDecryptBinary(std::span<const unsigned char> data, std::span<unsigned char> result, uint64_t a, uint64_t b);
+
 bool isValidTextKey(uint64_t a);
 bool isValidBinaryKey(uint64_t a);
 
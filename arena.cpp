@@ -0,0 +1,98 @@
+#include "arena.h"
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+const size_t MIN_BLOCK = 64 * 1024;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+ScratchArena::~ScratchArena() {
+    for (const Block& block : blocks) {
+        ::operator delete(block.data);
+    }
+}
+
+void* ScratchArena::allocateBytes(size_t bytes, size_t alignment) {
+    if (!blocks.empty()) {
+        size_t start = alignUp(offset, alignment);
+        if (start + bytes <= blocks[current].size) {
+            offset = start + bytes;
+            return blocks[current].data + start;
+        }
+        // Блоки после текущего свободны: они остались от прошлых операций
+        for (size_t next = current + 1; next < blocks.size(); next++) {
+            if (bytes <= blocks[next].size) {
+                current = next;
+                offset = bytes;
+                return blocks[next].data;
+            }
+        }
+    }
+
+    size_t size = max(MIN_BLOCK, bytes);
+    if (!blocks.empty()) {
+        size = max(size, blocks.back().size * 2);
+    }
+    Block block = { static_cast<unsigned char*>(::operator new(size)), size };
+    blocks.push_back(block);
+    current = blocks.size() - 1;
+    offset = bytes;
+    return block.data;
+}
+
+ScratchArena::Mark ScratchArena::mark() const {
+    return { current, offset };
+}
+
+void ScratchArena::release(Mark position) {
+    current = position.block;
+    offset = position.offset;
+    if (current == 0 && offset == 0) {
+        coalesce();
+    }
+}
+
+// Вызывается, когда арена пуста: несколько блоков заменяются одним
+// суммарного размера, слишком большой объём возвращается системе.
+void ScratchArena::coalesce() {
+    size_t total = capacity();
+    if (blocks.size() <= 1 && total <= RETAIN_LIMIT) return;
+
+    for (const Block& block : blocks) {
+        ::operator delete(block.data);
+    }
+    blocks.clear();
+    if (total <= RETAIN_LIMIT) {
+        blocks.push_back({ static_cast<unsigned char*>(::operator new(total)), total });
+    }
+}
+
+size_t ScratchArena::capacity() const {
+    size_t total = 0;
+    for (const Block& block : blocks) {
+        total += block.size;
+    }
+    return total;
+}
+
+size_t ScratchArena::used() const {
+    if (blocks.empty()) return 0;
+    size_t total = offset;
+    for (size_t b = 0; b < current; b++) {
+        total += blocks[b].size;
+    }
+    return total;
+}
+
+ScratchArena& threadArena() {
+    thread_local ScratchArena arena;
+    return arena;
+}
@@ -0,0 +1,84 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Память для промежуточных буферов шифров. Выделение - сдвиг указателя в
+// блоке, освобождение - откат к отметке в конце операции. Когда операция
+// не уместилась в один блок, после её завершения блоки сливаются в один
+// достаточного размера, и следующие операции того же объёма обходятся без
+// обращений к куче.
+class ScratchArena {
+public:
+    // Сколько памяти арена удерживает между операциями; больший блок
+    // возвращается системе, как только арена освобождается полностью.
+    static const size_t RETAIN_LIMIT = 16 * 1024 * 1024;
+
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    ScratchArena() = default;
+    ~ScratchArena();
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // Неинициализированный массив; годится только для тривиальных типов.
+    template <typename T>
+    std::span<T> allocate(size_t count) {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                      "ScratchArena: only trivial types are supported");
+        if (count == 0) return {};
+        return std::span<T>(static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T))), count);
+    }
+
+    Mark mark() const;
+    void release(Mark position);
+
+    size_t capacity() const;
+    size_t used() const;
+
+private:
+    struct Block {
+        unsigned char* data;
+        size_t size;
+    };
+
+    void* allocateBytes(size_t bytes, size_t alignment);
+    void coalesce();
+
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+};
+
+// Арена текущего потока.
+ScratchArena& threadArena();
+
+// Область операции: всё, что выделено через неё (или через арену) после
+// создания, освобождается в деструкторе. Области вкладываются.
+class ArenaScope {
+public:
+    explicit ArenaScope(ScratchArena& arena = threadArena()) : arena(arena), position(arena.mark()) {}
+    ~ArenaScope() { arena.release(position); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    template <typename T>
+    std::span<T> allocate(size_t count) {
+        return arena.template allocate<T>(count);
+    }
+
+private:
+    ScratchArena& arena;
+    ScratchArena::Mark position;
+};
+
+#endif
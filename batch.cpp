@@ -0,0 +1,161 @@
+#include "batch.h"
+#include "affine.h"
+#include "transposition.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+namespace {
+
+// Символы пробы для построения таблиц перестановок: за пределами Юникода,
+// поэтому не совпадают ни с дополнением шифра, ни с пробелом.
+const wchar_t BATCH_PROBE_BASE = 0x110000;
+
+const wchar_t TABLE_TEXT_PAD = L'x';  // дополнение табличного шифра в тексте (table.cpp)
+
+// Все символы, которые меняет Аффинный шифр, - не дальше 'я'.
+const size_t AFFINE_TABLE_SIZE = static_cast<size_t>(L'я') + 1;
+
+void checkOffsets(span<const uint64_t> offsets, size_t dataSize) {
+    if (offsets.empty()) throw invalid_argument("batch: offsets must contain at least one element");
+    for (size_t i = 1; i < offsets.size(); i++) {
+        if (offsets[i] < offsets[i - 1]) throw invalid_argument("batch: offsets must not decrease");
+    }
+    if (offsets.back() > static_cast<uint64_t>(dataSize)) throw invalid_argument("batch: offsets exceed data");
+}
+
+// Аффинный шифр: границы сообщений не нужны - у результата они те же.
+void shiftOffsets(span<const uint64_t> offsets, vector<uint64_t>& outputOffsets) {
+    outputOffsets.resize(offsets.size());
+    for (size_t i = 0; i < offsets.size(); i++) {
+        outputOffsets[i] = offsets[i] - offsets[0];
+    }
+}
+
+}
+
+BatchCipher::BatchCipher(const CipherKey& key) : key(key), cipher(makeCipher(key)) {
+    if (key.cipher != ContainerCipher::AFFINE) return;
+    vector<wchar_t> probe(AFFINE_TABLE_SIZE);
+    for (size_t c = 0; c < probe.size(); c++) {
+        probe[c] = static_cast<wchar_t>(c);
+    }
+    encryptTable.resize(AFFINE_TABLE_SIZE);
+    decryptTable.resize(AFFINE_TABLE_SIZE);
+    affineEncryptWide(span<const wchar_t>(probe), span<wchar_t>(encryptTable), key.a, key.b);
+    affineDecryptWide(span<const wchar_t>(probe), span<wchar_t>(decryptTable), key.a, key.b);
+}
+
+const BatchCipher::Plan& BatchCipher::plan(uint64_t length, bool encrypt) {
+    size_t index = static_cast<size_t>(length * 2 + (encrypt ? 1 : 0));
+    if (index >= plans.size()) plans.resize(index + 1);
+    Plan& plan = plans[index];
+    if (plan.built) return plan;
+
+    // Перестановка зависит только от длины: шифр на различимых символах
+    // показывает, откуда берётся каждый символ результата
+    vector<wchar_t> probe(static_cast<size_t>(length));
+    for (size_t i = 0; i < probe.size(); i++) {
+        probe[i] = BATCH_PROBE_BASE + static_cast<wchar_t>(i);
+    }
+    vector<wchar_t> result(cipher->requiredOutputSize(probe.size(), encrypt));
+    result.resize(cipher->transform(span<const wchar_t>(probe), span<wchar_t>(result), encrypt));
+
+    plan.source.resize(result.size());
+    for (size_t j = 0; j < result.size(); j++) {
+        if (result[j] >= BATCH_PROBE_BASE) {
+            plan.source[j] = static_cast<uint32_t>(result[j] - BATCH_PROBE_BASE);
+        } else {
+            plan.source[j] = PLAN_PAD;
+            plan.pad = result[j];
+        }
+    }
+    plan.built = true;
+    return plan;
+}
+
+template <typename T>
+void BatchCipher::permute(span<const T> data, span<const uint64_t> offsets, bool encrypt, vector<T>& output,
+                          vector<uint64_t>& outputOffsets) {
+    const size_t count = offsets.size() - 1;
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += cipher->requiredOutputSize(static_cast<size_t>(offsets[i + 1] - offsets[i]), encrypt);
+    }
+    output.resize(static_cast<size_t>(total));
+    outputOffsets.assign(offsets.size(), 0);
+
+    const bool table = key.cipher == ContainerCipher::TABLE;
+    constexpr bool text = is_same_v<T, wchar_t>;
+    const T trimPad = text ? static_cast<T>(TABLE_TEXT_PAD) : T(0);
+    uint64_t position = 0;
+    for (size_t i = 0; i < count; i++) {
+        span<const T> message = data.subspan(static_cast<size_t>(offsets[i]),
+                                             static_cast<size_t>(offsets[i + 1] - offsets[i]));
+        T* out = output.data() + position;
+        size_t size;
+        if (message.size() > BATCH_PLAN_MAX_LENGTH) {
+            size = cipher->transform(message, span<T>(out, output.size() - static_cast<size_t>(position)), encrypt);
+        } else {
+            span<const T> clean = message;
+            if constexpr (text) {
+                // Табличный шифр пропускает пробелы - перестановка по длине без них
+                if (table && find(message.begin(), message.end(), L' ') != message.end()) {
+                    scratch.clear();
+                    copy_if(message.begin(), message.end(), back_inserter(scratch), [](wchar_t c) { return c != L' '; });
+                    clean = span<const T>(scratch);
+                }
+            }
+            const Plan& order = plan(clean.size(), encrypt);
+            applyIndex(clean.data(), out, order.source, text ? static_cast<T>(order.pad) : T(0));
+            size = order.source.size();
+            if (table && !encrypt) {
+                while (size > 0 && out[size - 1] == trimPad) {
+                    size--;
+                }
+            }
+        }
+        position += size;
+        outputOffsets[i + 1] = position;
+    }
+    output.resize(static_cast<size_t>(position));
+}
+
+void BatchCipher::transform(span<const wchar_t> data, span<const uint64_t> offsets, bool encrypt,
+                            vector<wchar_t>& output, vector<uint64_t>& outputOffsets) {
+    checkOffsets(offsets, data.size());
+    if (key.cipher != ContainerCipher::AFFINE) {
+        permute(data, offsets, encrypt, output, outputOffsets);
+        return;
+    }
+
+    span<const wchar_t> packed = data.subspan(static_cast<size_t>(offsets.front()),
+                                              static_cast<size_t>(offsets.back() - offsets.front()));
+    output.resize(packed.size());
+    const wchar_t* substitution = encrypt ? encryptTable.data() : decryptTable.data();
+    const wchar_t* in = packed.data();
+    wchar_t* out = output.data();
+    for (size_t i = 0; i < packed.size(); i++) {
+        uint32_t c = static_cast<uint32_t>(in[i]);
+        out[i] = c < AFFINE_TABLE_SIZE ? substitution[c] : in[i];
+    }
+    shiftOffsets(offsets, outputOffsets);
+}
+
+void BatchCipher::transform(span<const unsigned char> data, span<const uint64_t> offsets, bool encrypt,
+                            vector<unsigned char>& output, vector<uint64_t>& outputOffsets) {
+    checkOffsets(offsets, data.size());
+    if (key.cipher != ContainerCipher::AFFINE) {
+        permute(data, offsets, encrypt, output, outputOffsets);
+        return;
+    }
+
+    span<const unsigned char> packed = data.subspan(static_cast<size_t>(offsets.front()),
+                                                    static_cast<size_t>(offsets.back() - offsets.front()));
+    output.resize(packed.size());
+    cipher->transform(packed, span<unsigned char>(output), encrypt);
+    shiftOffsets(offsets, outputOffsets);
+}
@@ -0,0 +1,65 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "container.h"
+#include <memory>
+#include <span>
+#include <vector>
+#include <cstdint>
+
+// Пакет коротких сообщений (идентификаторы, имена): тысячи сообщений лежат
+// подряд в одном буфере, их границы - в массиве смещений offsets из n + 1
+// элементов (сообщение i - [offsets[i], offsets[i + 1])). Результаты
+// возвращаются так же: подряд в output, границы в outputOffsets
+// (outputOffsets[0] == 0).
+//
+// Подготовка ключа делается один раз на пакет, а не на сообщение:
+//   - Аффинный шифр заменяет символы по одному, поэтому границы сообщений ему
+//     не нужны - весь пакет проходит одним циклом: двоичный - ядром
+//     cpu_dispatch, текст - по таблице замены всех символов до 'я' (символы
+//     дальше шифр не меняет), построенной при создании объекта для обоих
+//     направлений;
+//   - Скитала и табличный шифр переставляют позиции, и перестановка зависит
+//     только от длины сообщения: для каждой встреченной длины таблица индексов
+//     строится один раз (прогоном шифра на различимых символах) и хранится в
+//     объекте, дальше каждое сообщение - выборка по ней. Сообщения длиннее
+//     BATCH_PLAN_MAX_LENGTH шифруются обычным Cipher::transform.
+// Результат совпадает с Cipher::transform над каждым сообщением по отдельности.
+//
+// Объект хранит таблицы между вызовами и не должен использоваться из
+// нескольких потоков одновременно: потоку - свой объект.
+
+const uint64_t BATCH_PLAN_MAX_LENGTH = 4096;
+
+class BatchCipher {
+public:
+    // invalid_argument для недопустимого ключа (makeCipher).
+    explicit BatchCipher(const CipherKey& key);
+
+    // offsets - неубывающие, offsets.back() <= data.size(), иначе invalid_argument.
+    void transform(std::span<const wchar_t> data, std::span<const uint64_t> offsets, bool encrypt,
+                   std::vector<wchar_t>& output, std::vector<uint64_t>& outputOffsets);
+    void transform(std::span<const unsigned char> data, std::span<const uint64_t> offsets, bool encrypt,
+                   std::vector<unsigned char>& output, std::vector<uint64_t>& outputOffsets);
+
+private:
+    struct Plan {
+        std::vector<uint32_t> source;  // out[j] = in[source[j]] или дополнение (PLAN_PAD)
+        wchar_t pad = L' ';            // дополнение текста; у двоичных данных - 0
+        bool built = false;
+    };
+
+    const Plan& plan(uint64_t length, bool encrypt);
+    template <typename T>
+    void permute(std::span<const T> data, std::span<const uint64_t> offsets, bool encrypt, std::vector<T>& output,
+                 std::vector<uint64_t>& outputOffsets);
+
+    CipherKey key;
+    std::unique_ptr<Cipher> cipher;
+    std::vector<wchar_t> encryptTable;  // Аффинный шифр, текст: замена символа c < size()
+    std::vector<wchar_t> decryptTable;
+    std::vector<Plan> plans;  // по индексу длина * 2 + encrypt
+    std::vector<wchar_t> scratch;
+};
+
+#endif
@@ -0,0 +1,354 @@
+// Микробенчмарки шифров. Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. bench/bench.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o rgr_bench
+// Результаты - по одному JSON-объекту на строку (stdout или --out).
+#include "affine.h"
+#include "skytale.h"
+#include "table.h"
+#include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct Options {
+    uint64_t minSize = 64;
+    uint64_t maxSize = 64ull << 20;
+    vector<uint64_t> keys = { 2, 16, 256, 4096 };
+    string filter;
+    string outFile;
+    string tmpDir = "/tmp";
+    double minTime = 0.2;
+    uint64_t seed = 2024;
+};
+
+enum class InputKind {
+    BINARY,
+    TEXT,
+    FILE_IO
+};
+
+struct Benchmark {
+    string name;
+    InputKind kind;
+    bool keyed;
+};
+
+uint64_t parseSize(const string& value) {
+    char* end = nullptr;
+    double number = strtod(value.c_str(), &end);
+    uint64_t multiplier = 1;
+    if (end && *end) {
+        switch (*end) {
+            case 'k': case 'K': multiplier = 1ull << 10; break;
+            case 'm': case 'M': multiplier = 1ull << 20; break;
+            case 'g': case 'G': multiplier = 1ull << 30; break;
+        }
+    }
+    return static_cast<uint64_t>(number * static_cast<double>(multiplier));
+}
+
+vector<uint64_t> parseList(const string& value) {
+    vector<uint64_t> result;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == string::npos) end = value.size();
+        if (end > start) result.push_back(parseSize(value.substr(start, end - start)));
+        start = end + 1;
+    }
+    return result;
+}
+
+// Синтетический текст: слова из русских и английских букв, цифры, знаки
+// препинания и переводы строк примерно в пропорциях обычного документа.
+wstring generateText(uint64_t utf8Bytes, mt19937_64& gen) {
+    static const wstring russian = L"абвгдежзийклмнопрстуфхцчшщъыьэюяАБВГДЕЖЗИЙКЛМНОПРСТУФХЦЧШЩЪЫЬЭЮЯ";
+    static const wstring english = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const wstring punctuation = L".,;:!?-()\"";
+
+    wstring text;
+    text.reserve(static_cast<size_t>(utf8Bytes));
+    uint64_t bytes = 0;
+    while (bytes < utf8Bytes) {
+        uint64_t choice = gen() % 100;
+        uint64_t wordLength = 1 + gen() % 10;
+        for (uint64_t i = 0; i < wordLength && bytes < utf8Bytes; i++) {
+            if (choice < 60) {
+                text += russian[gen() % russian.size()];
+                bytes += 2;
+            } else if (choice < 90) {
+                text += english[gen() % english.size()];
+                bytes += 1;
+            } else {
+                text += static_cast<wchar_t>(L'0' + gen() % 10);
+                bytes += 1;
+            }
+        }
+        if (bytes >= utf8Bytes) break;
+        uint64_t separator = gen() % 20;
+        text += separator == 0 ? punctuation[gen() % punctuation.size()] : (separator == 1 ? L'\n' : L' ');
+        bytes += 1;
+    }
+    return text;
+}
+
+// Синтетические двоичные данные: участки случайных байтов, повторов и
+// плавных градиентов, как в несжатых изображениях.
+vector<unsigned char> generateBinary(uint64_t size, mt19937_64& gen) {
+    vector<unsigned char> data(static_cast<size_t>(size));
+    uint64_t pos = 0;
+    while (pos < size) {
+        uint64_t run = min<uint64_t>(size - pos, 64 + gen() % 4096);
+        uint64_t kind = gen() % 3;
+        unsigned char value = static_cast<unsigned char>(gen());
+        for (uint64_t i = 0; i < run; i++) {
+            if (kind == 0) data[pos + i] = static_cast<unsigned char>(gen());
+            else if (kind == 1) data[pos + i] = value;
+            else data[pos + i] = static_cast<unsigned char>(value + i / 16);
+        }
+        pos += run;
+    }
+    return data;
+}
+
+wstring tableKeyOfLength(uint64_t length, mt19937_64& gen) {
+    wstring key;
+    for (uint64_t i = 0; i < length; i++) {
+        key += static_cast<wchar_t>(L'А' + gen() % 64);
+    }
+    return key;
+}
+
+uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct Measurement {
+    uint64_t iterations = 0;
+    double seconds = 0;
+    uint64_t cycles = 0;
+};
+
+Measurement measure(const function<void()>& body, double minTime) {
+    Measurement result;
+    auto start = chrono::steady_clock::now();
+    uint64_t startCycles = readCycles();
+    do {
+        body();
+        result.iterations++;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (result.seconds < minTime);
+    result.cycles = readCycles() - startCycles;
+    return result;
+}
+
+void report(FILE* out, const string& name, uint64_t size, uint64_t key, const Measurement& m, const PeakRss& peak) {
+    double bytes = static_cast<double>(size) * static_cast<double>(m.iterations);
+    fprintf(out, "{\"kernel\":\"%s\",\"isa\":\"%s\",\"bytes\":%llu,\"key\":%llu,\"iterations\":%llu,\"seconds\":%.6f,"
+                 "\"bytes_per_second\":%.1f,\"cycles_per_byte\":",
+            name.c_str(), isaLevelName(activeIsaLevel()), static_cast<unsigned long long>(size), static_cast<unsigned long long>(key),
+            static_cast<unsigned long long>(m.iterations), m.seconds, bytes / m.seconds);
+    if (m.cycles != 0) {
+        fprintf(out, "%.3f", static_cast<double>(m.cycles) / bytes);
+    } else {
+        fprintf(out, "null");
+    }
+    long delta = peak.deltaKb();
+    if (delta >= 0) {
+        fprintf(out, ",\"peak_rss_delta_kb\":%ld}\n", delta);
+    } else {
+        fprintf(out, ",\"peak_rss_delta_kb\":null}\n");
+    }
+    fflush(out);
+}
+
+void runBinary(FILE* out, const Benchmark& b, const vector<unsigned char>& data, uint64_t key, const Options& options, mt19937_64& gen) {
+    PeakRss peak;
+    peak.reset();
+    volatile size_t sink = 0;
+    Measurement m;
+    const string& n = b.name;
+
+    if (n == "affineEncryptBinary") {
+        m = measure([&] { sink = affineEncryptBinary(data, 7, 3).size(); }, options.minTime);
+    } else if (n == "affineDecryptBinary") {
+        vector<unsigned char> encrypted = affineEncryptBinary(data, 7, 3);
+        m = measure([&] { sink = affineDecryptBinary(encrypted, 7, 3).size(); }, options.minTime);
+    } else if (n == "transformSkytaleBinary.encrypt") {
+        m = measure([&] { sink = transformSkytaleBinary(data, key, true).size(); }, options.minTime);
+    } else if (n == "transformSkytaleBinary.decrypt") {
+        vector<unsigned char> encrypted = transformSkytaleBinary(data, key, true);
+        m = measure([&] { sink = transformSkytaleBinary(encrypted, key, false).size(); }, options.minTime);
+    } else if (n == "encryptTableBinary") {
+        wstring tableKey = tableKeyOfLength(key, gen);
+        m = measure([&] { sink = encryptTableBinary(data, tableKey).size(); }, options.minTime);
+    } else if (n == "decryptTableBinary") {
+        wstring tableKey = tableKeyOfLength(key, gen);
+        vector<unsigned char> encrypted = encryptTableBinary(data, tableKey);
+        m = measure([&] { sink = decryptTableBinary(encrypted, tableKey).size(); }, options.minTime);
+    }
+    (void)sink;
+    report(out, n, data.size(), key, m, peak);
+}
+
+void runText(FILE* out, const Benchmark& b, const wstring& text, uint64_t size, uint64_t key, const Options& options, mt19937_64& gen) {
+    PeakRss peak;
+    peak.reset();
+    volatile size_t sink = 0;
+    Measurement m;
+    const string& n = b.name;
+
+    if (n == "affineEncryptWide") {
+        m = measure([&] { sink = affineEncryptWide(text, 7, 3).size(); }, options.minTime);
+    } else if (n == "affineDecryptWide") {
+        wstring encrypted = affineEncryptWide(text, 7, 3);
+        m = measure([&] { sink = affineDecryptWide(encrypted, 7, 3).size(); }, options.minTime);
+    } else if (n == "transformSkytaleText.encrypt") {
+        m = measure([&] { sink = transformSkytaleText(text, key, true).size(); }, options.minTime);
+    } else if (n == "transformSkytaleText.decrypt") {
+        wstring encrypted = transformSkytaleText(text, key, true);
+        m = measure([&] { sink = transformSkytaleText(encrypted, key, false).size(); }, options.minTime);
+    } else if (n == "encryptTable") {
+        wstring tableKey = tableKeyOfLength(key, gen);
+        m = measure([&] { sink = encryptTable(tableKey, text).size(); }, options.minTime);
+    } else if (n == "decryptTable") {
+        wstring tableKey = tableKeyOfLength(key, gen);
+        wstring encrypted = encryptTable(tableKey, text);
+        m = measure([&] { sink = decryptTable(tableKey, encrypted).size(); }, options.minTime);
+    }
+    (void)sink;
+    report(out, n, size, key, m, peak);
+}
+
+void runFile(FILE* out, const Benchmark& b, const wstring& text, uint64_t size, const Options& options) {
+    PeakRss peak;
+    peak.reset();
+    wstring path = s2ws(options.tmpDir + "/rgr_bench_" + to_string(size) + ".txt");
+    volatile size_t sink = 0;
+    Measurement m;
+
+    if (b.name == "writeTextFile") {
+        m = measure([&] { sink = writeTextFile(path, text); }, options.minTime);
+    } else if (b.name == "readTextFile") {
+        writeTextFile(path, text);
+        m = measure([&] { sink = readTextFile(path).size(); }, options.minTime);
+    }
+    (void)sink;
+    remove(ws2s(path).c_str());
+    report(out, b.name, size, 0, m, peak);
+}
+
+void printUsage() {
+    fprintf(stderr,
+            "Использование: rgr_bench [--min-size N] [--max-size N] [--sizes N,N,...] [--keys K,K,...]\n"
+            "                 [--filter ИМЯ] [--min-time СЕК] [--out ФАЙЛ] [--tmpdir КАТАЛОГ] [--list]\n"
+            "Размеры принимают суффиксы K, M, G.\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    vector<uint64_t> sizes;
+    bool listOnly = false;
+
+    const vector<Benchmark> benchmarks = {
+        { "affineEncryptBinary", InputKind::BINARY, false },
+        { "affineDecryptBinary", InputKind::BINARY, false },
+        { "affineEncryptWide", InputKind::TEXT, false },
+        { "affineDecryptWide", InputKind::TEXT, false },
+        { "transformSkytaleBinary.encrypt", InputKind::BINARY, true },
+        { "transformSkytaleBinary.decrypt", InputKind::BINARY, true },
+        { "transformSkytaleText.encrypt", InputKind::TEXT, true },
+        { "transformSkytaleText.decrypt", InputKind::TEXT, true },
+        { "encryptTableBinary", InputKind::BINARY, true },
+        { "decryptTableBinary", InputKind::BINARY, true },
+        { "encryptTable", InputKind::TEXT, true },
+        { "decryptTable", InputKind::TEXT, true },
+        { "readTextFile", InputKind::FILE_IO, false },
+        { "writeTextFile", InputKind::FILE_IO, false },
+    };
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--min-size" && hasValue) options.minSize = parseSize(argv[++i]);
+        else if (arg == "--max-size" && hasValue) options.maxSize = parseSize(argv[++i]);
+        else if (arg == "--sizes" && hasValue) sizes = parseList(argv[++i]);
+        else if (arg == "--keys" && hasValue) options.keys = parseList(argv[++i]);
+        else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+        else if (arg == "--min-time" && hasValue) options.minTime = atof(argv[++i]);
+        else if (arg == "--out" && hasValue) options.outFile = argv[++i];
+        else if (arg == "--tmpdir" && hasValue) options.tmpDir = argv[++i];
+        else if (arg == "--seed" && hasValue) options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--list") listOnly = true;
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (listOnly) {
+        for (const Benchmark& b : benchmarks) printf("%s\n", b.name.c_str());
+        return 0;
+    }
+
+    if (sizes.empty()) {
+        for (uint64_t size = options.minSize; size <= options.maxSize; size *= 4) {
+            sizes.push_back(size);
+            if (size > options.maxSize / 4) break;
+        }
+    }
+
+    FILE* out = stdout;
+    if (!options.outFile.empty()) {
+        out = fopen(options.outFile.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Не удалось открыть %s\n", options.outFile.c_str());
+            return 1;
+        }
+    }
+
+    mt19937_64 gen(options.seed);
+    for (uint64_t size : sizes) {
+        vector<unsigned char> data;
+        wstring text;
+        for (const Benchmark& b : benchmarks) {
+            if (!options.filter.empty() && b.name.find(options.filter) == string::npos) continue;
+
+            if (b.kind == InputKind::BINARY && data.empty()) data = generateBinary(size, gen);
+            if (b.kind != InputKind::BINARY && text.empty()) text = generateText(size, gen);
+
+            if (b.kind == InputKind::FILE_IO) {
+                runFile(out, b, text, size, options);
+                continue;
+            }
+            for (uint64_t key : b.keyed ? options.keys : vector<uint64_t>{ 0 }) {
+                if (b.kind == InputKind::BINARY) runBinary(out, b, data, key, options, gen);
+                else runText(out, b, text, size, key, options, gen);
+            }
+        }
+    }
+
+    if (out != stdout) fclose(out);
+    return 0;
+}
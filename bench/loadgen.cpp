@@ -0,0 +1,156 @@
+// Нагрузочный тест резидентного режима (rgr --serve). Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. bench/loadgen.cpp -o rgr_loadgen
+//
+// Несколько соединений без пауз шлют одинаковые запросы заданного размера;
+// в конце печатается JSON-строка с пропускной способностью и задержками.
+#include "daemon_protocol.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Options {
+    string socketPath = "/tmp/rgr.sock";
+    string cipher = "affine";
+    bool text = false;
+    uint64_t size = 1024;
+    unsigned connections = 4;
+    double duration = 5.0;
+};
+
+void usage() {
+    fprintf(stderr,
+            "usage: rgr_loadgen [--socket PATH] [--cipher affine|skytale|table] [--text]\n"
+            "                   [--size BYTES] [--connections N] [--duration SECONDS]\n");
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue) options.socketPath = argv[++i];
+        else if (arg == "--cipher" && hasValue) options.cipher = argv[++i];
+        else if (arg == "--text") options.text = true;
+        else if (arg == "--size" && hasValue) options.size = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--connections" && hasValue) options.connections = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--duration" && hasValue) options.duration = strtod(argv[++i], nullptr);
+        else return false;
+    }
+    return options.connections > 0 && options.duration > 0;
+}
+
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    RequestHeader header = {};
+    header.magic = DAEMON_MAGIC;
+    header.encrypt = 1;
+    header.payload = static_cast<uint8_t>(options.text ? DaemonPayload::TEXT : DaemonPayload::BINARY);
+    string key;
+    if (options.cipher == "affine") {
+        uint64_t ab[2] = { 7, 3 };
+        key.assign(reinterpret_cast<const char*>(ab), sizeof(ab));
+        header.cipher = static_cast<uint8_t>(DaemonCipher::AFFINE);
+    } else if (options.cipher == "skytale") {
+        uint64_t value = 16;
+        key.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+        header.cipher = static_cast<uint8_t>(DaemonCipher::SKYTALE);
+    } else if (options.cipher == "table") {
+        key = "криптография";
+        header.cipher = static_cast<uint8_t>(DaemonCipher::TABLE);
+    } else {
+        usage();
+        return 2;
+    }
+    header.keyLength = static_cast<uint32_t>(key.size());
+    header.payloadLength = options.size;
+
+    // Для текста - ASCII, чтобы размер в байтах совпадал с числом символов
+    vector<char> payload(static_cast<size_t>(options.size));
+    mt19937_64 gen(7);
+    for (char& c : payload) {
+        c = options.text ? static_cast<char>('a' + gen() % 26) : static_cast<char>(gen());
+    }
+
+    atomic<bool> failed{ false };
+    vector<vector<double>> latencies(options.connections);
+    vector<thread> clients;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(options.duration));
+
+    for (unsigned c = 0; c < options.connections; c++) {
+        clients.emplace_back([&, c]() {
+            int fd = connectDaemon(options.socketPath.c_str());
+            if (fd < 0) {
+                failed = true;
+                return;
+            }
+            vector<char> result;
+            vector<double>& samples = latencies[c];
+            samples.reserve(1 << 20);
+            while (chrono::steady_clock::now() < deadline) {
+                auto sent = chrono::steady_clock::now();
+                ResponseHeader response;
+                if (!sendRequest(fd, header, key.data(), payload.data()) || !recvAll(fd, &response, sizeof(response)) ||
+                    response.status != static_cast<uint32_t>(DaemonStatus::OK)) {
+                    failed = true;
+                    break;
+                }
+                result.resize(static_cast<size_t>(response.payloadLength));
+                if (!recvAll(fd, result.data(), result.size())) {
+                    failed = true;
+                    break;
+                }
+                samples.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        });
+    }
+    for (thread& client : clients) {
+        client.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (failed) {
+        fprintf(stderr, "rgr_loadgen: request failed (is the server running on %s?)\n", options.socketPath.c_str());
+        return 1;
+    }
+
+    vector<double> all;
+    for (const vector<double>& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    sort(all.begin(), all.end());
+    double requests = static_cast<double>(all.size());
+
+    printf("{\"bench\":\"daemon\",\"cipher\":\"%s\",\"payload\":\"%s\",\"bytes\":%llu,\"connections\":%u,"
+           "\"requests\":%zu,\"seconds\":%.3f,\"requests_per_second\":%.1f,\"bytes_per_second\":%.1f,"
+           "\"p50_us\":%.2f,\"p90_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f}\n",
+           options.cipher.c_str(), options.text ? "text" : "binary", static_cast<unsigned long long>(options.size),
+           options.connections, all.size(), seconds, requests / seconds,
+           requests * static_cast<double>(options.size) / seconds, percentile(all, 0.5), percentile(all, 0.9),
+           percentile(all, 0.99), all.empty() ? 0.0 : all.back());
+    return 0;
+}
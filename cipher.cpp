@@ -0,0 +1,139 @@
+#include "cipher.h"
+#include "affine.h"
+#include "skytale.h"
+#include "table.h"
+#include "probes.h"
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Преобразование между точками transform__begin/end.
+template <typename T, typename Run>
+size_t traced(ProbeCipher cipher, bool encrypt, size_t length, Run run) {
+    RGR_PROBE(transform__begin, static_cast<int>(cipher), static_cast<int>(encrypt), length, sizeof(T));
+    size_t written = run();
+    RGR_PROBE(transform__end, static_cast<int>(cipher), written);
+    return written;
+}
+
+}
+
+AffineCipher::AffineCipher(uint64_t a, uint64_t b) : a(a), b(b) {}
+
+size_t AffineCipher::requiredOutputSize(size_t inputSize, bool) const {
+    return inputSize;
+}
+
+size_t AffineCipher::transform(span<const unsigned char> input, span<unsigned char> output, bool encrypt) const {
+    return traced<unsigned char>(ProbeCipher::AFFINE, encrypt, input.size(), [&] {
+        if (encrypt) {
+            affineEncryptBinary(input, output, a, b);
+        } else {
+            affineDecryptBinary(input, output, a, b);
+        }
+        return input.size();
+    });
+}
+
+size_t AffineCipher::transform(span<const wchar_t> input, span<wchar_t> output, bool encrypt) const {
+    return traced<wchar_t>(ProbeCipher::AFFINE, encrypt, input.size(), [&] {
+        if (encrypt) {
+            affineEncryptWide(input, output, a, b);
+        } else {
+            affineDecryptWide(input, output, a, b);
+        }
+        return input.size();
+    });
+}
+
+size_t AffineCipher::transformInPlace(span<unsigned char> buffer, size_t length, bool encrypt) const {
+    if (length > buffer.size()) {
+        throw length_error("affine: buffer is too small");
+    }
+    return transform(span<const unsigned char>(buffer.first(length)), buffer, encrypt);
+}
+
+size_t AffineCipher::transformInPlace(span<wchar_t> buffer, size_t length, bool encrypt) const {
+    if (length > buffer.size()) {
+        throw length_error("affine: buffer is too small");
+    }
+    return transform(span<const wchar_t>(buffer.first(length)), buffer, encrypt);
+}
+
+SkytaleCipher::SkytaleCipher(uint64_t key) : key(key) {}
+
+size_t SkytaleCipher::requiredOutputSize(size_t inputSize, bool encrypt) const {
+    return static_cast<size_t>(skytaleOutputSize(inputSize, key, encrypt));
+}
+
+size_t SkytaleCipher::transform(span<const unsigned char> input, span<unsigned char> output, bool encrypt) const {
+    return traced<unsigned char>(ProbeCipher::SKYTALE, encrypt, input.size(), [&] {
+        return static_cast<size_t>(transformSkytaleBinary(input, output, key, encrypt));
+    });
+}
+
+size_t SkytaleCipher::transform(span<const wchar_t> input, span<wchar_t> output, bool encrypt) const {
+    return traced<wchar_t>(ProbeCipher::SKYTALE, encrypt, input.size(), [&] {
+        return static_cast<size_t>(transformSkytaleText(input, output, key, encrypt));
+    });
+}
+
+size_t SkytaleCipher::transformInPlace(span<unsigned char> buffer, size_t length, bool encrypt) const {
+    return traced<unsigned char>(ProbeCipher::SKYTALE, encrypt, length, [&] {
+        return static_cast<size_t>(transformSkytaleBinaryInPlace(buffer, length, key, encrypt));
+    });
+}
+
+size_t SkytaleCipher::transformInPlace(span<wchar_t> buffer, size_t length, bool encrypt) const {
+    return traced<wchar_t>(ProbeCipher::SKYTALE, encrypt, length, [&] {
+        return static_cast<size_t>(transformSkytaleTextInPlace(buffer, length, key, encrypt));
+    });
+}
+
+TableCipher::TableCipher(const wstring& key) : columnOrder(getColumnOrder(key)) {
+    if (columnOrder.empty()) {
+        throw invalid_argument("table: key must not be empty");
+    }
+}
+
+size_t TableCipher::requiredOutputSize(size_t inputSize, bool encrypt) const {
+    return static_cast<size_t>(tableOutputSize(inputSize, columnOrder.size(), encrypt));
+}
+
+size_t TableCipher::transform(span<const unsigned char> input, span<unsigned char> output, bool encrypt) const {
+    return traced<unsigned char>(ProbeCipher::TABLE, encrypt, input.size(), [&] {
+        if (encrypt) {
+            return static_cast<size_t>(encryptTableBinary(input, output, columnOrder));
+        }
+        return static_cast<size_t>(decryptTableBinary(input, output, columnOrder));
+    });
+}
+
+size_t TableCipher::transform(span<const wchar_t> input, span<wchar_t> output, bool encrypt) const {
+    return traced<wchar_t>(ProbeCipher::TABLE, encrypt, input.size(), [&] {
+        if (encrypt) {
+            return static_cast<size_t>(encryptTable(columnOrder, input, output));
+        }
+        return static_cast<size_t>(decryptTable(columnOrder, input, output));
+    });
+}
+
+size_t TableCipher::transformInPlace(span<unsigned char> buffer, size_t length, bool encrypt) const {
+    return traced<unsigned char>(ProbeCipher::TABLE, encrypt, length, [&] {
+        if (encrypt) {
+            return static_cast<size_t>(encryptTableBinaryInPlace(buffer, length, columnOrder));
+        }
+        return static_cast<size_t>(decryptTableBinaryInPlace(buffer, length, columnOrder));
+    });
+}
+
+size_t TableCipher::transformInPlace(span<wchar_t> buffer, size_t length, bool encrypt) const {
+    return traced<wchar_t>(ProbeCipher::TABLE, encrypt, length, [&] {
+        if (encrypt) {
+            return static_cast<size_t>(encryptTableInPlace(columnOrder, buffer, length));
+        }
+        return static_cast<size_t>(decryptTableInPlace(columnOrder, buffer, length));
+    });
+}
@@ -0,0 +1,71 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+// Единый интерфейс шифров для встраивания: работает с чужими буферами
+// и не выделяет память под результат.
+class Cipher {
+public:
+    virtual ~Cipher() = default;
+
+    // Сколько элементов нужно выделить под результат для входа длины inputSize.
+    virtual size_t requiredOutputSize(size_t inputSize, bool encrypt) const = 0;
+
+    // Возвращают число записанных в output элементов.
+    virtual size_t transform(std::span<const unsigned char> input, std::span<unsigned char> output, bool encrypt) const = 0;
+    virtual size_t transform(std::span<const wchar_t> input, std::span<wchar_t> output, bool encrypt) const = 0;
+
+    // Первые length элементов buffer - вход; buffer.size() >= requiredOutputSize(length, encrypt).
+    virtual size_t transformInPlace(std::span<unsigned char> buffer, size_t length, bool encrypt) const = 0;
+    virtual size_t transformInPlace(std::span<wchar_t> buffer, size_t length, bool encrypt) const = 0;
+};
+
+class AffineCipher : public Cipher {
+public:
+    AffineCipher(uint64_t a, uint64_t b);
+
+    size_t requiredOutputSize(size_t inputSize, bool encrypt) const override;
+    size_t transform(std::span<const unsigned char> input, std::span<unsigned char> output, bool encrypt) const override;
+    size_t transform(std::span<const wchar_t> input, std::span<wchar_t> output, bool encrypt) const override;
+    size_t transformInPlace(std::span<unsigned char> buffer, size_t length, bool encrypt) const override;
+    size_t transformInPlace(std::span<wchar_t> buffer, size_t length, bool encrypt) const override;
+
+private:
+    uint64_t a;
+    uint64_t b;
+};
+
+class SkytaleCipher : public Cipher {
+public:
+    explicit SkytaleCipher(uint64_t key);
+
+    size_t requiredOutputSize(size_t inputSize, bool encrypt) const override;
+    size_t transform(std::span<const unsigned char> input, std::span<unsigned char> output, bool encrypt) const override;
+    size_t transform(std::span<const wchar_t> input, std::span<wchar_t> output, bool encrypt) const override;
+    size_t transformInPlace(std::span<unsigned char> buffer, size_t length, bool encrypt) const override;
+    size_t transformInPlace(std::span<wchar_t> buffer, size_t length, bool encrypt) const override;
+
+private:
+    uint64_t key;
+};
+
+class TableCipher : public Cipher {
+public:
+    explicit TableCipher(const std::wstring& key);
+
+    size_t requiredOutputSize(size_t inputSize, bool encrypt) const override;
+    size_t transform(std::span<const unsigned char> input, std::span<unsigned char> output, bool encrypt) const override;
+    size_t transform(std::span<const wchar_t> input, std::span<wchar_t> output, bool encrypt) const override;
+    size_t transformInPlace(std::span<unsigned char> buffer, size_t length, bool encrypt) const override;
+    size_t transformInPlace(std::span<wchar_t> buffer, size_t length, bool encrypt) const override;
+
+private:
+    std::vector<uint64_t> columnOrder;
+};
+
+#endif
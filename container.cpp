@@ -0,0 +1,482 @@
+#include "container.h"
+#include "affine.h"
+#include "table.h"
+#include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "arena.h"
+#include "parallel.h"
+#include "lz.h"
+#include "probes.h"
+#include "large_buffer.h"
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+uint32_t crc32c(const void* data, size_t length) {
+    return cipherKernels().crc32c(0, static_cast<const unsigned char*>(data), length);
+}
+
+// Точки chunk__begin/end вокруг обработки блока; конец отмечается при любом выходе.
+struct ChunkProbe {
+    int cipher;
+    uint64_t index;
+    uint64_t bytes;
+
+    ChunkProbe(ContainerCipher type, uint64_t chunk, uint64_t length)
+        : cipher(static_cast<int>(type)), index(chunk), bytes(length) {
+        RGR_PROBE(chunk__begin, cipher, index, bytes);
+    }
+    ~ChunkProbe() {
+        RGR_PROBE(chunk__end, cipher, index, bytes);
+    }
+};
+
+// Шифрование и запись блока. Несжатому блоку место (entry.offset,
+// storedLength) назначено заранее, сжатому - выделяется из fileEnd.
+bool storeChunk(int fd, const Cipher& cipher, ContainerCipher type, uint64_t index, span<const unsigned char> plain,
+                bool compress, atomic<uint64_t>& fileEnd, ChunkEntry& entry) {
+    ChunkProbe probe(type, index, entry.plainLength);
+    ArenaScope scope;
+    if (compress) {
+        span<unsigned char> packed = scope.allocate<unsigned char>(lzCompressBound(plain.size()));
+        size_t packedLength = lzCompress(plain, packed);
+        if (packedLength < plain.size()) {
+            plain = packed.first(packedLength);
+        }
+        entry.packedLength = static_cast<uint32_t>(plain.size());
+        entry.storedLength = static_cast<uint32_t>(cipher.requiredOutputSize(plain.size(), true));
+        entry.offset = fileEnd.fetch_add(entry.storedLength);
+    }
+    span<unsigned char> stored = scope.allocate<unsigned char>(entry.storedLength);
+    cipher.transform(plain, stored, true);
+    entry.checksum = crc32c(stored.data(), stored.size());
+    probe.bytes = entry.storedLength;
+    return pwriteAll(fd, stored.data(), stored.size(), entry.offset);
+}
+
+}
+
+unique_ptr<Cipher> makeCipher(const CipherKey& key) {
+    switch (key.cipher) {
+        case ContainerCipher::AFFINE:
+            if (!isValidBinaryKey(key.a)) throw invalid_argument("affine: a must be coprime with 256");
+            return make_unique<AffineCipher>(key.a, key.b);
+        case ContainerCipher::SKYTALE:
+            if (key.key == 0) throw invalid_argument("skytale: key must be positive");
+            return make_unique<SkytaleCipher>(key.key);
+        case ContainerCipher::TABLE:
+            return make_unique<TableCipher>(key.word);
+    }
+    throw invalid_argument("unknown cipher");
+}
+
+uint64_t keyFingerprint(const CipherKey& key) {
+    // FNV-1a по идентификатору шифра и параметрам ключа
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](const void* data, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    uint8_t cipher = static_cast<uint8_t>(key.cipher);
+    mix(&cipher, 1);
+    switch (key.cipher) {
+        case ContainerCipher::AFFINE:
+            mix(&key.a, sizeof(key.a));
+            mix(&key.b, sizeof(key.b));
+            break;
+        case ContainerCipher::SKYTALE:
+            mix(&key.key, sizeof(key.key));
+            break;
+        case ContainerCipher::TABLE: {
+            string word = ws2s(key.word);
+            mix(word.data(), word.size());
+            break;
+        }
+    }
+    return hash;
+}
+
+vector<uint64_t> permutationColumns(const CipherKey& key) {
+    vector<uint64_t> columnOrder;
+    if (key.cipher == ContainerCipher::TABLE) {
+        columnOrder = getColumnOrder(key.word);
+    } else if (key.cipher == ContainerCipher::SKYTALE) {
+        columnOrder.resize(static_cast<size_t>(key.key));
+        iota(columnOrder.begin(), columnOrder.end(), 1);
+    }
+    return columnOrder;
+}
+
+bool writeContainer(const wstring& filename, span<const unsigned char> data, const CipherKey& key,
+                    uint64_t chunkSize, unsigned threads, bool compress) {
+    if (chunkSize == 0 || chunkSize > CONTAINER_MAX_CHUNK) return false;
+    unique_ptr<Cipher> cipher = makeCipher(key);
+
+    uint64_t length = static_cast<uint64_t>(data.size());
+    uint64_t count = (length + chunkSize - 1) / chunkSize;
+
+    // Без сжатия размеры зашифрованных блоков известны заранее - блоки пишутся
+    // параллельно, каждый по своему смещению
+    vector<ChunkEntry> chunks(static_cast<size_t>(count));
+    uint64_t offset = sizeof(ContainerHeader);
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t plain = min(chunkSize, length - i * chunkSize);
+        chunks[i].offset = offset;
+        chunks[i].plainLength = static_cast<uint32_t>(plain);
+        chunks[i].storedLength = compress ? 0 : static_cast<uint32_t>(cipher->requiredOutputSize(plain, true));
+        chunks[i].checksum = 0;
+        chunks[i].packedLength = 0;
+        offset += chunks[i].storedLength;
+    }
+
+    int fd = ::open(ws2s(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    // Сжатые блоки занимают место в файле по мере готовности
+    atomic<uint64_t> fileEnd{ offset };
+    bool ok = parallelFor(count, threads, [&](uint64_t i) {
+        span<const unsigned char> plain = data.subspan(static_cast<size_t>(i * chunkSize), chunks[i].plainLength);
+        return storeChunk(fd, *cipher, key.cipher, i, plain, compress, fileEnd, chunks[i]);
+    });
+    offset = fileEnd;
+
+    // Заголовок пишется последним: файл без него не откроется как контейнер
+    ContainerHeader header = {};
+    header.magic = CONTAINER_MAGIC;
+    header.version = CONTAINER_VERSION;
+    header.cipher = static_cast<uint8_t>(key.cipher);
+    header.flags = compress ? CONTAINER_FLAG_COMPRESSED : 0;
+    header.headerSize = sizeof(ContainerHeader);
+    header.chunkSize = chunkSize;
+    header.originalLength = length;
+    header.chunkCount = count;
+    header.keyFingerprint = keyFingerprint(key);
+    header.indexOffset = offset;
+    header.indexChecksum = crc32c(chunks.data(), chunks.size() * sizeof(ChunkEntry));
+
+    ok = ok && pwriteAll(fd, chunks.data(), chunks.size() * sizeof(ChunkEntry), offset);
+    ok = ok && pwriteAll(fd, &header, sizeof(header), 0);
+    ok = ::close(fd) == 0 && ok;
+    return ok;
+}
+
+namespace {
+
+const uint64_t COMPACT_MIN_WASTE = 64 << 20;
+
+// Живые блоки подряд в новый файл без расшифровки, индекс и заголовок за ними;
+// новый файл заменяет контейнер, только когда целиком на диске.
+bool compactContainer(const wstring& filename, int fd, ContainerHeader header, vector<ChunkEntry> chunks) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    wstring temporary = filename + L".tmp";
+    int out = ::open(ws2s(temporary).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 0777);
+    if (out < 0) return false;
+
+    uint64_t offset = sizeof(ContainerHeader);
+    bool ok = true;
+    for (ChunkEntry& entry : chunks) {
+        ArenaScope scope;
+        span<unsigned char> stored = scope.allocate<unsigned char>(entry.storedLength);
+        ok = preadAll(fd, stored.data(), stored.size(), entry.offset) && pwriteAll(out, stored.data(), stored.size(), offset);
+        if (!ok) break;
+        entry.offset = offset;
+        offset += entry.storedLength;
+    }
+    header.indexOffset = offset;
+    header.indexChecksum = crc32c(chunks.data(), chunks.size() * sizeof(ChunkEntry));
+    ok = ok && pwriteAll(out, chunks.data(), chunks.size() * sizeof(ChunkEntry), offset);
+    ok = ok && pwriteAll(out, &header, sizeof(header), 0) && fdatasync(out) == 0;
+    ok = ::close(out) == 0 && ok;
+    ok = ok && rename(ws2s(temporary).c_str(), ws2s(filename).c_str()) == 0;
+    if (!ok) unlink(ws2s(temporary).c_str());
+    return ok;
+}
+
+// Дописывание к открытому reader контейнеру: tail - расшифрованный последний
+// неполный блок (пуст, если последний блок полный), он шифруется заново
+// вместе с началом data. Новые блоки и индекс ложатся за конец файла, старые
+// индекс и последний блок остаются целыми, пока не записан заголовок, - при
+// сбое контейнер открывается в прежнем виде. Потом их место освобождается.
+bool appendChunks(const wstring& filename, const ContainerReader& reader, span<const unsigned char> tail,
+                  span<const unsigned char> data, const CipherKey& key, unsigned threads) {
+    if (data.empty()) return true;
+    unique_ptr<Cipher> cipher = makeCipher(key);
+    int fd = ::open(ws2s(filename).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    ContainerHeader header;
+    struct stat info;
+    if (!preadAll(fd, &header, sizeof(header), 0) || fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    const uint64_t chunkSize = header.chunkSize;
+    const bool compress = header.flags & CONTAINER_FLAG_COMPRESSED;
+    const uint64_t kept = header.chunkCount - (tail.empty() ? 0 : 1);
+    const uint64_t length = static_cast<uint64_t>(tail.size() + data.size());
+    const uint64_t count = (length + chunkSize - 1) / chunkSize;
+
+    // Первый новый блок склеивается из хвоста и начала data, остальные - срезы data
+    vector<unsigned char> first;
+    if (!tail.empty()) {
+        size_t take = static_cast<size_t>(min<uint64_t>(chunkSize - tail.size(), data.size()));
+        first.assign(tail.begin(), tail.end());
+        first.insert(first.end(), data.begin(), data.begin() + take);
+    }
+    auto plainChunk = [&](uint64_t i) -> span<const unsigned char> {
+        if (!tail.empty() && i == 0) return first;
+        uint64_t start = i * chunkSize - tail.size();
+        return data.subspan(static_cast<size_t>(start), static_cast<size_t>(min(chunkSize, length - i * chunkSize)));
+    };
+
+    vector<ChunkEntry> chunks(static_cast<size_t>(kept + count));
+    for (uint64_t i = 0; i < kept; i++) chunks[i] = reader.chunk(i);
+    uint64_t offset = max<uint64_t>(static_cast<uint64_t>(info.st_size), header.indexOffset);
+    for (uint64_t i = 0; i < count; i++) {
+        ChunkEntry& entry = chunks[kept + i];
+        uint64_t plain = min(chunkSize, length - i * chunkSize);
+        entry.offset = offset;
+        entry.plainLength = static_cast<uint32_t>(plain);
+        entry.storedLength = compress ? 0 : static_cast<uint32_t>(cipher->requiredOutputSize(plain, true));
+        entry.checksum = 0;
+        entry.packedLength = 0;
+        offset += entry.storedLength;
+    }
+
+    atomic<uint64_t> fileEnd{ offset };
+    bool ok = parallelFor(count, threads, [&](uint64_t i) {
+        return storeChunk(fd, *cipher, key.cipher, kept + i, plainChunk(i), compress, fileEnd, chunks[kept + i]);
+    });
+    offset = fileEnd;
+
+    ContainerHeader updated = header;
+    updated.originalLength = header.originalLength + static_cast<uint64_t>(data.size());
+    updated.chunkCount = kept + count;
+    updated.indexOffset = offset;
+    updated.indexChecksum = crc32c(chunks.data(), chunks.size() * sizeof(ChunkEntry));
+    ok = ok && pwriteAll(fd, chunks.data(), chunks.size() * sizeof(ChunkEntry), offset);
+    // Новые блоки и индекс на диске раньше заголовка, который на них ссылается
+    ok = ok && fdatasync(fd) == 0;
+    ok = ok && pwriteAll(fd, &updated, sizeof(updated), 0) && fdatasync(fd) == 0;
+
+    if (ok) {
+        // Дыры на месте прежних индекса и последнего блока; не вышло - только место
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(header.indexOffset),
+                  static_cast<off_t>(header.chunkCount * sizeof(ChunkEntry)));
+        if (!tail.empty()) {
+            const ChunkEntry& replaced = reader.chunk(kept);
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(replaced.offset),
+                      static_cast<off_t>(replaced.storedLength));
+        }
+
+        // Дыры растут на блок за запуск; когда их больше живых данных, файл
+        // переписывается подряд - в среднем тоже не больше блока за запуск
+        uint64_t live = sizeof(ContainerHeader) + chunks.size() * sizeof(ChunkEntry);
+        for (const ChunkEntry& entry : chunks) live += entry.storedLength;
+        uint64_t end = offset + chunks.size() * sizeof(ChunkEntry);
+        if (end - live > max(live, COMPACT_MIN_WASTE)) compactContainer(filename, fd, updated, chunks);
+    }
+    ok = ::close(fd) == 0 && ok;
+    return ok;
+}
+
+// Расшифрованный последний блок, если он неполный.
+bool partialTail(const ContainerReader& reader, vector<unsigned char>& tail) {
+    tail.clear();
+    if (reader.chunkCount() == 0) return true;
+    uint64_t last = reader.chunkCount() - 1;
+    if (reader.chunk(last).plainLength == reader.chunkSize()) return true;
+    tail.resize(reader.chunk(last).plainLength);
+    return reader.readChunk(last, tail);
+}
+
+}
+
+bool appendContainer(const wstring& filename, span<const unsigned char> data, const CipherKey& key, unsigned threads) {
+    ContainerReader reader;
+    vector<unsigned char> tail;
+    if (!reader.open(filename, key) || !partialTail(reader, tail)) return false;
+    return appendChunks(filename, reader, tail, data, key, threads);
+}
+
+bool syncContainer(const wstring& source, const wstring& filename, const CipherKey& key, uint64_t chunkSize,
+                   unsigned threads, bool compress) {
+    int in = ::open(ws2s(source).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat info;
+    if (fstat(in, &info) != 0) {
+        ::close(in);
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(info.st_size);
+
+    bool ok;
+    if (access(ws2s(filename).c_str(), F_OK) != 0) {
+        LargeBuffer data(static_cast<size_t>(size));
+        ok = preadAll(in, data.data(), data.size(), 0) &&
+             writeContainer(filename, data.bytes(), key, chunkSize, threads, compress);
+        ::close(in);
+        return ok;
+    }
+
+    ContainerReader reader;
+    ok = reader.open(filename, key) && size >= reader.size();
+    // Последний сохранённый блок сверяется с файлом: если файл переписан, а не
+    // дописан, дописывать нечего и сообщается ошибка
+    vector<unsigned char> stored;
+    uint64_t start = 0;
+    if (ok && reader.chunkCount() > 0) {
+        uint64_t last = reader.chunkCount() - 1;
+        start = last * reader.chunkSize();
+        stored.resize(reader.chunk(last).plainLength);
+        vector<unsigned char> current(stored.size());
+        ok = reader.readChunk(last, stored) && preadAll(in, current.data(), current.size(), start) &&
+             current == stored;
+    }
+    if (ok && stored.size() == reader.chunkSize()) stored.clear();
+
+    LargeBuffer data;
+    if (ok && size > reader.size()) {
+        data = LargeBuffer(static_cast<size_t>(size - reader.size()));
+        ok = preadAll(in, data.data(), data.size(), reader.size());
+    }
+    ::close(in);
+    return ok && appendChunks(filename, reader, stored, data.bytes(), key, threads);
+}
+
+ContainerReader::~ContainerReader() {
+    close();
+}
+
+void ContainerReader::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    header = {};
+    chunks.clear();
+    cipher.reset();
+}
+
+bool ContainerReader::open(const wstring& filename, const CipherKey& key) {
+    close();
+    fd = ::open(ws2s(filename).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && preadAll(fd, &header, sizeof(header), 0) &&
+              header.magic == CONTAINER_MAGIC && header.version == CONTAINER_VERSION &&
+              header.headerSize == sizeof(ContainerHeader) && (header.flags & ~CONTAINER_FLAG_COMPRESSED) == 0 &&
+              header.cipher == static_cast<uint8_t>(key.cipher) &&
+              header.keyFingerprint == keyFingerprint(key) &&
+              header.chunkSize > 0 && header.chunkSize <= CONTAINER_MAX_CHUNK &&
+              header.indexOffset <= static_cast<uint64_t>(info.st_size) &&
+              header.chunkCount <= (static_cast<uint64_t>(info.st_size) - header.indexOffset) / sizeof(ChunkEntry);
+    if (ok) {
+        chunks.resize(static_cast<size_t>(header.chunkCount));
+        ok = preadAll(fd, chunks.data(), chunks.size() * sizeof(ChunkEntry), header.indexOffset) &&
+             crc32c(chunks.data(), chunks.size() * sizeof(ChunkEntry)) == header.indexChecksum;
+    }
+
+    // Все блоки, кроме последнего, полные - на этом держится доступ по смещению
+    uint64_t total = 0;
+    for (uint64_t i = 0; ok && i < header.chunkCount; i++) {
+        const ChunkEntry& entry = chunks[i];
+        bool last = i + 1 == header.chunkCount;
+        uint32_t cipherLength = compressed() ? entry.packedLength : entry.plainLength;
+        ok = entry.plainLength <= header.chunkSize && (last || entry.plainLength == header.chunkSize) &&
+             cipherLength <= entry.plainLength && entry.storedLength >= cipherLength &&
+             entry.offset + entry.storedLength <= header.indexOffset;
+        total += entry.plainLength;
+    }
+    ok = ok && total == header.originalLength;
+
+    if (ok) {
+        try {
+            cipher = makeCipher(key);
+        } catch (const exception&) {
+            ok = false;
+        }
+    }
+    if (!ok) close();
+    return ok;
+}
+
+bool ContainerReader::readChunk(uint64_t index, span<unsigned char> out) const {
+    if (index >= header.chunkCount) return false;
+    const ChunkEntry& entry = chunks[index];
+    if (out.size() < entry.plainLength) return false;
+    size_t cipherLength = compressed() ? entry.packedLength : entry.plainLength;
+    bool packed = cipherLength < entry.plainLength;
+    ChunkProbe probe(static_cast<ContainerCipher>(header.cipher), index, entry.storedLength);
+
+    // Расшифровка на месте прямо в out, если в нём хватает места под дополнение
+    // и блок не нужно распаковывать
+    ArenaScope scope;
+    span<unsigned char> buffer = !packed && out.size() >= entry.storedLength ? out : scope.allocate<unsigned char>(entry.storedLength);
+    if (!preadAll(fd, buffer.data(), entry.storedLength, entry.offset)) return false;
+    if (crc32c(buffer.data(), entry.storedLength) != entry.checksum) return false;
+
+    size_t size = cipher->transformInPlace(buffer, entry.storedLength, false);
+    if (size < cipherLength) {
+        // Табличный шифр отрезает нули в конце - среди них могли быть настоящие
+        fill(buffer.begin() + size, buffer.begin() + cipherLength, 0);
+    }
+    if (packed) {
+        return lzDecompress(buffer.first(cipherLength), out.first(entry.plainLength));
+    }
+    if (buffer.data() != out.data()) {
+        copy(buffer.begin(), buffer.begin() + entry.plainLength, out.begin());
+    }
+    return true;
+}
+
+bool ContainerReader::readRange(uint64_t offset, span<unsigned char> out) const {
+    uint64_t end = offset + static_cast<uint64_t>(out.size());
+    if (end > header.originalLength || end < offset) return false;
+
+    for (uint64_t position = offset; position < end;) {
+        uint64_t index = position / header.chunkSize;
+        uint64_t chunkStart = index * header.chunkSize;
+        uint64_t chunkEnd = chunkStart + chunks[index].plainLength;
+        uint64_t stop = min(end, chunkEnd);
+        span<unsigned char> target = out.subspan(static_cast<size_t>(position - offset));
+
+        if (position == chunkStart && stop == chunkEnd) {
+            // Блок целиком: место за ним в out ещё не заполнено и годится под дополнение
+            if (!readChunk(index, target)) return false;
+        } else {
+            ArenaScope scope;
+            span<unsigned char> plain = scope.allocate<unsigned char>(chunks[index].plainLength);
+            if (!readChunk(index, plain)) return false;
+            copy(plain.begin() + (position - chunkStart), plain.begin() + (stop - chunkStart), target.begin());
+        }
+        position = stop;
+    }
+    return true;
+}
+
+bool ContainerReader::readAll(vector<unsigned char>& out, unsigned threads) const {
+    out.resize(static_cast<size_t>(header.originalLength));
+    return readAll(span<unsigned char>(out), threads);
+}
+
+bool ContainerReader::readAll(span<unsigned char> out, unsigned threads) const {
+    if (out.size() != header.originalLength) return false;
+    return parallelFor(header.chunkCount, threads, [&](uint64_t i) {
+        span<unsigned char> target(out.data() + i * header.chunkSize, chunks[i].plainLength);
+        return readChunk(i, target);
+    });
+}
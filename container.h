@@ -0,0 +1,143 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include "cipher.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <span>
+#include <cstdint>
+
+// Контейнер зашифрованных данных:
+//   ContainerHeader | блок 0 | блок 1 | ... | блок N-1 | индекс (ChunkEntry x N)
+// Данные делятся на блоки по chunkSize байт, каждый шифруется отдельно,
+// поэтому любой блок или диапазон байт расшифровывается независимо и блоки
+// можно обрабатывать параллельно. Исходная длина каждого блока хранится
+// в индексе, так что дополнение шифра отделяется от настоящих нулевых байт.
+// Числа - в порядке байт машины.
+//
+// С флагом CONTAINER_FLAG_COMPRESSED каждый блок перед шифрованием сжимается
+// (lz.h) тем же потоком, что его шифрует; блок, который не сжимается,
+// хранится как есть. Размеры сжатых блоков заранее не известны, поэтому
+// блоки лежат в файле в порядке готовности - их место задаёт индекс.
+// После дописывания (appendContainer) между блоками остаются пустые места
+// от прежних индексов - в файле они дыры и места на диске не занимают.
+
+enum class ContainerCipher : uint8_t {
+    SKYTALE = 1,
+    AFFINE = 2,
+    TABLE = 3
+};
+
+// Ключ шифра в переносимом виде.
+struct CipherKey {
+    ContainerCipher cipher = ContainerCipher::AFFINE;
+    uint64_t a = 0;      // Аффинный шифр
+    uint64_t b = 0;
+    uint64_t key = 0;    // Скитала
+    std::wstring word;   // табличный шифр
+};
+
+const uint32_t CONTAINER_MAGIC = 0x43524752;  // "RGRC"
+const uint16_t CONTAINER_VERSION = 1;
+const uint64_t CONTAINER_DEFAULT_CHUNK = 1 << 20;
+const uint64_t CONTAINER_MAX_CHUNK = 1ull << 30;
+
+const uint8_t CONTAINER_FLAG_COMPRESSED = 0x01;
+
+struct ContainerHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t cipher;
+    uint8_t flags;
+    uint32_t headerSize;
+    uint32_t reserved;
+    uint64_t chunkSize;
+    uint64_t originalLength;
+    uint64_t chunkCount;
+    uint64_t keyFingerprint;
+    uint64_t indexOffset;
+    uint32_t indexChecksum;
+    uint32_t reserved2;
+};
+
+struct ChunkEntry {
+    uint64_t offset;
+    uint32_t storedLength;
+    uint32_t plainLength;
+    uint32_t checksum;   // CRC-32C зашифрованного блока
+    uint32_t packedLength;  // размер после сжатия (== plainLength - блок не сжат); 0 без флага сжатия
+};
+
+static_assert(sizeof(ContainerHeader) == 64, "ContainerHeader layout");
+static_assert(sizeof(ChunkEntry) == 24, "ChunkEntry layout");
+
+// Шифр по ключу; исключение invalid_argument для недопустимого ключа.
+std::unique_ptr<Cipher> makeCipher(const CipherKey& key);
+
+// Отпечаток ключа для проверки при открытии (не раскрывает сам ключ).
+uint64_t keyFingerprint(const CipherKey& key);
+
+// Порядок столбцов перестановки для файловых путей (table_file.h): у таблицы -
+// по ключевому слову, у Скиталы - тождественный из key столбцов; у Аффинного
+// шифра пуст.
+std::vector<uint64_t> permutationColumns(const CipherKey& key);
+
+// threads == 0 - workerThreads() (parallel.h). false при ошибке ввода-вывода,
+// invalid_argument для недопустимого ключа.
+bool writeContainer(const std::wstring& filename, std::span<const unsigned char> data, const CipherKey& key,
+                    uint64_t chunkSize = CONTAINER_DEFAULT_CHUNK, unsigned threads = 0, bool compress = false);
+
+// Дописывает data к содержимому контейнера. Полные блоки не трогаются:
+// последний неполный блок расшифровывается и шифруется заново вместе с
+// началом data, так что работа пропорциональна новым байтам. Блоки и индекс
+// пишутся за конец файла, заголовок - последним, после fdatasync; при сбое
+// контейнер остаётся прежним. Место прежних индекса и блока освобождается
+// (FALLOC_FL_PUNCH_HOLE). Размер блока и сжатие - как у контейнера.
+bool appendContainer(const std::wstring& filename, std::span<const unsigned char> data, const CipherKey& key,
+                     unsigned threads = 0);
+
+// Контейнер догоняет растущий файл source (например, журнал): шифруются
+// только байты за уже сохранённой длиной. Контейнера нет - он создаётся
+// целиком с chunkSize и compress. false, если файл стал короче или его
+// последний сохранённый блок изменился (файл переписан, а не дописан).
+bool syncContainer(const std::wstring& source, const std::wstring& filename, const CipherKey& key,
+                   uint64_t chunkSize = CONTAINER_DEFAULT_CHUNK, unsigned threads = 0, bool compress = false);
+
+class ContainerReader {
+public:
+    ContainerReader() = default;
+    ~ContainerReader();
+
+    ContainerReader(const ContainerReader&) = delete;
+    ContainerReader& operator=(const ContainerReader&) = delete;
+
+    // false, если файл не открывается, повреждён или ключ не подходит.
+    bool open(const std::wstring& filename, const CipherKey& key);
+    void close();
+
+    uint64_t size() const { return header.originalLength; }
+    uint64_t chunkSize() const { return header.chunkSize; }
+    uint64_t chunkCount() const { return header.chunkCount; }
+    bool compressed() const { return header.flags & CONTAINER_FLAG_COMPRESSED; }
+    const ChunkEntry& chunk(uint64_t index) const { return chunks[index]; }
+
+    // Расшифровка блока: out.size() >= chunk(index).plainLength.
+    // false при ошибке чтения или несовпадении контрольной суммы.
+    bool readChunk(uint64_t index, std::span<unsigned char> out) const;
+
+    // Байты [offset, offset + out.size()); читаются только затронутые блоки.
+    bool readRange(uint64_t offset, std::span<unsigned char> out) const;
+
+    // Всё содержимое, блоки расшифровываются параллельно.
+    bool readAll(std::vector<unsigned char>& out, unsigned threads = 0) const;
+    bool readAll(std::span<unsigned char> out, unsigned threads = 0) const;  // out.size() == size()
+
+private:
+    int fd = -1;
+    ContainerHeader header = {};
+    std::vector<ChunkEntry> chunks;
+    std::unique_ptr<Cipher> cipher;
+};
+
+#endif
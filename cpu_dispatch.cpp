@@ -0,0 +1,322 @@
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RGR_X86_DISPATCH 1
+#define RGR_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define RGR_X86_DISPATCH 0
+#define RGR_ALWAYS_INLINE inline
+#endif
+
+namespace {
+
+// Тела ядер. Каждое встраивается в обёртки с разными target-атрибутами,
+// и компилятор векторизует его под соответствующий набор инструкций.
+
+const size_t AFFINE_BLOCK = 64;
+const size_t ASCII_BLOCK = 32;
+const size_t TILE = 16;
+
+RGR_ALWAYS_INLINE void affineBytesLoop(const unsigned char* __restrict in, unsigned char* __restrict out, size_t length, unsigned char a, unsigned char b) {
+    // Внутренний цикл фиксированной длины векторизуется и при -O2
+    size_t i = 0;
+    for (; i + AFFINE_BLOCK <= length; i += AFFINE_BLOCK) {
+        for (size_t j = 0; j < AFFINE_BLOCK; j++) {
+            out[i + j] = static_cast<unsigned char>(a * in[i + j] + b);
+        }
+    }
+    for (; i < length; i++) {
+        out[i] = static_cast<unsigned char>(a * in[i] + b);
+    }
+}
+
+RGR_ALWAYS_INLINE void affineBytesBody(const unsigned char* in, unsigned char* out, size_t length, unsigned char a, unsigned char b) {
+    // Зависимость поэлементная, поэтому при out == in векторный цикл тоже корректен;
+    // частичное пересечение буферов обрабатывается по одному байту
+    if (out == in || out + length <= in || in + length <= out) {
+        affineBytesLoop(in, out, length, a, b);
+        return;
+    }
+    for (size_t i = 0; i < length; i++) {
+        out[i] = static_cast<unsigned char>(a * in[i] + b);
+    }
+}
+
+template <typename T>
+RGR_ALWAYS_INLINE void interleaveBody(const T* const* rows, size_t count, T* out, size_t outStride, size_t length) {
+    for (size_t r0 = 0; r0 < length; r0 += TILE) {
+        size_t rEnd = min(length, r0 + TILE);
+        for (size_t d = 0; d < count; d++) {
+            const T* source = rows[d];
+            T* target = out + d;
+            for (size_t r = r0; r < rEnd; r++) {
+                target[r * outStride] = source[r];
+            }
+        }
+    }
+}
+
+template <typename T>
+RGR_ALWAYS_INLINE void gatherBody(const T* in, size_t inStride, const uint64_t* offsets, size_t count, T* out, size_t outStride, size_t length) {
+    for (size_t r0 = 0; r0 < length; r0 += TILE) {
+        size_t rEnd = min(length, r0 + TILE);
+        for (size_t c = 0; c < count; c++) {
+            const T* source = in + (offsets ? offsets[c] : c);
+            T* target = out + c * outStride;
+            for (size_t r = r0; r < rEnd; r++) {
+                target[r] = source[r * inStride];
+            }
+        }
+    }
+}
+
+RGR_ALWAYS_INLINE size_t decodeUtf8Body(const unsigned char* in, size_t length, wchar_t* out) {
+    size_t i = 0;
+    size_t n = 0;
+    while (i < length) {
+        if (i + ASCII_BLOCK <= length) {
+            unsigned char high = 0;
+            for (size_t j = 0; j < ASCII_BLOCK; j++) {
+                high |= in[i + j];
+            }
+            if (high < 0x80) {
+                for (size_t j = 0; j < ASCII_BLOCK; j++) {
+                    out[n + j] = static_cast<wchar_t>(in[i + j]);
+                }
+                i += ASCII_BLOCK;
+                n += ASCII_BLOCK;
+                continue;
+            }
+        }
+
+        unsigned char lead = in[i];
+        if (lead < 0x80) {
+            out[n++] = static_cast<wchar_t>(lead);
+            i++;
+            continue;
+        }
+
+        size_t need;
+        uint32_t code;
+        uint32_t minimum;
+        if (lead < 0xC2) {
+            return UTF8_ERROR;
+        } else if (lead < 0xE0) {
+            need = 1;
+            code = lead & 0x1F;
+            minimum = 0x80;
+        } else if (lead < 0xF0) {
+            need = 2;
+            code = lead & 0x0F;
+            minimum = 0x800;
+        } else if (lead < 0xF5) {
+            need = 3;
+            code = lead & 0x07;
+            minimum = 0x10000;
+        } else {
+            return UTF8_ERROR;
+        }
+
+        if (length - i - 1 < need) {
+            // Как и codecvt_utf8: неполный символ в конце данных отбрасывается
+            break;
+        }
+        for (size_t k = 1; k <= need; k++) {
+            unsigned char next = in[i + k];
+            if ((next & 0xC0) != 0x80) return UTF8_ERROR;
+            code = (code << 6) | (next & 0x3F);
+        }
+        if (code < minimum || code > 0x10FFFF) return UTF8_ERROR;
+
+        out[n++] = static_cast<wchar_t>(code);
+        i += need + 1;
+    }
+    return n;
+}
+
+RGR_ALWAYS_INLINE size_t countUtf8Body(const unsigned char* in, size_t length) {
+    size_t i = 0;
+    size_t n = 0;
+    for (; i + ASCII_BLOCK <= length; i += ASCII_BLOCK) {
+        unsigned char block = 0;
+        for (size_t j = 0; j < ASCII_BLOCK; j++) {
+            block += (in[i + j] & 0xC0) != 0x80;
+        }
+        n += block;
+    }
+    for (; i < length; i++) {
+        n += (in[i] & 0xC0) != 0x80;
+    }
+    return n;
+}
+
+// CRC-32C таблицами "slicing-by-8": восемь байт за шаг без специальных инструкций
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; k++) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32cTables CRC32C_TABLES;
+
+uint32_t crc32cGeneric(uint32_t crc, const unsigned char* data, size_t length) {
+    const auto& t = CRC32C_TABLES.table;
+    crc = ~crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        uint32_t low = static_cast<uint32_t>(word) ^ crc;
+        uint32_t high = static_cast<uint32_t>(word >> 32);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+}
+
+#if RGR_X86_DISPATCH && defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t crc32cHardware(uint32_t crc, const unsigned char* data, size_t length) {
+    uint64_t value = static_cast<uint32_t>(~crc);
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        value = __builtin_ia32_crc32di(value, word);
+        data += 8;
+        length -= 8;
+    }
+    uint32_t result = static_cast<uint32_t>(value);
+    while (length-- > 0) {
+        result = __builtin_ia32_crc32qi(result, *data++);
+    }
+    return ~result;
+}
+#else
+#define crc32cHardware crc32cGeneric
+#endif
+
+#define RGR_DEFINE_KERNELS(SUFFIX, TARGET, CRC32C)                                                                          \
+    TARGET void affineBytes##SUFFIX(const unsigned char* in, unsigned char* out, size_t length, unsigned char a,    \
+                                    unsigned char b) {                                                              \
+        affineBytesBody(in, out, length, a, b);                                                                     \
+    }                                                                                                               \
+    TARGET void interleaveBytes##SUFFIX(const unsigned char* const* rows, size_t count, unsigned char* out,         \
+                                        size_t outStride, size_t length) {                                          \
+        interleaveBody(rows, count, out, outStride, length);                                                        \
+    }                                                                                                               \
+    TARGET void interleaveWide##SUFFIX(const wchar_t* const* rows, size_t count, wchar_t* out, size_t outStride,    \
+                                       size_t length) {                                                             \
+        interleaveBody(rows, count, out, outStride, length);                                                        \
+    }                                                                                                               \
+    TARGET void gatherBytes##SUFFIX(const unsigned char* in, size_t inStride, const uint64_t* offsets,              \
+                                    size_t count, unsigned char* out, size_t outStride, size_t length) {            \
+        gatherBody(in, inStride, offsets, count, out, outStride, length);                                           \
+    }                                                                                                               \
+    TARGET void gatherWide##SUFFIX(const wchar_t* in, size_t inStride, const uint64_t* offsets, size_t count,       \
+                                   wchar_t* out, size_t outStride, size_t length) {                                 \
+        gatherBody(in, inStride, offsets, count, out, outStride, length);                                           \
+    }                                                                                                               \
+    TARGET size_t decodeUtf8##SUFFIX(const unsigned char* in, size_t length, wchar_t* out) {                        \
+        return decodeUtf8Body(in, length, out);                                                                     \
+    }                                                                                                               \
+    TARGET size_t countUtf8##SUFFIX(const unsigned char* in, size_t length) {                                       \
+        return countUtf8Body(in, length);                                                                           \
+    }                                                                                                               \
+    const CipherKernels KERNELS##SUFFIX = { affineBytes##SUFFIX, interleaveBytes##SUFFIX, interleaveWide##SUFFIX,   \
+                                            gatherBytes##SUFFIX, gatherWide##SUFFIX, decodeUtf8##SUFFIX,             \
+                                            countUtf8##SUFFIX, CRC32C };
+
+RGR_DEFINE_KERNELS(Generic, , crc32cGeneric)
+#if RGR_X86_DISPATCH
+RGR_DEFINE_KERNELS(Sse42, __attribute__((target("sse4.2"))), crc32cHardware)
+RGR_DEFINE_KERNELS(Avx2, __attribute__((target("avx2"))), crc32cHardware)
+RGR_DEFINE_KERNELS(Avx512, __attribute__((target("avx512f,avx512bw,avx512vl"))), crc32cHardware)
+#endif
+
+const CipherKernels* kernelsFor(IsaLevel level) {
+#if RGR_X86_DISPATCH
+    switch (level) {
+        case IsaLevel::AVX512: return &KERNELSAvx512;
+        case IsaLevel::AVX2: return &KERNELSAvx2;
+        case IsaLevel::SSE42: return &KERNELSSse42;
+        case IsaLevel::GENERIC: break;
+    }
+#else
+    (void)level;
+#endif
+    return &KERNELSGeneric;
+}
+
+IsaLevel requestedIsaLevel(IsaLevel detected) {
+    const char* value = getenv("RGR_ISA");
+    if (!value) return detected;
+
+    string name = value;
+    IsaLevel requested = detected;
+    if (name == "generic") requested = IsaLevel::GENERIC;
+    else if (name == "sse4.2" || name == "sse42") requested = IsaLevel::SSE42;
+    else if (name == "avx2") requested = IsaLevel::AVX2;
+    else if (name == "avx512") requested = IsaLevel::AVX512;
+    return min(requested, detected);
+}
+
+atomic<IsaLevel> activeLevel{ requestedIsaLevel(detectIsaLevel()) };
+
+}
+
+IsaLevel detectIsaLevel() {
+#if RGR_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) {
+        return IsaLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) return IsaLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return IsaLevel::SSE42;
+#endif
+    return IsaLevel::GENERIC;
+}
+
+IsaLevel activeIsaLevel() {
+    return activeLevel.load(memory_order_relaxed);
+}
+
+void setIsaLevel(IsaLevel level) {
+    activeLevel.store(min(level, detectIsaLevel()), memory_order_relaxed);
+}
+
+const char* isaLevelName(IsaLevel level) {
+    switch (level) {
+        case IsaLevel::GENERIC: return "generic";
+        case IsaLevel::SSE42: return "sse4.2";
+        case IsaLevel::AVX2: return "avx2";
+        case IsaLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+const CipherKernels& cipherKernels() {
+    return *kernelsFor(activeIsaLevel());
+}
@@ -0,0 +1,74 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Горячие циклы собираются из одного исходника в нескольких вариантах под
+// разные наборы инструкций; подходящий выбирается при первом обращении по cpuid.
+// Переменная окружения RGR_ISA=generic|sse4.2|avx2|avx512 принудительно
+// задаёт уровень (не выше поддерживаемого процессором).
+
+enum class IsaLevel {
+    GENERIC,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+struct CipherKernels {
+    // out[i] = a * in[i] + b (mod 256); out может совпадать с in
+    void (*affineBytes)(const unsigned char* in, unsigned char* out, size_t length, unsigned char a, unsigned char b);
+
+    // out[r * outStride + d] = rows[d][r] для d < count, r < length
+    void (*interleaveBytes)(const unsigned char* const* rows, size_t count, unsigned char* out, size_t outStride, size_t length);
+    void (*interleaveWide)(const wchar_t* const* rows, size_t count, wchar_t* out, size_t outStride, size_t length);
+
+    // out[c * outStride + r] = in[r * inStride + offsets[c]] для c < count, r < length;
+    // offsets == nullptr означает offsets[c] = c
+    void (*gatherBytes)(const unsigned char* in, size_t inStride, const uint64_t* offsets, size_t count, unsigned char* out, size_t outStride, size_t length);
+    void (*gatherWide)(const wchar_t* in, size_t inStride, const uint64_t* offsets, size_t count, wchar_t* out, size_t outStride, size_t length);
+
+    // Декодирование UTF-8 в out (не менее length элементов). Возвращает число
+    // символов или UTF8_ERROR; незавершённая последовательность в конце отбрасывается.
+    size_t (*decodeUtf8)(const unsigned char* in, size_t length, wchar_t* out);
+
+    // Число байт, не являющихся продолжением последовательности, - для
+    // корректного UTF-8 это число символов.
+    size_t (*countUtf8)(const unsigned char* in, size_t length);
+
+    // CRC-32C (Castagnoli) с продолжением: crc32c(crc32c(0, a), b) == crc32c(0, a + b).
+    // Начиная с SSE4.2 - аппаратной инструкцией.
+    uint32_t (*crc32c)(uint32_t crc, const unsigned char* data, size_t length);
+};
+
+const size_t UTF8_ERROR = static_cast<size_t>(-1);
+
+IsaLevel detectIsaLevel();
+IsaLevel activeIsaLevel();
+void setIsaLevel(IsaLevel level);
+const char* isaLevelName(IsaLevel level);
+
+const CipherKernels& cipherKernels();
+
+// Короче этого перестановки выполняются простым циклом: подготовка
+// таблиц указателей для ядер окупается только на больших данных.
+const uint64_t KERNEL_MIN_LENGTH = 4096;
+
+inline void interleaveRows(const unsigned char* const* rows, size_t count, unsigned char* out, size_t outStride, size_t length) {
+    cipherKernels().interleaveBytes(rows, count, out, outStride, length);
+}
+
+inline void interleaveRows(const wchar_t* const* rows, size_t count, wchar_t* out, size_t outStride, size_t length) {
+    cipherKernels().interleaveWide(rows, count, out, outStride, length);
+}
+
+inline void gatherColumns(const unsigned char* in, size_t inStride, const uint64_t* offsets, size_t count, unsigned char* out, size_t outStride, size_t length) {
+    cipherKernels().gatherBytes(in, inStride, offsets, count, out, outStride, length);
+}
+
+inline void gatherColumns(const wchar_t* in, size_t inStride, const uint64_t* offsets, size_t count, wchar_t* out, size_t outStride, size_t length) {
+    cipherKernels().gatherWide(in, inStride, offsets, count, out, outStride, length);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef DAEMON_PROTOCOL_H
+#define DAEMON_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Протокол резидентного режима (rgr --serve). Соединение - поток кадров
+// запрос/ответ; числа в порядке байт машины (клиент и сервер на одном узле).
+//
+// Запрос:  RequestHeader, затем keyLength байт ключа, затем payloadLength байт данных.
+// Ответ:   ResponseHeader, затем payloadLength байт результата.
+//
+// Ключ: Аффинный шифр - два uint64_t (a, b); Скитала - uint64_t;
+// табличный шифр - ключевое слово в UTF-8.
+// Данные: для BINARY - байты, для TEXT - текст в UTF-8, для файловых
+// режимов - путь к исходному файлу и путь к результату через '\0'.
+//
+// Заголовок и ключ проверяются до приёма данных. Если запрос отклонён
+// (данные длиннее предела сервера, неизвестный режим, недопустимый ключ),
+// сервер отвечает статусом без данных и закрывает соединение, не читая их.
+// Запрос или ответ, который не продвигается 30 секунд, сервер прерывает,
+// закрывая соединение; между запросами соединение может простаивать сколько угодно.
+
+const uint32_t DAEMON_MAGIC = 0x31524752;  // "RGR1"
+const uint32_t DAEMON_MAX_KEY = 4096;
+const uint64_t DAEMON_DEFAULT_MAX_PAYLOAD = 64 << 20;  // предел данных запроса; у сервера - RGR_MAX_PAYLOAD
+
+enum class DaemonCipher : uint8_t {
+    SKYTALE = 1,
+    AFFINE = 2,
+    TABLE = 3
+};
+
+enum class DaemonPayload : uint8_t {
+    BINARY = 0,
+    TEXT = 1,
+    BINARY_FILE = 2,
+    TEXT_FILE = 3
+};
+
+// Размещение буферов для BINARY_FILE (large_buffer.h), выбирается на каждый
+// запрос; 0 в поле - значение по умолчанию сервера (RGR_HUGEPAGES, RGR_NUMA).
+const uint8_t DAEMON_PAGES_MASK = 0x03;
+const uint8_t DAEMON_PAGES_NONE = 0x01;
+const uint8_t DAEMON_PAGES_TRANSPARENT = 0x02;
+const uint8_t DAEMON_PAGES_EXPLICIT = 0x03;
+const uint8_t DAEMON_NUMA_MASK = 0x0c;
+const uint8_t DAEMON_NUMA_DEFAULT = 0x04;
+const uint8_t DAEMON_NUMA_FIRST_TOUCH = 0x08;
+const uint8_t DAEMON_NUMA_INTERLEAVE = 0x0c;
+
+enum class DaemonStatus : uint32_t {
+    OK = 0,
+    BAD_REQUEST = 1,
+    BAD_KEY = 2,
+    IO_ERROR = 3,
+    INTERNAL_ERROR = 4
+};
+
+struct RequestHeader {
+    uint32_t magic;
+    uint8_t cipher;
+    uint8_t encrypt;
+    uint8_t payload;
+    uint8_t flags;      // DAEMON_PAGES_* | DAEMON_NUMA_*
+    uint32_t keyLength;
+    uint32_t reserved2;
+    uint64_t payloadLength;
+};
+
+struct ResponseHeader {
+    uint32_t magic;
+    uint32_t status;
+    uint64_t payloadLength;
+};
+
+static_assert(sizeof(RequestHeader) == 24, "RequestHeader layout");
+static_assert(sizeof(ResponseHeader) == 16, "ResponseHeader layout");
+
+// Чтение и запись ровно length байт; false - ошибка или закрытое соединение.
+inline bool recvAll(int fd, void* data, size_t length) {
+    char* p = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t n = recv(fd, p, length, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Отправка нескольких участков одним системным вызовом (без склейки в буфер).
+inline bool sendAllv(int fd, iovec* parts, int count) {
+    while (count > 0) {
+        msghdr message = {};
+        message.msg_iov = parts;
+        message.msg_iovlen = static_cast<size_t>(count);
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        size_t sent = static_cast<size_t>(n);
+        while (count > 0 && sent >= parts->iov_len) {
+            sent -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<char*>(parts->iov_base) + sent;
+            parts->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+inline bool fillSocketAddress(const char* path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+    return true;
+}
+
+// Подключение клиента; -1 при ошибке (errno сохраняется).
+inline int connectDaemon(const char* path) {
+    sockaddr_un address;
+    if (!fillSocketAddress(path, address)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+inline bool sendRequest(int fd, RequestHeader header, const void* key, const void* payload) {
+    iovec parts[3] = {
+        { &header, sizeof(header) },
+        { const_cast<void*>(key), header.keyLength },
+        { const_cast<void*>(payload), static_cast<size_t>(header.payloadLength) }
+    };
+    return sendAllv(fd, parts, 3);
+}
+
+#endif
@@ -0,0 +1,556 @@
+#include "execution_plan.h"
+#include "table.h"
+#include "table_file.h"
+#include "transposition.h"
+#include "file_utils.h"
+#include "large_buffer.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "result_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+using namespace std;
+
+namespace {
+
+const uint64_t UNLIMITED = UINT64_MAX;
+const uint64_t STREAM_MIN_BYTES = 64 << 20;   // Аффинный шифр от этого размера - блоками
+const uint64_t STREAM_CHUNK = 8 << 20;
+const uint64_t STREAM_CHUNK_ROTATIONAL = 32 << 20;  // меньше переключений между чтением и записью
+const uint64_t MIN_CHUNK = 64 << 10;
+const uint64_t TEXT_MEMORY_FACTOR = 10;       // байты файла + wchar_t вход и выход + UTF-8 выход
+const uint64_t TEXT_PARALLEL_MIN_BYTES = 16 << 20;  // порог параллельного UTF-8 (file_utils.cpp)
+const uint64_t HASH_BLOCK = 4 << 20;
+
+string readFirstLine(const string& path) {
+    ifstream file(path);
+    string line;
+    getline(file, line);
+    return line;
+}
+
+uint64_t readNumber(const string& path) {
+    string line = readFirstLine(path);
+    if (line.empty() || line == "max" || line == "-1") return UNLIMITED;
+    return strtoull(line.c_str(), nullptr, 10);
+}
+
+// Поле name из memory.stat.
+uint64_t statField(const string& path, const char* name) {
+    ifstream file(path);
+    string key;
+    uint64_t value;
+    while (file >> key >> value) {
+        if (key == name) return value;
+    }
+    return 0;
+}
+
+// Каталоги группы процесса для контроллера от листа к корню иерархии root.
+// Если группа не видна (пространство имён cgroup), - только root.
+vector<string> cgroupDirectories(const string& root, const char* controller) {
+    ifstream file("/proc/self/cgroup");
+    string line;
+    string relative;
+    while (getline(file, line)) {
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == string::npos || second == string::npos) continue;
+        string controllers = line.substr(first + 1, second - first - 1);
+        bool match = controller == nullptr ? controllers.empty()
+                                           : ("," + controllers + ",").find(string(",") + controller + ",") != string::npos;
+        if (match) relative = line.substr(second + 1);
+    }
+
+    vector<string> directories;
+    struct stat info;
+    string path = root + relative;
+    while (path.size() > root.size() && !path.empty() && path.back() == '/') path.pop_back();
+    if (stat(path.c_str(), &info) != 0) path = root;
+    while (true) {
+        directories.push_back(path);
+        if (path.size() <= root.size()) break;
+        path = path.substr(0, path.rfind('/'));
+    }
+    return directories;
+}
+
+bool exists(const string& path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// Свободно до ограничения памяти группы; страничный кэш, который можно
+// вытеснить (inactive_file), свободным считается.
+uint64_t cgroupMemory() {
+    uint64_t best = UNLIMITED;
+    if (exists("/sys/fs/cgroup/cgroup.controllers")) {
+        for (const string& directory : cgroupDirectories("/sys/fs/cgroup", nullptr)) {
+            uint64_t limit = readNumber(directory + "/memory.max");
+            if (limit == UNLIMITED) continue;
+            uint64_t used = readNumber(directory + "/memory.current");
+            uint64_t cache = statField(directory + "/memory.stat", "inactive_file");
+            used = used == UNLIMITED ? 0 : used - min(used, cache);
+            best = min(best, limit - min(limit, used));
+        }
+    } else if (exists("/sys/fs/cgroup/memory/memory.limit_in_bytes")) {
+        for (const string& directory : cgroupDirectories("/sys/fs/cgroup/memory", "memory")) {
+            uint64_t limit = readNumber(directory + "/memory.limit_in_bytes");
+            if (limit >= (uint64_t(1) << 62)) continue;  // без ограничения - почти 2^63
+            uint64_t used = readNumber(directory + "/memory.usage_in_bytes");
+            uint64_t cache = statField(directory + "/memory.stat", "total_inactive_file");
+            used = used == UNLIMITED ? 0 : used - min(used, cache);
+            best = min(best, limit - min(limit, used));
+        }
+    }
+    return best;
+}
+
+uint64_t availableMemory() {
+    uint64_t available = UNLIMITED;
+    ifstream file("/proc/meminfo");
+    string key;
+    uint64_t value;
+    string unit;
+    while (file >> key >> value >> unit) {
+        if (key == "MemAvailable:") {
+            available = value * 1024;
+            break;
+        }
+    }
+    return min(available, cgroupMemory());
+}
+
+uint64_t quotaCores(uint64_t quota, uint64_t period) {
+    if (quota == UNLIMITED || period == UNLIMITED || period == 0) return UNLIMITED;
+    return max<uint64_t>(1, (quota + period - 1) / period);
+}
+
+unsigned availableCores() {
+    uint64_t cores = max(1u, thread::hardware_concurrency());
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) cores = max(1, CPU_COUNT(&set));
+
+    if (exists("/sys/fs/cgroup/cgroup.controllers")) {
+        for (const string& directory : cgroupDirectories("/sys/fs/cgroup", nullptr)) {
+            string line = readFirstLine(directory + "/cpu.max");
+            if (line.empty() || line.compare(0, 3, "max") == 0) continue;
+            char* end;
+            uint64_t quota = strtoull(line.c_str(), &end, 10);
+            cores = min(cores, quotaCores(quota, strtoull(end, nullptr, 10)));
+        }
+    } else if (exists("/sys/fs/cgroup/cpu/cpu.cfs_quota_us")) {
+        for (const string& directory : cgroupDirectories("/sys/fs/cgroup/cpu", "cpu")) {
+            cores = min(cores, quotaCores(readNumber(directory + "/cpu.cfs_quota_us"),
+                                          readNumber(directory + "/cpu.cfs_period_us")));
+        }
+    }
+    return static_cast<unsigned>(min<uint64_t>(cores, workerThreads()));
+}
+
+// Признак rotational очереди блочного устройства, где лежит файл; у раздела
+// очередь - у родительского диска. tmpfs, сеть и неизвестное - не вращаются.
+bool rotationalStorage(const string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    char device[64];
+    snprintf(device, sizeof(device), "/sys/dev/block/%u:%u", major(info.st_dev), minor(info.st_dev));
+    string value = readFirstLine(string(device) + "/queue/rotational");
+    if (value.empty()) value = readFirstLine(string(device) + "/../queue/rotational");
+    return value == "1";
+}
+
+uint64_t environmentBytes(const char* name) {
+    const char* value = getenv(name);
+    if (!value) return 0;
+    return strtoull(value, nullptr, 10);
+}
+
+bool forcedPath(ExecutionPath& path) {
+    const char* value = getenv("RGR_PLAN");
+    if (!value) return false;
+    const ExecutionPath paths[] = { ExecutionPath::MEMORY, ExecutionPath::PARALLEL, ExecutionPath::STREAM,
+                                    ExecutionPath::MMAP, ExecutionPath::OUT_OF_CORE };
+    for (ExecutionPath candidate : paths) {
+        if (strcmp(value, executionPathName(candidate)) == 0) {
+            path = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* cipherName(ContainerCipher cipher) {
+    switch (cipher) {
+        case ContainerCipher::SKYTALE: return "skytale";
+        case ContainerCipher::AFFINE: return "affine";
+        case ContainerCipher::TABLE: return "table";
+    }
+    return "unknown";
+}
+
+void logPlan(const char* operation, const ExecutionRequest& request, const ExecutionResources& resources,
+             const ExecutionPlan& plan, const char* cache = "off") {
+    static const char* target = getenv("RGR_PLAN_LOG");
+    if (!target) return;
+
+    char line[512];
+    int length = snprintf(line, sizeof(line),
+                          "{\"operation\":\"%s\",\"encrypt\":%s,\"cipher\":\"%s\",\"key_width\":%llu,\"input_bytes\":%llu,"
+                          "\"memory_bytes\":%llu,\"cores\":%u,\"rotational\":%s,\"path\":\"%s\",\"threads\":%u,"
+                          "\"chunk_bytes\":%llu,\"reason\":\"%s\",\"cache\":\"%s\"}\n",
+                          operation, request.encrypt ? "true" : "false", cipherName(request.cipher),
+                          static_cast<unsigned long long>(request.keyWidth),
+                          static_cast<unsigned long long>(request.inputSize),
+                          static_cast<unsigned long long>(resources.memory), resources.cores,
+                          resources.rotational ? "true" : "false", executionPathName(plan.path), plan.threads,
+                          static_cast<unsigned long long>(plan.chunkSize), plan.reason, cache);
+    length = min(length, static_cast<int>(sizeof(line)) - 1);
+    if (strcmp(target, "stderr") != 0 && strcmp(target, "1") != 0) {
+        ofstream file(target, ios::app);
+        file.write(line, length);
+    } else {
+        // Напрямую в дескриптор, как сводки metrics.cpp
+        ssize_t written = write(STDERR_FILENO, line, static_cast<size_t>(length));
+        (void)written;
+    }
+}
+
+// Полосы строк по потоку: память на поток и число потоков, которым её хватает.
+bool fitBands(uint64_t keyWidth, uint64_t budget, unsigned& threads, uint64_t& perThread) {
+    uint64_t minimum = 2 * keyWidth * TABLE_FILE_MIN_BAND_ROWS;
+    threads = static_cast<unsigned>(max<uint64_t>(1, min<uint64_t>(threads, budget / max<uint64_t>(minimum, 1))));
+    perThread = budget / threads;
+    return perThread >= minimum;
+}
+
+// Хеш содержимого для кэша результатов тем же проходом, что читает файл:
+// в target, если путь держит вход в памяти, иначе через небольшой буфер.
+bool readHashed(int in, uint64_t size, LargeBuffer* target, ContentHasher& hasher) {
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    LargeBuffer scratch;
+    if (target) *target = LargeBuffer(static_cast<size_t>(size));
+    else scratch = LargeBuffer(static_cast<size_t>(min(HASH_BLOCK, size)));
+    StageTimer timer(MetricStage::READ, size);
+    for (uint64_t offset = 0; offset < size; offset += HASH_BLOCK) {
+        size_t n = static_cast<size_t>(min(HASH_BLOCK, size - offset));
+        unsigned char* block = target ? target->data() + offset : scratch.data();
+        if (!preadAll(in, block, n, offset)) return false;
+        hasher.update(span<const unsigned char>(block, n));
+    }
+    return true;
+}
+
+FileResult memoryPath(const wstring& input, LargeBuffer& data, const wstring& output, const Cipher& cipher,
+                      bool encrypt) {
+    if (data.empty() && !readBinaryFile(input, data, defaultBufferPolicy())) return FileResult::READ_FAILED;
+    LargeBuffer result(cipher.requiredOutputSize(data.size(), encrypt));
+    {
+        StageTimer timer(encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT, data.size());
+        result.shrink(cipher.transform(data.bytes(), result.bytes(), encrypt));
+    }
+    return writeBinaryFile(output, result.bytes()) ? FileResult::OK : FileResult::WRITE_FAILED;
+}
+
+FileResult streamPath(int in, uint64_t size, const wstring& output, const Cipher& cipher, bool encrypt, uint64_t chunk) {
+    int out = ::open(ws2s(output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return FileResult::WRITE_FAILED;
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    LargeBuffer buffer(static_cast<size_t>(min(chunk, size)));
+    FileResult result = FileResult::OK;
+    for (uint64_t offset = 0; offset < size && result == FileResult::OK; offset += buffer.size()) {
+        size_t n = static_cast<size_t>(min<uint64_t>(buffer.size(), size - offset));
+        bool ok;
+        {
+            StageTimer timer(MetricStage::READ, n);
+            ok = preadAll(in, buffer.data(), n, offset);
+        }
+        if (!ok) {
+            result = FileResult::READ_FAILED;
+            break;
+        }
+        {
+            StageTimer timer(encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT, n);
+            cipher.transformInPlace(buffer.bytes(), n, encrypt);
+        }
+        StageTimer timer(MetricStage::WRITE, n);
+        if (!pwriteAll(out, buffer.data(), n, offset)) result = FileResult::WRITE_FAILED;
+    }
+    if (::close(out) != 0 && result == FileResult::OK) result = FileResult::WRITE_FAILED;
+    return result;
+}
+
+FileResult mmapPath(int in, uint64_t size, const wstring& output, const Cipher& cipher, bool encrypt) {
+    void* source = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, in, 0);
+    if (source == MAP_FAILED) return FileResult::READ_FAILED;
+    int out = ::open(ws2s(output).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    size_t capacity = cipher.requiredOutputSize(static_cast<size_t>(size), encrypt);
+    void* target = MAP_FAILED;
+    if (out >= 0 && ftruncate(out, static_cast<off_t>(capacity)) == 0) {
+        target = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+    }
+
+    FileResult result = FileResult::WRITE_FAILED;
+    if (target != MAP_FAILED) {
+        size_t written;
+        {
+            StageTimer timer(encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT, size);
+            written = cipher.transform(span<const unsigned char>(static_cast<const unsigned char*>(source), size),
+                                       span<unsigned char>(static_cast<unsigned char*>(target), capacity), encrypt);
+        }
+        munmap(target, capacity);
+        if (ftruncate(out, static_cast<off_t>(written)) == 0) result = FileResult::OK;
+    }
+    munmap(source, static_cast<size_t>(size));
+    if (out >= 0 && ::close(out) != 0) result = FileResult::WRITE_FAILED;
+    return result;
+}
+
+// Скитала - табличный шифр с тождественным порядком столбцов, но без
+// отбрасывания нулей при расшифровании.
+FileResult outOfCorePath(int in, uint64_t size, const wstring& output, const CipherKey& key, bool encrypt,
+                         const ExecutionPlan& plan) {
+    vector<uint64_t> columnOrder = permutationColumns(key);
+    uint64_t keyWidth = static_cast<uint64_t>(columnOrder.size());
+    uint64_t rows = tableFileRows(size, keyWidth, encrypt);
+    uint64_t bandRows = tableBandRows(keyWidth, plan.chunkSize);
+
+    int out = ::open(ws2s(output).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return FileResult::WRITE_FAILED;
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    bool ok = ftruncate(out, static_cast<off_t>(rows * keyWidth)) == 0;
+    if (ok) {
+        StageTimer timer(encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT, size);
+        // Потоки берут соседние диапазоны строк; полосы не пересекаются по записи
+        uint64_t parts = min<uint64_t>(plan.threads, max<uint64_t>(rows, 1));
+        uint64_t step = (rows + parts - 1) / max<uint64_t>(parts, 1);
+        ok = parallelFor(parts, plan.threads, [&](uint64_t part) {
+            uint64_t first = part * step;
+            uint64_t last = min(rows, first + step);
+            return transposeTableRows(in, size, out, columnOrder, encrypt, first, last, bandRows);
+        });
+    }
+    if (ok && key.cipher == ContainerCipher::TABLE && !encrypt) ok = trimTablePadding(out, rows * keyWidth);
+    ok = ::close(out) == 0 && ok;
+    return ok ? FileResult::OK : FileResult::WRITE_FAILED;
+}
+
+uint64_t keyWidth(const CipherKey& key) {
+    switch (key.cipher) {
+        case ContainerCipher::SKYTALE: return key.key;
+        case ContainerCipher::TABLE: return static_cast<uint64_t>(getColumnOrder(key.word).size());
+        case ContainerCipher::AFFINE: break;
+    }
+    return 1;
+}
+
+}
+
+const char* executionPathName(ExecutionPath path) {
+    switch (path) {
+        case ExecutionPath::MEMORY: return "memory";
+        case ExecutionPath::PARALLEL: return "parallel";
+        case ExecutionPath::STREAM: return "stream";
+        case ExecutionPath::MMAP: return "mmap";
+        case ExecutionPath::OUT_OF_CORE: return "out-of-core";
+    }
+    return "unknown";
+}
+
+ExecutionResources probeResources(const wstring& path) {
+    ExecutionResources resources;
+    uint64_t memory = environmentBytes("RGR_PLAN_MEMORY");
+    resources.memory = memory > 0 ? memory : availableMemory();
+    resources.cores = availableCores();
+    const char* storage = getenv("RGR_PLAN_STORAGE");
+    if (storage && strcmp(storage, "hdd") == 0) resources.rotational = true;
+    else if (storage && strcmp(storage, "ssd") == 0) resources.rotational = false;
+    else resources.rotational = rotationalStorage(ws2s(path));
+    return resources;
+}
+
+ExecutionPlan planExecution(const ExecutionRequest& request, const ExecutionResources& resources) {
+    ExecutionPlan plan;
+    const uint64_t size = request.inputSize;
+    const uint64_t budget = resources.memory / 4 * 3;  // запас другим процессам и кэшу
+    const unsigned cores = max(1u, resources.cores);
+    const bool permutation = request.cipher != ContainerCipher::AFFINE;
+    const uint64_t width = max<uint64_t>(request.keyWidth, 1);
+    const uint64_t chunkOverride = environmentBytes("RGR_PLAN_CHUNK");
+
+    if (request.text) {
+        bool parallel = size >= TEXT_PARALLEL_MIN_BYTES && cores > 1;
+        plan.path = parallel ? ExecutionPath::PARALLEL : ExecutionPath::MEMORY;
+        plan.threads = parallel ? cores : 1;
+        plan.reason = size * TEXT_MEMORY_FACTOR <= budget ? "text fits in memory" : "text has no streaming path";
+        return plan;
+    }
+
+    // Полосы строк годятся, если это перестановка всей матрицы: у Скиталы
+    // длина расшифровываемого входа должна быть кратна ключу
+    const bool bandable = permutation && request.keyWidth > 0 &&
+                          !(request.cipher == ContainerCipher::SKYTALE && !request.encrypt && size % width != 0);
+    const bool fits = size + size + width <= budget;
+    unsigned bandThreads = resources.rotational ? 1 : cores;  // на диске с головкой - один последовательный проход
+    uint64_t perThread = 0;
+    const bool bands = bandable && fitBands(width, chunkOverride > 0 ? chunkOverride * bandThreads : budget / 2,
+                                            bandThreads, perThread);
+
+    if (!permutation) {
+        if (size >= STREAM_MIN_BYTES || !fits) {
+            plan.path = ExecutionPath::STREAM;
+            plan.reason = fits ? "byte substitution streams at the same speed with less memory" : "input exceeds memory";
+        } else {
+            plan.path = ExecutionPath::MEMORY;
+            plan.reason = "small input";
+        }
+    } else if (fits) {
+        bool parallel = size >= PARALLEL_MIN_BYTES && cores > 1;
+        plan.path = parallel ? ExecutionPath::PARALLEL : ExecutionPath::MEMORY;
+        plan.threads = parallel ? cores : 1;
+        plan.reason = parallel ? "input fits in memory, permutation split into bands" : "small input";
+    } else if (bands) {
+        plan.path = ExecutionPath::OUT_OF_CORE;
+        plan.threads = bandThreads;
+        plan.chunkSize = perThread;
+        plan.reason = resources.rotational ? "input exceeds memory, one sequential pass on rotational storage"
+                                           : "input exceeds memory, row bands in parallel";
+    } else {
+        plan.path = ExecutionPath::MMAP;
+        plan.threads = resources.rotational ? 1 : cores;
+        plan.reason = "input exceeds memory and key is too wide for row bands";
+    }
+
+    ExecutionPath forced;
+    if (forcedPath(forced) && forced != plan.path) {
+        bool applicable = (forced != ExecutionPath::STREAM || !permutation) &&
+                          (forced != ExecutionPath::OUT_OF_CORE || bandable);
+        if (applicable) {
+            plan.path = forced;
+            plan.reason = "RGR_PLAN override";
+            plan.threads = forced == ExecutionPath::MEMORY || forced == ExecutionPath::STREAM ? 1 : cores;
+            if (forced == ExecutionPath::OUT_OF_CORE) {
+                plan.threads = resources.rotational ? 1 : cores;
+                fitBands(width, chunkOverride > 0 ? chunkOverride * plan.threads : budget / 2, plan.threads, perThread);
+                plan.chunkSize = perThread;
+            }
+        } else {
+            plan.reason = "RGR_PLAN override is not applicable to this cipher";
+        }
+    }
+
+    if (plan.path == ExecutionPath::STREAM) {
+        uint64_t chunk = resources.rotational ? STREAM_CHUNK_ROTATIONAL : STREAM_CHUNK;
+        plan.chunkSize = chunkOverride > 0 ? chunkOverride : max(MIN_CHUNK, min(chunk, budget / 2));
+    } else if (plan.path == ExecutionPath::OUT_OF_CORE && chunkOverride > 0) {
+        plan.chunkSize = chunkOverride;
+    }
+    return plan;
+}
+
+FileResult transformBinaryFile(const char* operation, const wstring& input, const wstring& output,
+                               const CipherKey& key, bool encrypt) {
+    unique_ptr<Cipher> cipher = makeCipher(key);
+    int in = ::open(ws2s(input).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return FileResult::READ_FAILED;
+    struct stat info;
+    uint64_t size = fstat(in, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    if (size == 0) {
+        ::close(in);
+        return FileResult::READ_FAILED;
+    }
+
+    // Выход - тот же файл, что и вход (в том числе через ссылку): потоковый,
+    // mmap и внешний пути усекают выход, пока вход ещё читается. Результат
+    // пишется во временный файл рядом и переименовывается на место входа
+    struct stat outputInfo;
+    const bool sameFile = stat(ws2s(output).c_str(), &outputInfo) == 0 && outputInfo.st_dev == info.st_dev &&
+                          outputInfo.st_ino == info.st_ino;
+    const wstring target = sameFile ? output + L".tmp." + to_wstring(getpid()) : output;
+    auto finish = [&](FileResult result) {
+        ::close(in);
+        if (!sameFile) return result;
+        if (result == FileResult::OK && chmod(ws2s(target).c_str(), info.st_mode & 07777) == 0 &&
+            rename(ws2s(target).c_str(), ws2s(output).c_str()) == 0) {
+            return result;
+        }
+        unlink(ws2s(target).c_str());
+        return result == FileResult::OK ? FileResult::WRITE_FAILED : result;
+    };
+
+    ExecutionRequest request;
+    request.cipher = key.cipher;
+    request.keyWidth = keyWidth(key);
+    request.encrypt = encrypt;
+    request.inputSize = size;
+    ExecutionResources resources = probeResources(input);
+    ExecutionPlan plan = planExecution(request, resources);
+
+    // С кэшем вход читается с хешированием до шифрования: пути в памяти
+    // потом берут прочитанное, остальные читают файл ещё раз только при промахе
+    const ResultCache& cache = defaultResultCache();
+    const bool inMemory = plan.path == ExecutionPath::MEMORY || plan.path == ExecutionPath::PARALLEL;
+    LargeBuffer data;
+    CacheKey cacheKey;
+    const bool cached = cache.covers(encrypt);
+    if (cached) {
+        ContentHasher hasher;
+        if (!readHashed(in, size, inMemory ? &data : nullptr, hasher)) {
+            ::close(in);
+            return FileResult::READ_FAILED;
+        }
+        cacheKey.content = hasher.finish();
+        cacheKey.length = size;
+        cacheKey.keyFingerprint = keyFingerprint(key);
+        cacheKey.cipher = static_cast<uint8_t>(key.cipher);
+        cacheKey.encrypt = encrypt;
+        if (cache.fetch(cacheKey, target)) {
+            logPlan(operation, request, resources, plan, "hit");
+            return finish(FileResult::OK);
+        }
+    }
+    logPlan(operation, request, resources, plan, cached ? "miss" : "off");
+
+    WorkerThreadsScope threads(plan.threads);
+    FileResult result;
+    switch (plan.path) {
+        case ExecutionPath::STREAM:
+            result = streamPath(in, size, target, *cipher, encrypt, plan.chunkSize);
+            break;
+        case ExecutionPath::MMAP:
+            result = mmapPath(in, size, target, *cipher, encrypt);
+            break;
+        case ExecutionPath::OUT_OF_CORE:
+            result = outOfCorePath(in, size, target, key, encrypt, plan);
+            break;
+        default:
+            result = memoryPath(input, data, target, *cipher, encrypt);
+            break;
+    }
+    result = finish(result);
+    if (cached && result == FileResult::OK) cache.store(cacheKey, output);
+    return result;
+}
+
+unsigned planTextThreads(const char* operation, const wstring& input, ContainerCipher cipher, bool encrypt) {
+    struct stat info;
+    ExecutionRequest request;
+    request.cipher = cipher;
+    request.text = true;
+    request.encrypt = encrypt;
+    request.inputSize = stat(ws2s(input).c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    ExecutionResources resources = probeResources(input);
+    ExecutionPlan plan = planExecution(request, resources);
+    logPlan(operation, request, resources, plan);
+    return plan.threads;
+}
@@ -0,0 +1,80 @@
+#ifndef EXECUTION_PLAN_H
+#define EXECUTION_PLAN_H
+
+#include "container.h"
+#include <string>
+#include <cstdint>
+
+// Выбор способа обработки файла. Планировщик смотрит на размер входа, шифр,
+// ширину ключа (столбцов матрицы), доступную память с учётом ограничений
+// cgroup, число ядер (привязка процесса и квота cgroup) и тип носителя, и
+// выбирает путь, число потоков и размер блока:
+//   MEMORY      - файл целиком в памяти, один поток;
+//   PARALLEL    - то же, перестановка полосами на нескольких потоках;
+//   STREAM      - Аффинный шифр блоками подряд, памяти - один блок;
+//   MMAP        - вход и выход отображаются в память, страницами управляет ядро;
+//   OUT_OF_CORE - перестановка полосами строк через table_file.h.
+//
+// Решение можно переопределить переменными окружения:
+//   RGR_PLAN=memory|parallel|stream|mmap|out-of-core - путь (если он годится для шифра);
+//   RGR_PLAN_MEMORY=<байт>  - доступная память вместо измеренной;
+//   RGR_PLAN_CHUNK=<байт>   - блок STREAM или бюджет полос OUT_OF_CORE;
+//   RGR_PLAN_STORAGE=hdd|ssd - тип носителя вместо определённого;
+//   RGR_THREADS=N           - не больше N потоков (parallel.h).
+// RGR_PLAN_LOG=stderr|<файл> - по JSON-строке с решением на каждую операцию.
+
+enum class ExecutionPath {
+    MEMORY,
+    PARALLEL,
+    STREAM,
+    MMAP,
+    OUT_OF_CORE
+};
+
+struct ExecutionResources {
+    uint64_t memory = 0;     // байт можно занять, не вытесняя других
+    unsigned cores = 1;
+    bool rotational = false; // вход на вращающемся диске
+};
+
+struct ExecutionRequest {
+    ContainerCipher cipher = ContainerCipher::AFFINE;
+    uint64_t keyWidth = 1;   // столбцов матрицы у Скиталы и таблицы
+    bool text = false;
+    bool encrypt = true;
+    uint64_t inputSize = 0;
+};
+
+struct ExecutionPlan {
+    ExecutionPath path = ExecutionPath::MEMORY;
+    unsigned threads = 1;
+    uint64_t chunkSize = 0;  // STREAM: блок; OUT_OF_CORE: память под полосы одного потока
+    const char* reason = "";
+};
+
+// Ресурсы для работы с файлом path (носитель - тот, где он лежит).
+ExecutionResources probeResources(const std::wstring& path);
+
+// Чистая функция запроса и ресурсов; учитывает RGR_PLAN и RGR_PLAN_CHUNK.
+ExecutionPlan planExecution(const ExecutionRequest& request, const ExecutionResources& resources);
+
+const char* executionPathName(ExecutionPath path);
+
+enum class FileResult {
+    OK,
+    READ_FAILED,   // вход не открылся, пуст или не прочитался
+    WRITE_FAILED
+};
+
+// Двоичный файл в файл по плану; operation - имя для журнала и замеров
+// (например, "table.image_file"). Результат совпадает с Cipher::transform.
+// output может совпадать с input: результат тогда заменяет вход целиком
+// (временный файл и rename), вход не портится при ошибке.
+FileResult transformBinaryFile(const char* operation, const std::wstring& input, const std::wstring& output,
+                               const CipherKey& key, bool encrypt);
+
+// Текст обрабатывается только целиком в памяти (табличный шифр и разбиение
+// на группы требуют всего сообщения): планируется число потоков.
+unsigned planTextThreads(const char* operation, const std::wstring& input, ContainerCipher cipher, bool encrypt);
+
+#endif
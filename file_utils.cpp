@@ -1,9 +1,20 @@
 #include "file_utils.h"
+#include "metrics.h"
+#include "cpu_dispatch.h"
+#include "arena.h"
+#include "parallel.h"
+#include "probes.h"
 #include <fstream>
+#include <algorithm>
 #include <vector>
 #include <locale>
 #include <codecvt>  
 #include <string>
+#include <span>
+#include <stdexcept>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
 
 using namespace std;
 
@@ -17,27 +28,164 @@ wstring s2ws(const string& s) {
     return converter.from_bytes(s);
 }
 
-wstring readTextFile(const wstring& filename) {
+// Начиная с двух таких частей текст декодируется и кодируется параллельно.
+static const size_t TEXT_CHUNK = 8 << 20;
+
+// Части начинаются с первого байта символа. Сначала считается число символов
+// каждой части, затем по префиксным суммам части декодируются одновременно,
+// каждая сразу на своё место в out. Результат совпадает с однопоточным.
+static size_t decodeUtf8Chunked(const unsigned char* in, size_t length, wchar_t* out) {
+    const CipherKernels& kernels = cipherKernels();
+    size_t chunks = length / TEXT_CHUNK;
+    if (chunks < 2 || workerThreads() < 2) {
+        return kernels.decodeUtf8(in, length, out);
+    }
+
+    ArenaScope scope;
+    span<size_t> bounds = scope.allocate<size_t>(chunks + 1);
+    bounds[0] = 0;
+    bounds[chunks] = length;
+    for (size_t c = 1; c < chunks; c++) {
+        size_t bound = c * TEXT_CHUNK;
+        for (int k = 0; k < 3 && (in[bound] & 0xC0) == 0x80; k++) {
+            bound++;
+        }
+        bounds[c] = bound;
+    }
+
+    span<size_t> offsets = scope.allocate<size_t>(chunks + 1);
+    offsets[0] = 0;
+    parallelFor(chunks, 0, [&](uint64_t c) {
+        offsets[c + 1] = kernels.countUtf8(in + bounds[c], bounds[c + 1] - bounds[c]);
+        return true;
+    });
+    for (size_t c = 0; c < chunks; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+
+    size_t lastCount = 0;
+    bool ok = parallelFor(chunks, 0, [&](uint64_t c) {
+        size_t count = kernels.decodeUtf8(in + bounds[c], bounds[c + 1] - bounds[c], out + offsets[c]);
+        if (c + 1 == chunks) {
+            lastCount = count;
+            return count != UTF8_ERROR;
+        }
+        // Отброшенный неполный символ внутри текста - ошибка, как и при чтении подряд
+        return count == offsets[c + 1] - offsets[c];
+    });
+    return ok ? offsets[chunks - 1] + lastCount : UTF8_ERROR;
+}
+
+TextFileResult readTextFile(const wstring& filename, wstring& content) {
+    content.clear();
     string narrow_filename = ws2s(filename);
     ifstream file(narrow_filename, ios::binary);
-    if (!file.is_open()) return L"";
+    if (!file.is_open()) return TextFileResult::READ_FAILED;
     
     file.seekg(0, ios::end);
-    size_t fileSize = file.tellg();
+    streamoff end = file.tellg();
     file.seekg(0, ios::beg);
+    if (end < 0) return TextFileResult::READ_FAILED;
+    size_t fileSize = static_cast<size_t>(end);
     
-    if (fileSize == 0) return L"";
+    if (fileSize == 0) return TextFileResult::OK;
     
-    vector<char> buffer(fileSize);
-    file.read(buffer.data(), fileSize);
-    file.close();
+    ArenaScope scope;
+    span<char> buffer = scope.allocate<char>(fileSize);
+    {
+        StageTimer timer(MetricStage::READ, fileSize);
+        if (!file.read(buffer.data(), fileSize)) return TextFileResult::READ_FAILED;
+        file.close();
+    }
     
-    wstring_convert<codecvt_utf8<wchar_t>> converter;
-    try {
-        return converter.from_bytes(string(buffer.data(), fileSize));
-    } catch (...) {
-        return L"";
+    StageTimer timer(MetricStage::DECODE, fileSize);
+    content.assign(fileSize, L'\0');
+    size_t count = decodeUtf8Chunked(reinterpret_cast<const unsigned char*>(buffer.data()), fileSize, content.data());
+    if (count == UTF8_ERROR) {
+        content.clear();
+        return TextFileResult::BAD_ENCODING;
+    }
+    content.resize(count);
+    return TextFileResult::OK;
+}
+
+wstring readTextFile(const wstring& filename) {
+    wstring content;
+    readTextFile(filename, content);
+    return content;
+}
+
+size_t encodeUtf8(const wchar_t* in, size_t length, char* out) {
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t code = static_cast<uint32_t>(in[i]);
+        if (code < 0x80) {
+            out[n++] = static_cast<char>(code);
+        } else if (code < 0x800) {
+            out[n++] = static_cast<char>(0xC0 | (code >> 6));
+            out[n++] = static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out[n++] = static_cast<char>(0xE0 | (code >> 12));
+            out[n++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out[n++] = static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code <= 0x10FFFF) {
+            out[n++] = static_cast<char>(0xF0 | (code >> 18));
+            out[n++] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out[n++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out[n++] = static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            return UTF8_ERROR;
+        }
     }
+    return n;
+}
+
+// Длина в UTF-8 или UTF8_ERROR - без записи, для расстановки частей.
+static size_t utf8Length(const wchar_t* in, size_t length) {
+    size_t n = 0;
+    uint32_t maximum = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t code = static_cast<uint32_t>(in[i]);
+        n += 1 + (code >= 0x80) + (code >= 0x800) + (code >= 0x10000);
+        maximum = max(maximum, code);
+    }
+    return maximum > 0x10FFFF ? UTF8_ERROR : n;
+}
+
+// Как decodeUtf8Chunked: длины частей в UTF-8, префиксные суммы, затем
+// части кодируются одновременно. Буфер точного размера берётся из scope.
+static span<char> encodeUtf8Chunked(ArenaScope& scope, const wchar_t* in, size_t length) {
+    const size_t chunkLength = TEXT_CHUNK / sizeof(wchar_t);
+    size_t chunks = length / chunkLength;
+    if (chunks < 2 || workerThreads() < 2) {
+        span<char> out = scope.allocate<char>(length * 4);
+        size_t size = encodeUtf8(in, length, out.data());
+        if (size == UTF8_ERROR) {
+            throw range_error("wstring_convert::to_bytes");
+        }
+        return out.first(size);
+    }
+
+    auto chunkEnd = [&](uint64_t c) { return c + 1 == chunks ? length : (c + 1) * chunkLength; };
+    span<size_t> offsets = scope.allocate<size_t>(chunks + 1);
+    offsets[0] = 0;
+    bool ok = parallelFor(chunks, 0, [&](uint64_t c) {
+        offsets[c + 1] = utf8Length(in + c * chunkLength, chunkEnd(c) - c * chunkLength);
+        return offsets[c + 1] != UTF8_ERROR;
+    });
+    if (!ok) {
+        throw range_error("wstring_convert::to_bytes");
+    }
+    for (size_t c = 0; c < chunks; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+
+    span<char> out = scope.allocate<char>(offsets[chunks]);
+    parallelFor(chunks, 0, [&](uint64_t c) {
+        encodeUtf8(in + c * chunkLength, chunkEnd(c) - c * chunkLength, out.data() + offsets[c]);
+        return true;
+    });
+    return out;
 }
 
 bool writeTextFile(const wstring& filename, const wstring& content) {
@@ -45,8 +193,13 @@ bool writeTextFile(const wstring& filename, const wstring& content) {
     ofstream file(narrow_filename, ios::binary);
     if (!file.is_open()) return false;
     
-    wstring_convert<codecvt_utf8<wchar_t>> converter;
-    string utf8_content = converter.to_bytes(content);
+    ArenaScope scope;
+    span<char> utf8_content;
+    {
+        StageTimer timer(MetricStage::ENCODE, content.size() * sizeof(wchar_t));
+        utf8_content = encodeUtf8Chunked(scope, content.data(), content.size());
+    }
+    StageTimer timer(MetricStage::WRITE, utf8_content.size());
     file.write(utf8_content.data(), utf8_content.size());
     file.close();
     return true;
@@ -64,17 +217,71 @@ vector<unsigned char> readBinaryFile(const wstring& filename) {
     if (fileSize == 0) return {};
     
     vector<unsigned char> buffer(fileSize);
+    StageTimer timer(MetricStage::READ, fileSize);
     file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
     file.close();
     return buffer;
 }
 
+bool readBinaryFile(const wstring& filename, LargeBuffer& buffer, const BufferPolicy& policy) {
+    string narrow_filename = ws2s(filename);
+    ifstream file(narrow_filename, ios::binary);
+    if (!file.is_open()) return false;
+
+    file.seekg(0, ios::end);
+    size_t fileSize = file.tellg();
+    file.seekg(0, ios::beg);
+
+    if (fileSize == 0) return false;
+
+    buffer = LargeBuffer(fileSize, policy);
+    StageTimer timer(MetricStage::READ, fileSize);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(buffer.data()), fileSize));
+}
+
 bool writeBinaryFile(const wstring& filename, const vector<unsigned char>& data) {
+    return writeBinaryFile(filename, span<const unsigned char>(data));
+}
+
+bool writeBinaryFile(const wstring& filename, span<const unsigned char> data) {
     string narrow_filename = ws2s(filename);
     ofstream file(narrow_filename, ios::binary);
     if (!file.is_open()) return false;
     
+    StageTimer timer(MetricStage::WRITE, data.size());
     file.write(reinterpret_cast<const char*>(data.data()), data.size());
     file.close();
     return true;
 }
+
+bool preadAll(int fd, void* data, size_t length, uint64_t offset) {
+    RGR_PROBE(io__begin, fd, length, offset, 0);
+    const size_t requested = length;
+    char* p = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t n = pread(fd, p, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    RGR_PROBE(io__end, fd, requested - length, static_cast<int>(length == 0));
+    return length == 0;
+}
+
+bool pwriteAll(int fd, const void* data, size_t length, uint64_t offset) {
+    RGR_PROBE(io__begin, fd, length, offset, 1);
+    const size_t requested = length;
+    const char* p = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t n = pwrite(fd, p, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    RGR_PROBE(io__end, fd, requested - length, static_cast<int>(length == 0));
+    return length == 0;
+}
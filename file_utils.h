@@ -3,14 +3,42 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "large_buffer.h"
 
 std::string ws2s(const std::wstring& ws);
 std::wstring s2ws(const std::string& s);
 
+// Пустая строка, если файл не прочитался, пуст или не в UTF-8.
 std::wstring readTextFile(const std::wstring& filename);
+
+// То же с различением исходов; пустой файл - OK с пустым content.
+enum class TextFileResult {
+    OK,
+    READ_FAILED,
+    BAD_ENCODING
+};
+
+TextFileResult readTextFile(const std::wstring& filename, std::wstring& content);
 bool writeTextFile(const std::wstring& filename, const std::wstring& content);
 
+// Кодирование в UTF-8 без выделения памяти: out - не менее 4 * length байт.
+// Возвращает число байт или UTF8_ERROR (cpu_dispatch.h) для символов вне Unicode.
+size_t encodeUtf8(const wchar_t* in, size_t length, char* out);
+
 std::vector<unsigned char> readBinaryFile(const std::wstring& filename);
 bool writeBinaryFile(const std::wstring& filename, const std::vector<unsigned char>& data);
 
+// Чтение в буфер с заданным размещением страниц (large_buffer.h) - для
+// больших файлов. false, если файл не открылся или пуст.
+bool readBinaryFile(const std::wstring& filename, LargeBuffer& buffer, const BufferPolicy& policy);
+bool writeBinaryFile(const std::wstring& filename, std::span<const unsigned char> data);
+
+// pread/pwrite всех length байт с повтором после EINTR и неполных операций;
+// false при ошибке или конце файла.
+bool preadAll(int fd, void* data, size_t length, uint64_t offset);
+bool pwriteAll(int fd, const void* data, size_t length, uint64_t offset);
+
 #endif
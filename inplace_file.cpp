@@ -0,0 +1,501 @@
+#include "inplace_file.h"
+#include "table.h"
+#include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+const uint32_t JOURNAL_MAGIC = 0x4a524752;  // "RGRJ"
+const uint32_t JOURNAL_VERSION = 1;
+const uint64_t JOURNAL_SLOT = 512;              // две копии заголовка: оборванная запись одной не портит другую
+const uint64_t JOURNAL_UNDO = 2 * JOURNAL_SLOT; // записи отката текущей порции
+
+enum class JournalState : uint8_t {
+    RUNNING = 1,  // порций в работе нет
+    BATCH = 2,    // порция записана в журнал и, возможно, частично в файл
+    DONE = 3      // осталось установить окончательную длину и удалить журнал
+};
+
+enum class JournalPhase : uint8_t {
+    FORWARD = 1,   // шифрование или расшифрование
+    REWIND = 2,    // откат: возврат недописанного цикла
+    ROLLBACK = 3   // откат: обратная перестановка пройденных циклов
+};
+
+// Положение обхода. Перестановка: циклы с лидером < next пройдены; при
+// inCycle идёт цикл с лидером next, следующая запись - в position, first -
+// исходное значение лидера. Аффинный шифр: пройдены байты [0, next).
+struct Cursor {
+    uint64_t next;
+    uint64_t position;
+    uint8_t inCycle;
+    uint8_t first;
+    uint8_t reserved[6];
+};
+
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;        // действует целая копия с большим номером
+    uint8_t cipher;
+    uint8_t encrypt;
+    uint8_t state;
+    uint8_t phase;
+    uint32_t reserved;
+    uint64_t keyFingerprint;
+    uint64_t originalLength;
+    uint64_t size;            // длина файла на время работы
+    uint64_t finalLength;     // DONE: длина после завершения
+    uint64_t limit;           // обрабатываются циклы с лидером (байты) < limit
+    Cursor committed;
+    uint64_t batchOffset;     // BATCH: начало порции аффинного шифра
+    uint64_t batchCount;      // BATCH: записей отката
+    uint32_t batchChecksum;   // CRC-32C записей отката
+    uint32_t checksum;        // CRC-32C заголовка до этого поля
+};
+
+static_assert(sizeof(Cursor) == 24, "Cursor layout");
+static_assert(sizeof(JournalHeader) <= JOURNAL_SLOT, "JournalHeader layout");
+
+uint32_t headerChecksum(const JournalHeader& header) {
+    return cipherKernels().crc32c(0, reinterpret_cast<const unsigned char*>(&header), offsetof(JournalHeader, checksum));
+}
+
+bool syncDirectory(const wstring& path) {
+    string name = ws2s(path);
+    size_t slash = name.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : name.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Один файл с журналом. Перестановка описана так же, как в transposition.h:
+// out[pos * count + order(d)] = in[d * segment + pos]; source() - откуда
+// берётся новое значение позиции при шифровании или расшифровании.
+class InPlaceSession {
+public:
+    InPlaceSession(const wstring& path, const CipherKey& key) : path(path), key(key), engine(makeCipher(key)) {}
+    ~InPlaceSession();
+
+    InPlaceSession(const InPlaceSession&) = delete;
+    InPlaceSession& operator=(const InPlaceSession&) = delete;
+
+    bool create(bool encrypt, bool& nothingToDo);
+    bool load();
+    bool recover();
+    bool startRollback();
+    bool run(uint64_t batchElements);
+    bool complete();
+    bool done() const { return header.state == static_cast<uint8_t>(JournalState::DONE); }
+    bool rollingBack() const { return header.phase != static_cast<uint8_t>(JournalPhase::FORWARD); }
+
+private:
+    wstring path;
+    CipherKey key;
+    unique_ptr<Cipher> engine;
+    int fd = -1;
+    int journal = -1;
+    JournalHeader header = {};
+    unsigned char* data = nullptr;
+
+    uint64_t count = 0;            // перестановка: столбцов матрицы
+    uint64_t segment = 0;
+    vector<uint64_t> order;        // пусто - тождественный порядок (Скитала)
+    vector<uint64_t> inverse;
+    vector<uint64_t> visited;      // бит на позицию: цикл пройден
+
+    bool permutation() const { return key.cipher != ContainerCipher::AFFINE; }
+    JournalPhase phase() const { return static_cast<JournalPhase>(header.phase); }
+    bool direction() const { return phase() == JournalPhase::FORWARD ? header.encrypt : !header.encrypt; }
+
+    bool setGeometry(uint64_t length, bool encrypt);
+    uint64_t source(uint64_t p, bool encrypt) const;
+    bool isVisited(uint64_t p) const { return (visited[p >> 6] >> (p & 63)) & 1; }
+    void mark(uint64_t p) { visited[p >> 6] |= uint64_t(1) << (p & 63); }
+    void rebuildVisited();
+    bool walkMove(Cursor& cursor, uint64_t& target, unsigned char& value);
+    bool rewindMove(Cursor& cursor, uint64_t& target, unsigned char& value) const;
+
+    bool ensureSize();
+    bool mapFile();
+    bool writeHeader();
+    bool commitBatch(span<const uint64_t> targets, span<const unsigned char> old);
+    bool finish();
+};
+
+InPlaceSession::~InPlaceSession() {
+    if (data != nullptr) munmap(data, static_cast<size_t>(header.size));
+    if (fd >= 0) ::close(fd);
+    if (journal >= 0) ::close(journal);
+}
+
+bool InPlaceSession::setGeometry(uint64_t length, bool encrypt) {
+    if (!permutation()) {
+        header.size = length;
+        return true;
+    }
+    if (key.cipher == ContainerCipher::TABLE) {
+        order = getColumnOrder(key.word);
+        for (uint64_t& column : order) {
+            column--;
+        }
+        inverse.resize(order.size());
+        for (size_t d = 0; d < order.size(); d++) {
+            inverse[order[d]] = d;
+        }
+        count = static_cast<uint64_t>(order.size());
+    } else {
+        count = key.key;
+    }
+    if (count == 0) {
+        header.size = length;  // пустое ключевое слово: данные не меняются
+        return true;
+    }
+    if (!encrypt && length % count != 0) return false;
+    segment = (length + count - 1) / count;
+    header.size = segment * count;
+    return true;
+}
+
+uint64_t InPlaceSession::source(uint64_t p, bool encrypt) const {
+    if (encrypt) {
+        uint64_t column = p % count;
+        return (order.empty() ? column : inverse[column]) * segment + p / count;
+    }
+    uint64_t d = p / segment;
+    return (p % segment) * count + (order.empty() ? d : order[d]);
+}
+
+// Отметки для положения header.committed без перемещения данных: циклы с
+// лидером < next целиком, у текущего цикла - уже записанные позиции.
+void InPlaceSession::rebuildVisited() {
+    visited.assign(static_cast<size_t>((header.size + 63) / 64), 0);
+    bool encrypt = direction();
+    const Cursor& cursor = header.committed;
+    for (uint64_t leader = 0; leader < cursor.next; leader++) {
+        if (isVisited(leader)) continue;
+        uint64_t p = leader;
+        do {
+            mark(p);
+            p = source(p, encrypt);
+        } while (p != leader);
+    }
+    if (cursor.inCycle) {
+        for (uint64_t p = cursor.next; p != cursor.position; p = source(p, encrypt)) {
+            mark(p);
+        }
+    }
+}
+
+// Следующая запись обхода циклов; false - циклы с лидером < limit пройдены.
+// Данные не меняются: значения берутся из ещё не записанных позиций.
+bool InPlaceSession::walkMove(Cursor& cursor, uint64_t& target, unsigned char& value) {
+    bool encrypt = direction();
+    if (!cursor.inCycle) {
+        while (cursor.next < header.limit && (isVisited(cursor.next) || source(cursor.next, encrypt) == cursor.next)) {
+            cursor.next++;
+        }
+        if (cursor.next >= header.limit) return false;
+        cursor.inCycle = 1;
+        cursor.first = data[cursor.next];
+        cursor.position = cursor.next;
+    }
+    uint64_t from = source(cursor.position, encrypt);
+    mark(cursor.position);
+    target = cursor.position;
+    if (from == cursor.next) {
+        value = cursor.first;
+        cursor.inCycle = 0;
+        cursor.next++;
+    } else {
+        value = data[from];
+        cursor.position = from;
+    }
+    return true;
+}
+
+// Недописанный цикл возвращается от последней записанной позиции к лидеру:
+// в позиции - значение предыдущей по циклу, в лидер - first.
+bool InPlaceSession::rewindMove(Cursor& cursor, uint64_t& target, unsigned char& value) const {
+    if (!cursor.inCycle) return false;
+    target = cursor.position;
+    if (cursor.position == cursor.next) {
+        value = cursor.first;
+        cursor.inCycle = 0;
+    } else {
+        uint64_t from = source(cursor.position, !header.encrypt);
+        value = data[from];
+        cursor.position = from;
+    }
+    return true;
+}
+
+bool InPlaceSession::writeHeader() {
+    header.sequence++;
+    header.checksum = headerChecksum(header);
+    return pwriteAll(journal, &header, sizeof(header), (header.sequence % 2) * JOURNAL_SLOT) && fdatasync(journal) == 0;
+}
+
+bool InPlaceSession::create(bool encrypt, bool& nothingToDo) {
+    fd = ::open(ws2s(path).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return false;
+    uint64_t length = static_cast<uint64_t>(info.st_size);
+    if (!setGeometry(length, encrypt)) return false;
+    nothingToDo = length == 0 || (permutation() && count == 0);
+    if (nothingToDo) return true;
+
+    // Журнал появляется под своим именем уже с целым заголовком
+    string journalName = ws2s(inPlaceJournalPath(path));
+    string temporary = journalName + ".tmp";
+    if (::access(journalName.c_str(), F_OK) == 0) return false;
+    journal = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (journal < 0) return false;
+    header.magic = JOURNAL_MAGIC;
+    header.version = JOURNAL_VERSION;
+    header.cipher = static_cast<uint8_t>(key.cipher);
+    header.encrypt = encrypt;
+    header.state = static_cast<uint8_t>(JournalState::RUNNING);
+    header.phase = static_cast<uint8_t>(JournalPhase::FORWARD);
+    header.keyFingerprint = keyFingerprint(key);
+    header.originalLength = length;
+    header.limit = header.size;
+    // Журнал должен пережить сбой раньше, чем файл изменит длину
+    if (!writeHeader() || ::rename(temporary.c_str(), journalName.c_str()) != 0 || !syncDirectory(path)) return false;
+    return ensureSize() && mapFile();
+}
+
+bool InPlaceSession::load() {
+    fd = ::open(ws2s(path).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    journal = ::open(ws2s(inPlaceJournalPath(path)).c_str(), O_RDWR | O_CLOEXEC);
+    if (journal < 0) return false;
+
+    JournalHeader copies[2];
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        valid[i] = preadAll(journal, &copies[i], sizeof(JournalHeader), i * JOURNAL_SLOT) &&
+                   copies[i].magic == JOURNAL_MAGIC && copies[i].version == JOURNAL_VERSION &&
+                   copies[i].checksum == headerChecksum(copies[i]);
+    }
+    if (!valid[0] && !valid[1]) return false;
+    header = valid[0] && (!valid[1] || copies[0].sequence > copies[1].sequence) ? copies[0] : copies[1];
+    if (header.cipher != static_cast<uint8_t>(key.cipher) || header.keyFingerprint != keyFingerprint(key)) return false;
+
+    uint64_t size = header.size;
+    if (!setGeometry(header.originalLength, header.encrypt) || header.size != size) return false;
+    if (done()) return true;
+    return ensureSize() && mapFile();
+}
+
+// Файл либо уже длины матрицы, либо сбой случился до её установки.
+bool InPlaceSession::ensureSize() {
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    uint64_t length = static_cast<uint64_t>(info.st_size);
+    if (length == header.size) return true;
+    if (length != header.originalLength || length > header.size) return false;
+    return ftruncate(fd, static_cast<off_t>(header.size)) == 0 && fsync(fd) == 0;
+}
+
+bool InPlaceSession::mapFile() {
+    void* mapping = mmap(nullptr, static_cast<size_t>(header.size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) return false;
+    data = static_cast<unsigned char*>(mapping);
+    // Перестановка обращается к файлу вразброс, замена - подряд
+    madvise(data, static_cast<size_t>(header.size), permutation() ? MADV_RANDOM : MADV_SEQUENTIAL);
+    return true;
+}
+
+// Незавершённая порция: прежние значения из журнала. Если записи отката не
+// сошлись с контрольной суммой, порция не успела попасть в файл.
+bool InPlaceSession::recover() {
+    if (header.state != static_cast<uint8_t>(JournalState::BATCH)) return true;
+    uint64_t n = header.batchCount;
+    if (n > header.size) return false;
+
+    vector<uint64_t> targets(permutation() ? static_cast<size_t>(n) : 0);
+    vector<unsigned char> old(static_cast<size_t>(n));
+    size_t targetBytes = targets.size() * sizeof(uint64_t);
+    if (!preadAll(journal, targets.data(), targetBytes, JOURNAL_UNDO) ||
+        !preadAll(journal, old.data(), old.size(), JOURNAL_UNDO + targetBytes)) return false;
+    uint32_t crc = cipherKernels().crc32c(0, reinterpret_cast<const unsigned char*>(targets.data()), targetBytes);
+    crc = cipherKernels().crc32c(crc, old.data(), old.size());
+
+    if (crc == header.batchChecksum) {
+        if (permutation()) {
+            for (size_t i = 0; i < old.size(); i++) {
+                if (targets[i] >= header.size) return false;
+                data[targets[i]] = old[i];
+            }
+        } else {
+            if (header.batchOffset > header.size || n > header.size - header.batchOffset) return false;
+            copy(old.begin(), old.end(), data + header.batchOffset);
+        }
+        if (msync(data, static_cast<size_t>(header.size), MS_SYNC) != 0) return false;
+    }
+    header.state = static_cast<uint8_t>(JournalState::RUNNING);
+    return writeHeader();
+}
+
+bool InPlaceSession::startRollback() {
+    if (phase() != JournalPhase::FORWARD) return true;  // откат уже идёт
+    Cursor& cursor = header.committed;
+    if (permutation() && cursor.inCycle) {
+        // Последняя записанная позиция цикла - предыдущая перед position
+        header.phase = static_cast<uint8_t>(JournalPhase::REWIND);
+        cursor.position = source(cursor.position, !header.encrypt);
+    } else {
+        header.phase = static_cast<uint8_t>(JournalPhase::ROLLBACK);
+        header.limit = cursor.next;
+        cursor = Cursor{};
+    }
+    return writeHeader();
+}
+
+// Записи отката - в журнал, затем новые значения - в файл, затем отметка
+// о завершении порции.
+bool InPlaceSession::commitBatch(span<const uint64_t> targets, span<const unsigned char> old) {
+    size_t targetBytes = targets.size() * sizeof(uint64_t);
+    uint32_t crc = cipherKernels().crc32c(0, reinterpret_cast<const unsigned char*>(targets.data()), targetBytes);
+    header.batchChecksum = cipherKernels().crc32c(crc, old.data(), old.size());
+    header.batchOffset = header.committed.next;
+    header.batchCount = old.size();
+    header.state = static_cast<uint8_t>(JournalState::BATCH);
+    return pwriteAll(journal, targets.data(), targetBytes, JOURNAL_UNDO) &&
+           pwriteAll(journal, old.data(), old.size(), JOURNAL_UNDO + targetBytes) && writeHeader();
+}
+
+bool InPlaceSession::run(uint64_t batchElements) {
+    batchElements = max<uint64_t>(batchElements, 1);
+    if (permutation() && phase() != JournalPhase::REWIND) rebuildVisited();
+
+    vector<uint64_t> targets;
+    vector<unsigned char> values;
+    vector<unsigned char> old;
+    while (!done()) {
+        Cursor cursor = header.committed;
+        if (phase() == JournalPhase::REWIND && !cursor.inCycle) {
+            // Цикл возвращён, дальше - пройденные до него циклы
+            header.phase = static_cast<uint8_t>(JournalPhase::ROLLBACK);
+            header.limit = cursor.next;
+            header.committed = Cursor{};
+            if (!writeHeader()) return false;
+            rebuildVisited();
+            continue;
+        }
+
+        if (permutation()) {
+            targets.clear();
+            values.clear();
+            old.clear();
+            uint64_t target;
+            unsigned char value;
+            while (targets.size() < batchElements &&
+                   (phase() == JournalPhase::REWIND ? rewindMove(cursor, target, value) : walkMove(cursor, target, value))) {
+                targets.push_back(target);
+                values.push_back(value);
+                old.push_back(data[target]);
+            }
+            if (targets.empty()) return finish();
+            if (!commitBatch(targets, old)) return false;
+            for (size_t i = 0; i < targets.size(); i++) {
+                data[targets[i]] = values[i];
+            }
+        } else {
+            uint64_t n = min(batchElements, header.limit - cursor.next);
+            if (n == 0) return finish();
+            span<unsigned char> range(data + cursor.next, static_cast<size_t>(n));
+            old.assign(range.begin(), range.end());
+            if (!commitBatch({}, old)) return false;
+            engine->transformInPlace(range, range.size(), direction());
+            cursor.next += n;
+        }
+
+        if (msync(data, static_cast<size_t>(header.size), MS_SYNC) != 0) return false;
+        header.committed = cursor;
+        header.state = static_cast<uint8_t>(JournalState::RUNNING);
+        if (!writeHeader()) return false;
+    }
+    return true;
+}
+
+bool InPlaceSession::finish() {
+    uint64_t length = header.size;
+    if (phase() != JournalPhase::FORWARD) {
+        length = header.originalLength;
+    } else if (key.cipher == ContainerCipher::TABLE && !header.encrypt) {
+        while (length > 0 && data[length - 1] == 0) {
+            length--;
+        }
+    }
+    header.finalLength = length;
+    header.state = static_cast<uint8_t>(JournalState::DONE);
+    return writeHeader();
+}
+
+// После DONE: длина файла и удаление журнала; повторять безопасно.
+bool InPlaceSession::complete() {
+    if (data != nullptr) {
+        munmap(data, static_cast<size_t>(header.size));
+        data = nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    if (static_cast<uint64_t>(info.st_size) != header.finalLength &&
+        ftruncate(fd, static_cast<off_t>(header.finalLength)) != 0) return false;
+    if (fsync(fd) != 0) return false;
+    return ::unlink(ws2s(inPlaceJournalPath(path)).c_str()) == 0 && syncDirectory(path);
+}
+
+}
+
+wstring inPlaceJournalPath(const wstring& path) {
+    return path + L".rgrj";
+}
+
+bool inPlaceJournalExists(const wstring& path) {
+    return ::access(ws2s(inPlaceJournalPath(path)).c_str(), F_OK) == 0;
+}
+
+bool transformFileInPlace(const wstring& path, const CipherKey& key, bool encrypt, uint64_t batchElements) {
+    OperationMetrics metrics("inplace.file");
+    InPlaceSession session(path, key);
+    bool nothingToDo = false;
+    if (!session.create(encrypt, nothingToDo)) return false;
+    if (nothingToDo) return true;
+    StageTimer timer(encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT);
+    return session.run(batchElements) && session.complete();
+}
+
+bool resumeFileInPlace(const wstring& path, const CipherKey& key, uint64_t batchElements) {
+    OperationMetrics metrics("inplace.resume");
+    InPlaceSession session(path, key);
+    if (!session.load()) return false;
+    if (session.done()) return session.complete();
+    return session.recover() && session.run(batchElements) && session.complete();
+}
+
+bool rollbackFileInPlace(const wstring& path, const CipherKey& key, uint64_t batchElements) {
+    OperationMetrics metrics("inplace.rollback");
+    InPlaceSession session(path, key);
+    if (!session.load()) return false;
+    if (session.done()) return session.rollingBack() && session.complete();
+    return session.recover() && session.startRollback() && session.run(batchElements) && session.complete();
+}
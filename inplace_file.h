@@ -0,0 +1,52 @@
+#ifndef INPLACE_FILE_H
+#define INPLACE_FILE_H
+
+#include "container.h"
+#include <string>
+#include <cstdint>
+
+// Шифрование двоичного файла на месте: файл отображается в память
+// (MAP_SHARED) и преобразуется там же, без второй копии на диске и в памяти.
+// Аффинный шифр - побайтовая замена по участкам файла; Скитала и табличный
+// шифр - перестановка циклами с лидером (наименьший индекс цикла): элемент
+// переносится по циклу на своё место, дополнительно нужен только бит
+// «пройден» на байт файла.
+//
+// Ход работы записывается в журнал рядом с файлом (inPlaceJournalPath).
+// Перестановка делится на порции по batchElements записей: до изменения
+// файла в журнал пишутся позиции и прежние значения порции, после msync
+// порция отмечается завершённой. Длинный цикл может растянуться на несколько
+// порций, поэтому журнал не больше ~9 * batchElements байт при любом файле.
+// Если процесс прервался, resumeFileInPlace откатывает незавершённую порцию
+// и продолжает, rollbackFileInPlace возвращает файл в исходный вид.
+//
+// При шифровании Скиталой и таблицей файл сначала дополняется нулями до
+// полной матрицы, при расшифровании таблицей нули в конце отбрасываются, как
+// в encryptTableBinary/decryptTableBinary. Расшифровать на месте можно
+// только файл, длина которого кратна длине ключа.
+
+const uint64_t INPLACE_DEFAULT_BATCH = 1 << 20;
+
+// Путь журнала для файла path.
+std::wstring inPlaceJournalPath(const std::wstring& path);
+
+// Есть ли незавершённая операция над файлом.
+bool inPlaceJournalExists(const std::wstring& path);
+
+// false при ошибке ввода-вывода, неподходящей длине или если у файла уже
+// есть журнал (тогда resume или rollback); invalid_argument для
+// недопустимого ключа, как у makeCipher.
+bool transformFileInPlace(const std::wstring& path, const CipherKey& key, bool encrypt,
+                          uint64_t batchElements = INPLACE_DEFAULT_BATCH);
+
+// Завершение прерванной операции; false, если журнала нет, он повреждён или
+// записан для другого ключа.
+bool resumeFileInPlace(const std::wstring& path, const CipherKey& key,
+                       uint64_t batchElements = INPLACE_DEFAULT_BATCH);
+
+// Возврат файла к состоянию до прерванной операции; false также, если
+// операция уже дошла до окончательной длины файла (тогда только resume).
+bool rollbackFileInPlace(const std::wstring& path, const CipherKey& key,
+                         uint64_t batchElements = INPLACE_DEFAULT_BATCH);
+
+#endif
@@ -0,0 +1,175 @@
+#include "large_buffer.h"
+#include "parallel.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const size_t HUGE_PAGE = 2 << 20;
+const size_t SMALL_PAGE = 4096;
+
+size_t roundUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Узлы из /sys/devices/system/node/online ("0", "0-1", "0,2-3") битовой маской.
+vector<unsigned long> onlineNodes() {
+    vector<unsigned long> mask;
+    ifstream file("/sys/devices/system/node/online");
+    string list;
+    if (!(file >> list)) return mask;
+
+    const size_t bits = sizeof(unsigned long) * 8;
+    size_t position = 0;
+    while (position < list.size()) {
+        char* end;
+        unsigned long first = strtoul(list.c_str() + position, &end, 10);
+        unsigned long last = first;
+        if (*end == '-') last = strtoul(end + 1, &end, 10);
+        if (last >= 4096) break;
+        for (unsigned long node = first; node <= last; node++) {
+            if (mask.size() <= node / bits) mask.resize(node / bits + 1, 0);
+            mask[node / bits] |= 1ul << (node % bits);
+        }
+        position = static_cast<size_t>(end - list.c_str());
+        if (position < list.size() && list[position] == ',') position++;
+        else break;
+    }
+    return mask;
+}
+
+void interleaveNodes(void* address, size_t size) {
+#ifdef SYS_mbind
+    static const vector<unsigned long> mask = onlineNodes();
+    size_t nodes = 0;
+    for (unsigned long word : mask) nodes += static_cast<size_t>(__builtin_popcountl(word));
+    if (nodes < 2) return;
+
+    const long MPOL_INTERLEAVE_MODE = 3;  // MPOL_INTERLEAVE из <linux/mempolicy.h>
+    syscall(SYS_mbind, address, size, MPOL_INTERLEAVE_MODE, mask.data(),
+            static_cast<unsigned long>(mask.size() * sizeof(unsigned long) * 8 + 1), 0ul);
+#else
+    (void)address;
+    (void)size;
+#endif
+}
+
+// Первое обращение к страницам полосами по потокам parallelFor.
+void touchPages(unsigned char* data, size_t size) {
+    const size_t band = 64 * HUGE_PAGE;
+    parallelFor((size + band - 1) / band, 0, [&](uint64_t i) {
+        size_t end = min(size, static_cast<size_t>((i + 1) * band));
+        for (size_t offset = static_cast<size_t>(i * band); offset < end; offset += SMALL_PAGE) {
+            data[offset] = 0;
+        }
+        return true;
+    });
+}
+
+}
+
+BufferPolicy defaultBufferPolicy() {
+    static const BufferPolicy policy = []() {
+        BufferPolicy result;
+        if (const char* value = getenv("RGR_HUGEPAGES")) {
+            string name = value;
+            if (name == "thp" || name == "transparent") result.pages = HugePages::TRANSPARENT;
+            else if (name == "explicit" || name == "hugetlb") result.pages = HugePages::EXPLICIT;
+        }
+        if (const char* value = getenv("RGR_NUMA")) {
+            string name = value;
+            if (name == "first-touch") result.numa = NumaPlacement::FIRST_TOUCH;
+            else if (name == "interleave") result.numa = NumaPlacement::INTERLEAVE;
+        }
+        return result;
+    }();
+    return policy;
+}
+
+LargeBuffer::LargeBuffer(size_t size, const BufferPolicy& policy) {
+    if (size == 0) return;
+
+    if (policy.pages == HugePages::EXPLICIT) {
+        size_t rounded = roundUp(size, HUGE_PAGE);
+        void* address = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (address != MAP_FAILED) {
+            mapping = address;
+            mappingSize = rounded;
+            begin = static_cast<unsigned char*>(address);
+            hugetlb = true;
+        }
+    }
+
+    if (!mapping && policy.pages != HugePages::NONE) {
+        // Прозрачные огромные страницы выделяются только в выровненных на 2 МБ участках
+        size_t rounded = roundUp(size, HUGE_PAGE);
+        void* address = mmap(nullptr, rounded + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) throw bad_alloc();
+        uintptr_t start = reinterpret_cast<uintptr_t>(address);
+        uintptr_t aligned = roundUp(start, HUGE_PAGE);
+        if (aligned > start) munmap(address, aligned - start);
+        munmap(reinterpret_cast<void*>(aligned + rounded), start + HUGE_PAGE - aligned);
+        mapping = reinterpret_cast<void*>(aligned);
+        mappingSize = rounded;
+        begin = static_cast<unsigned char*>(mapping);
+#ifdef MADV_HUGEPAGE
+        madvise(mapping, mappingSize, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (!mapping) {
+        size_t rounded = roundUp(size, SMALL_PAGE);
+        void* address = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) throw bad_alloc();
+        mapping = address;
+        mappingSize = rounded;
+        begin = static_cast<unsigned char*>(address);
+    }
+    length = size;
+
+    // Политика NUMA действует только на ещё не тронутые страницы
+    if (policy.numa == NumaPlacement::INTERLEAVE) {
+        interleaveNodes(mapping, mappingSize);
+    } else if (policy.numa == NumaPlacement::FIRST_TOUCH) {
+        touchPages(begin, mappingSize);
+    }
+}
+
+LargeBuffer::~LargeBuffer() {
+    release();
+}
+
+LargeBuffer::LargeBuffer(LargeBuffer&& other) noexcept
+    : mapping(exchange(other.mapping, nullptr)), mappingSize(exchange(other.mappingSize, 0)),
+      begin(exchange(other.begin, nullptr)), length(exchange(other.length, 0)), hugetlb(exchange(other.hugetlb, false)) {}
+
+LargeBuffer& LargeBuffer::operator=(LargeBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        mapping = exchange(other.mapping, nullptr);
+        mappingSize = exchange(other.mappingSize, 0);
+        begin = exchange(other.begin, nullptr);
+        length = exchange(other.length, 0);
+        hugetlb = exchange(other.hugetlb, false);
+    }
+    return *this;
+}
+
+void LargeBuffer::release() {
+    if (mapping) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    begin = nullptr;
+    length = 0;
+    hugetlb = false;
+}
@@ -0,0 +1,72 @@
+#ifndef LARGE_BUFFER_H
+#define LARGE_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Буферы для файлов в несколько гигабайт. Перестановки Скиталы и таблицы
+// обращаются к памяти с большим шагом, и на страницах по 4 КБ почти каждое
+// обращение - промах TLB; на многопроцессорных узлах, кроме того, важно, на
+// каком узле NUMA лежат страницы относительно потоков, которые их обрабатывают.
+
+enum class HugePages {
+    NONE,
+    TRANSPARENT,  // madvise(MADV_HUGEPAGE), страницы по 2 МБ, если ядро разрешает
+    EXPLICIT      // MAP_HUGETLB из заранее выделенного пула; без пула - как TRANSPARENT
+};
+
+enum class NumaPlacement {
+    DEFAULT,      // страница - на узле потока, первым к ней обратившегося
+    FIRST_TOUCH,  // страницы заранее размещаются потоками parallelFor полосами
+                  // по порядку адресов - так же, как делят работу перестановки
+    INTERLEAVE    // страницы поочерёдно на всех узлах (mbind, MPOL_INTERLEAVE)
+};
+
+struct BufferPolicy {
+    HugePages pages = HugePages::NONE;
+    NumaPlacement numa = NumaPlacement::DEFAULT;
+};
+
+// Из RGR_HUGEPAGES=none|thp|explicit и RGR_NUMA=default|first-touch|interleave.
+BufferPolicy defaultBufferPolicy();
+
+// Анонимное отображение памяти с заданным размещением. Содержимое после
+// создания - нули. Исключение bad_alloc, если память не выделена; недоступные
+// огромные страницы и NUMA (один узел, старое ядро) молча не используются.
+class LargeBuffer {
+public:
+    LargeBuffer() = default;
+    explicit LargeBuffer(size_t size, const BufferPolicy& policy = defaultBufferPolicy());
+    ~LargeBuffer();
+
+    LargeBuffer(LargeBuffer&& other) noexcept;
+    LargeBuffer& operator=(LargeBuffer&& other) noexcept;
+    LargeBuffer(const LargeBuffer&) = delete;
+    LargeBuffer& operator=(const LargeBuffer&) = delete;
+
+    unsigned char* data() { return begin; }
+    const unsigned char* data() const { return begin; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    std::span<unsigned char> bytes() { return { begin, length }; }
+    std::span<const unsigned char> bytes() const { return { begin, length }; }
+
+    // Уменьшает видимый размер (например, до числа байт результата шифра).
+    void shrink(size_t size) { if (size < length) length = size; }
+
+    // Получены ли страницы из пула MAP_HUGETLB.
+    bool explicitHugePages() const { return hugetlb; }
+
+private:
+    void release();
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    unsigned char* begin = nullptr;
+    size_t length = 0;
+    bool hugetlb = false;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "lz.h"
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const unsigned HASH_BITS = 14;
+
+uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash4(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+unsigned char* writeLength(unsigned char* op, size_t length) {
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<unsigned char>(length);
+    return op;
+}
+
+// Последовательность: literalLength литералов с literals, затем совпадение
+// (matchLength == 0 - последняя последовательность без совпадения).
+unsigned char* writeSequence(unsigned char* op, const unsigned char* literals, size_t literalLength,
+                             size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    unsigned char* token = op++;
+    *token = static_cast<unsigned char>((min<size_t>(literalLength, 15) << 4) | min<size_t>(matchCode, 15));
+    if (literalLength >= 15) op = writeLength(op, literalLength - 15);
+    if (literalLength > 0) memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (matchLength == 0) return op;
+
+    *op++ = static_cast<unsigned char>(offset);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    if (matchCode >= 15) op = writeLength(op, matchCode - 15);
+    return op;
+}
+
+// Продолжение длины; false, если вход кончился.
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (ip == end) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+size_t lzCompressBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+size_t lzCompress(span<const unsigned char> in, span<unsigned char> out) {
+    const unsigned char* base = in.data();
+    const size_t length = in.size();
+    unsigned char* op = out.data();
+    size_t anchor = 0;
+
+    if (length > MIN_MATCH) {
+        ArenaScope scope;
+        span<uint32_t> table = scope.allocate<uint32_t>(size_t(1) << HASH_BITS);
+        fill(table.begin(), table.end(), 0);
+
+        const size_t limit = length - MIN_MATCH;
+        size_t i = 1;
+        while (i <= limit) {
+            uint32_t value = read32(base + i);
+            uint32_t h = hash4(value);
+            size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(i);
+
+            if (i - candidate > MAX_OFFSET || read32(base + candidate) != value) {
+                // На несжимаемых участках шаг растёт, чтобы не тратить время впустую
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            size_t match = MIN_MATCH;
+            while (i + match < length && base[candidate + match] == base[i + match]) {
+                match++;
+            }
+            while (i > anchor && candidate > 0 && base[i - 1] == base[candidate - 1]) {
+                i--;
+                candidate--;
+                match++;
+            }
+
+            op = writeSequence(op, base + anchor, i - anchor, i - candidate, match);
+            i += match;
+            anchor = i;
+            if (i - 2 <= limit) {
+                table[hash4(read32(base + i - 2))] = static_cast<uint32_t>(i - 2);
+            }
+        }
+    }
+
+    op = writeSequence(op, base + anchor, length - anchor, 0, 0);
+    return static_cast<size_t>(op - out.data());
+}
+
+bool lzDecompress(span<const unsigned char> in, span<unsigned char> out) {
+    const unsigned char* ip = in.data();
+    const unsigned char* end = ip + in.size();
+    unsigned char* op = out.data();
+    unsigned char* const outEnd = op + out.size();
+
+    while (ip < end) {
+        unsigned char token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength)) return false;
+        if (literalLength > static_cast<size_t>(end - ip) || literalLength > static_cast<size_t>(outEnd - op)) return false;
+        if (literalLength > 0) memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == end) break;
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (size_t(ip[1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength)) return false;
+        matchLength += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(op - out.data()) ||
+            matchLength > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        const unsigned char* source = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, source, matchLength);
+            op += matchLength;
+        } else {
+            // Перекрытие: совпадение повторяет только что записанные байты
+            for (size_t k = 0; k < matchLength; k++) {
+                *op++ = source[k];
+            }
+        }
+    }
+    return op == outEnd;
+}
@@ -0,0 +1,25 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <span>
+
+// Быстрое сжатие семейства LZ77 для данных перед шифрованием. Поток - серия
+// последовательностей: байт-метка (старшие 4 бита - число литералов, младшие -
+// длина совпадения минус 4; значение 15 продолжается байтами по 255), литералы,
+// смещение совпадения (2 байта, little-endian, до 65535) и продолжение длины.
+// Последняя последовательность содержит только литералы. Без энтропийного
+// кодирования: степень сжатия ниже, чем у deflate, зато скорость сопоставима
+// со скоростью самих шифров.
+
+// Наибольший размер сжатых данных для входа длины length.
+size_t lzCompressBound(size_t length);
+
+// out - не меньше lzCompressBound(in.size()) байт. Возвращает размер сжатых данных.
+size_t lzCompress(std::span<const unsigned char> in, std::span<unsigned char> out);
+
+// Распаковывает ровно out.size() байт; false, если данные повреждены
+// или распаковываются в другой размер.
+bool lzDecompress(std::span<const unsigned char> in, std::span<unsigned char> out);
+
+#endif
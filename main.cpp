@@ -1,9 +1,13 @@
 #include <iostream>
 #include <string>
 #include <locale>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include "skytale.h"
 #include "affine.h"
 #include "table.h"
+#include "server.h"
 
 using namespace std;
 
@@ -32,7 +36,7 @@ void displayMenu() {
     wcout << L"Введите номер выбранного шифра: ";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     locale::global(locale(""));
     wcin.imbue(locale());
     wcout.imbue(locale());
@@ -46,6 +50,25 @@ int main() {
         wcout << L"Неверный пароль!" << endl;
         return -1;
     }
+
+    // rgr --serve <сокет> [потоков] - резидентный режим вместо меню
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+        unsigned long workers = 0;
+        bool valid = argc == 3 || argc == 4;
+        if (valid && argc == 4) {
+            char* end = nullptr;
+            errno = 0;
+            workers = strtoul(argv[3], &end, 10);
+            valid = isdigit(static_cast<unsigned char>(argv[3][0])) && *end == '\0' && errno == 0 &&
+                    workers <= SERVER_MAX_WORKERS;
+        }
+        if (!valid) {
+            wcerr << L"Использование: rgr --serve <сокет> [число потоков от 0 до " << SERVER_MAX_WORKERS
+                  << L", 0 - по числу ядер]" << endl;
+            return 1;
+        }
+        return runServer(argv[2], static_cast<unsigned>(workers));
+    }
     wcout << endl;
     displayMenu();
     wstring number;
@@ -0,0 +1,350 @@
+#include "metrics.h"
+#include "probes.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char* STAGE_NAMES[] = { "read", "decode", "encrypt", "decrypt", "encode", "write" };
+
+struct StageTotals {
+    double seconds = 0;
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated = 0;
+};
+
+}
+
+// Замеры операции пишутся из всех потоков, которые её выполняют: время стадий
+// под мьютексом, выделения - атомарными счётчиками (на каждое выделение).
+struct OperationRecord {
+    string name;
+    chrono::steady_clock::time_point start;
+    PeakRss peak;
+    mutex stagesMutex;
+    StageTotals stages[static_cast<int>(MetricStage::COUNT)];
+    atomic<uint64_t> allocations{ 0 };
+    atomic<uint64_t> allocated{ 0 };
+    atomic<uint64_t> stageAllocations[static_cast<int>(MetricStage::COUNT)] = {};
+    atomic<uint64_t> stageAllocated[static_cast<int>(MetricStage::COUNT)] = {};
+};
+
+namespace {
+
+struct Aggregate {
+    uint64_t operations = 0;
+    double seconds = 0;
+    StageTotals stages[static_cast<int>(MetricStage::COUNT)];
+};
+
+thread_local OperationRecord* currentOperation = nullptr;
+thread_local unsigned currentStages = 0;
+
+mutex statsMutex;
+map<string, Aggregate> statistics;
+
+const char* metricsTarget() {
+    static const char* target = getenv("RGR_METRICS");
+    return target;
+}
+
+const char* statsTarget() {
+    static const char* target = getenv("RGR_METRICS_STATS");
+    return target;
+}
+
+#if defined(RGR_COUNT_ALLOCATIONS) && !defined(RGR_LIBRARY)
+const bool COUNT_ALLOCATIONS = true;
+#else
+const bool COUNT_ALLOCATIONS = false;  // без подсчёта поля выделений в сводку не попадают
+#endif
+
+// Поле "VmRSS:" или "VmHWM:" из /proc/self/status в КБ; -1, если его нет.
+long statusKb(const char* field) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) return -1;
+    char line[256];
+    long value = -1;
+    size_t length = strlen(field);
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, field, length) == 0) {
+            value = strtol(line + length, nullptr, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return value;
+}
+
+void appendStage(string& out, const char* name, const StageTotals& stage) {
+    char buffer[320];
+    double rate = stage.seconds > 0 ? static_cast<double>(stage.bytes) / stage.seconds : 0;
+    snprintf(buffer, sizeof(buffer),
+             "\"%s\":{\"calls\":%llu,\"seconds\":%.6f,\"bytes\":%llu,\"bytes_per_second\":%.1f",
+             name, static_cast<unsigned long long>(stage.calls), stage.seconds,
+             static_cast<unsigned long long>(stage.bytes), rate);
+    out += buffer;
+    if (COUNT_ALLOCATIONS) {
+        snprintf(buffer, sizeof(buffer), ",\"allocations\":%llu,\"allocated_bytes\":%llu",
+                 static_cast<unsigned long long>(stage.allocations),
+                 static_cast<unsigned long long>(stage.allocated));
+        out += buffer;
+    }
+    out += '}';
+}
+
+string stagesJson(const StageTotals* stages) {
+    string out = "{";
+    bool first = true;
+    for (int i = 0; i < static_cast<int>(MetricStage::COUNT); i++) {
+        if (stages[i].calls == 0) continue;
+        if (!first) out += ',';
+        appendStage(out, STAGE_NAMES[i], stages[i]);
+        first = false;
+    }
+    return out + "}";
+}
+
+void emitOperation(const OperationRecord& record, double seconds, uint64_t allocations, uint64_t allocated) {
+    char header[256];
+    snprintf(header, sizeof(header), "{\"operation\":\"%s\",\"seconds\":%.6f,", record.name.c_str(), seconds);
+    string line = header;
+    if (COUNT_ALLOCATIONS) {
+        snprintf(header, sizeof(header), "\"allocations\":%llu,\"allocated_bytes\":%llu,",
+                 static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(allocated));
+        line += header;
+    }
+    long peak = record.peak.deltaKb();
+    if (peak >= 0) {
+        snprintf(header, sizeof(header), "\"peak_rss_delta_kb\":%ld,\"stages\":", peak);
+    } else {
+        snprintf(header, sizeof(header), "\"peak_rss_delta_kb\":null,\"stages\":");
+    }
+    line += header + stagesJson(record.stages) + "}\n";
+
+    const char* target = metricsTarget();
+    if (target && strcmp(target, "stderr") != 0 && strcmp(target, "1") != 0) {
+        ofstream file(target, ios::app);
+        file << line;
+    } else if (target) {
+        // Напрямую в дескриптор: stderr уже занят широкими потоками wcerr
+        ssize_t written = write(STDERR_FILENO, line.data(), line.size());
+        (void)written;
+    }
+}
+
+void updateStatistics(const OperationRecord& record, double seconds) {
+    const char* target = statsTarget();
+    if (!target) return;
+
+    lock_guard<mutex> lock(statsMutex);
+    Aggregate& aggregate = statistics[record.name];
+    aggregate.operations++;
+    aggregate.seconds += seconds;
+    for (int i = 0; i < static_cast<int>(MetricStage::COUNT); i++) {
+        aggregate.stages[i].seconds += record.stages[i].seconds;
+        aggregate.stages[i].calls += record.stages[i].calls;
+        aggregate.stages[i].bytes += record.stages[i].bytes;
+        aggregate.stages[i].allocations += record.stages[i].allocations;
+        aggregate.stages[i].allocated += record.stages[i].allocated;
+    }
+
+    string json = "{";
+    bool first = true;
+    for (const auto& entry : statistics) {
+        char header[192];
+        snprintf(header, sizeof(header), "%s\"%s\":{\"operations\":%llu,\"seconds\":%.6f,\"stages\":",
+                 first ? "" : ",", entry.first.c_str(),
+                 static_cast<unsigned long long>(entry.second.operations), entry.second.seconds);
+        json += header + stagesJson(entry.second.stages) + "}";
+        first = false;
+    }
+    json += "}\n";
+
+    string temporary = string(target) + ".tmp";
+    {
+        ofstream file(temporary, ios::trunc);
+        file << json;
+    }
+    rename(temporary.c_str(), target);
+}
+
+}
+
+// Подсчёт выделений памяти - только в сборке с -DRGR_COUNT_ALLOCATIONS: замена
+// operator new действует на всю программу (и мешает ASan и другим
+// распределителям), поэтому включается явно. Заменяется весь набор - с
+// массивами, выравниванием и nothrow - вместе с парными operator delete, чтобы
+// любое выделение освобождалось тем же распределителем. Счётчики потока
+// увеличиваются только внутри активной операции. В librgr.so (RGR_LIBRARY)
+// operator new не заменяется никогда - он подменил бы распределитель
+// программы-хозяина.
+#if defined(RGR_COUNT_ALLOCATIONS) && !defined(RGR_LIBRARY)
+namespace {
+
+void* countedAllocate(size_t size, size_t alignment) {
+    if (OperationRecord* record = currentOperation) {
+        record->allocations.fetch_add(1, memory_order_relaxed);
+        record->allocated.fetch_add(size, memory_order_relaxed);
+        for (unsigned stages = currentStages; stages != 0; stages &= stages - 1) {
+            int stage = __builtin_ctz(stages);
+            record->stageAllocations[stage].fetch_add(1, memory_order_relaxed);
+            record->stageAllocated[stage].fetch_add(size, memory_order_relaxed);
+        }
+    }
+    if (size == 0) size = 1;
+    while (true) {
+        void* pointer = nullptr;
+        if (alignment <= alignof(max_align_t)) {
+            pointer = malloc(size);
+        } else if (posix_memalign(&pointer, alignment, size) != 0) {
+            pointer = nullptr;
+        }
+        if (pointer) return pointer;
+        new_handler handler = get_new_handler();
+        if (!handler) throw bad_alloc();
+        handler();
+    }
+}
+
+void* countedAllocateNothrow(size_t size, size_t alignment) noexcept {
+    try {
+        return countedAllocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+}
+
+void* operator new(size_t size) { return countedAllocate(size, 0); }
+void* operator new[](size_t size) { return countedAllocate(size, 0); }
+void* operator new(size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAllocateNothrow(size, 0); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAllocateNothrow(size, 0); }
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAllocateNothrow(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAllocateNothrow(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const nothrow_t&) noexcept { free(pointer); }
+void operator delete(void* pointer, align_val_t, const nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, align_val_t, const nothrow_t&) noexcept { free(pointer); }
+#endif
+
+bool metricsEnabled() {
+    static const bool enabled = metricsTarget() != nullptr || statsTarget() != nullptr;
+    return enabled;
+}
+
+void PeakRss::reset() {
+    baseline = -1;
+    FILE* clear = fopen("/proc/self/clear_refs", "w");
+    if (!clear) return;
+    bool cleared = fputs("5", clear) >= 0;
+    if (fclose(clear) == 0 && cleared) baseline = statusKb("VmRSS:");
+}
+
+long PeakRss::deltaKb() const {
+    long peak = statusKb("VmHWM:");
+    if (baseline < 0 || peak < 0) return -1;
+    return max(0L, peak - baseline);
+}
+
+MetricsContext currentMetricsContext() {
+    return MetricsContext{ currentOperation, currentStages };
+}
+
+MetricsContextScope::MetricsContextScope(const MetricsContext& context) : outer(currentMetricsContext()) {
+    currentOperation = context.operation;
+    currentStages = context.stages;
+}
+
+MetricsContextScope::~MetricsContextScope() {
+    currentOperation = outer.operation;
+    currentStages = outer.stages;
+}
+
+OperationMetrics::OperationMetrics(const char* name) : name(name), active(metricsEnabled() && currentOperation == nullptr) {
+    RGR_PROBE(operation__begin, name);
+    if (!active) return;
+
+    OperationRecord* record = new OperationRecord;
+    record->name = name;
+    record->peak.reset();
+    record->start = chrono::steady_clock::now();
+    currentOperation = record;
+    currentStages = 0;
+}
+
+// Рабочие потоки parallelFor к этому моменту завершены: их стадии и
+// выделения уже в записи.
+OperationMetrics::~OperationMetrics() {
+    RGR_PROBE(operation__end, name);
+    if (!active) return;
+
+    OperationRecord* record = currentOperation;
+    currentOperation = nullptr;
+    currentStages = 0;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - record->start).count();
+    for (int i = 0; i < static_cast<int>(MetricStage::COUNT); i++) {
+        record->stages[i].allocations = record->stageAllocations[i].load(memory_order_relaxed);
+        record->stages[i].allocated = record->stageAllocated[i].load(memory_order_relaxed);
+    }
+
+    emitOperation(*record, seconds, record->allocations.load(memory_order_relaxed),
+                  record->allocated.load(memory_order_relaxed));
+    updateStatistics(*record, seconds);
+    delete record;
+}
+
+StageTimer::StageTimer(MetricStage stage, uint64_t bytes)
+    : stage(stage), bytes(bytes), active(currentOperation != nullptr), outerStages(currentStages) {
+    RGR_PROBE(stage__begin, static_cast<int>(stage), bytes);
+    if (!active) return;
+    currentStages |= 1u << static_cast<int>(stage);
+    start = chrono::steady_clock::now();
+}
+
+// Стадии из нескольких потоков складываются: время - суммарное по потокам.
+StageTimer::~StageTimer() {
+    RGR_PROBE(stage__end, static_cast<int>(stage), bytes);
+    if (!active) return;
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    currentStages = outerStages;
+    lock_guard<mutex> lock(currentOperation->stagesMutex);
+    StageTotals& totals = currentOperation->stages[static_cast<int>(stage)];
+    totals.seconds += seconds;
+    totals.calls++;
+    totals.bytes += bytes;
+}
+
+void StageTimer::setBytes(uint64_t value) {
+    bytes = value;
+}
@@ -0,0 +1,96 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <chrono>
+
+// Замеры стадий работы с файлами. Включаются переменными окружения:
+//   RGR_METRICS=stderr | <файл>  - JSON-сводка по каждой операции (в файл - дописывается);
+//   RGR_METRICS_STATS=<файл>     - накопительная статистика по всем операциям,
+//                                  перезаписывается после каждой операции.
+// Без них таймеры сводятся к проверке одного флага. Начало и конец операций
+// и стадий также отмечаются точками трассировки (probes.h). Стадии и выделения
+// памяти в потоках parallelFor относятся к операции вызвавшего потока.
+
+enum class MetricStage {
+    READ,
+    DECODE,
+    ENCRYPT,
+    DECRYPT,
+    ENCODE,
+    WRITE,
+    COUNT
+};
+
+bool metricsEnabled();
+
+// Насколько пик памяти процесса поднялся с момента reset(). ru_maxrss - пик за
+// всю жизнь процесса, поэтому reset() записью "5" в /proc/self/clear_refs
+// сбрасывает пик (VmHWM) до текущего RSS. Пик один на процесс: замеры,
+// идущие одновременно в разных потоках, сбрасывают его друг другу.
+class PeakRss {
+public:
+    void reset();
+    long deltaKb() const;  // -1, если сбросить пик не удалось
+
+private:
+    long baseline = -1;
+};
+
+struct OperationRecord;
+
+// Операция и стадии, к которым поток относит свои замеры. parallelFor
+// переносит их в рабочие потоки.
+struct MetricsContext {
+    OperationRecord* operation = nullptr;
+    unsigned stages = 0;  // биты активных MetricStage
+};
+
+MetricsContext currentMetricsContext();
+
+class MetricsContextScope {
+public:
+    explicit MetricsContextScope(const MetricsContext& context);
+    ~MetricsContextScope();
+
+    MetricsContextScope(const MetricsContextScope&) = delete;
+    MetricsContextScope& operator=(const MetricsContextScope&) = delete;
+
+private:
+    MetricsContext outer;
+};
+
+// Операция верхнего уровня (например, шифрование файла); стадии внутри неё
+// суммируются, при завершении печатается сводка.
+class OperationMetrics {
+public:
+    explicit OperationMetrics(const char* name);
+    ~OperationMetrics();
+
+    OperationMetrics(const OperationMetrics&) = delete;
+    OperationMetrics& operator=(const OperationMetrics&) = delete;
+
+private:
+    const char* name;
+    bool active;
+};
+
+class StageTimer {
+public:
+    explicit StageTimer(MetricStage stage, uint64_t bytes = 0);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void setBytes(uint64_t value);
+
+private:
+    MetricStage stage;
+    uint64_t bytes;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+    unsigned outerStages;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "parallel.h"
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+unsigned defaultThreads() {
+    const char* value = getenv("RGR_THREADS");
+    if (value) {
+        unsigned long threads = strtoul(value, nullptr, 10);
+        if (threads > 0 && threads <= 1024) return static_cast<unsigned>(threads);
+    }
+    return max(1u, thread::hardware_concurrency());
+}
+
+atomic<unsigned> configuredThreads{ 0 };
+
+}
+
+unsigned workerThreads() {
+    unsigned threads = configuredThreads.load(memory_order_relaxed);
+    if (threads == 0) {
+        static const unsigned fallback = defaultThreads();
+        threads = fallback;
+    }
+    return threads;
+}
+
+void setWorkerThreads(unsigned threads) {
+    configuredThreads.store(threads, memory_order_relaxed);
+}
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Число потоков для распараллеливаемых преобразований больших буферов.
+// По умолчанию - число ядер; RGR_THREADS=N задаёт его явно (1 - без потоков).
+unsigned workerThreads();
+void setWorkerThreads(unsigned threads);  // 0 - снова по умолчанию
+
+// Число потоков на время одной операции (например, по плану execution_plan.h).
+class WorkerThreadsScope {
+public:
+    explicit WorkerThreadsScope(unsigned threads) { setWorkerThreads(threads); }
+    ~WorkerThreadsScope() { setWorkerThreads(0); }
+
+    WorkerThreadsScope(const WorkerThreadsScope&) = delete;
+    WorkerThreadsScope& operator=(const WorkerThreadsScope&) = delete;
+};
+
+// Поток уже выполняет работу parallelFor: вложенные вызовы не создают
+// новых потоков, иначе их число растёт как произведение уровней.
+inline thread_local bool insideParallelFor = false;
+
+// Выполняет job(i) для i < count на нескольких потоках (threads == 0 -
+// workerThreads()); false, если хоть один вызов вернул false или бросил исключение.
+// Потоки выполняют job в операции и стадиях замеров (metrics.h) вызвавшего.
+template <typename Job>
+bool parallelFor(uint64_t count, unsigned threads, Job job) {
+    if (threads == 0) threads = workerThreads();
+    threads = static_cast<unsigned>(std::min<uint64_t>(threads, count));
+    if (insideParallelFor) threads = 1;
+
+    std::atomic<uint64_t> next{ 0 };
+    std::atomic<bool> ok{ true };
+    const MetricsContext metrics = currentMetricsContext();
+    auto worker = [&]() {
+        MetricsContextScope metricsScope(metrics);
+        bool outer = insideParallelFor;
+        insideParallelFor = true;
+        for (uint64_t i = next++; i < count && ok; i = next++) {
+            try {
+                if (!job(i)) ok = false;
+            } catch (const std::exception&) {
+                ok = false;
+            }
+        }
+        insideParallelFor = outer;
+    };
+
+    if (threads <= 1) {
+        worker();
+        return ok;
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    return ok;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+// Перестановка на месте: после вызова data[i] == старое data[source(i)]
+// для всех i < length. Обход по циклам, дополнительная память - length бит
+// из арены потока.
+template <typename T, typename Source>
+void permuteInPlace(T* data, uint64_t length, Source source) {
+    ArenaScope scope;
+    std::span<uint64_t> visited = scope.allocate<uint64_t>(static_cast<size_t>((length + 63) / 64));
+    std::fill(visited.begin(), visited.end(), 0);
+
+    for (uint64_t start = 0; start < length; start++) {
+        if (visited[start / 64] >> (start % 64) & 1) continue;
+
+        T first = std::move(data[start]);
+        uint64_t current = start;
+        while (true) {
+            visited[current / 64] |= uint64_t(1) << (current % 64);
+            uint64_t next = source(current);
+            if (next == start) {
+                data[current] = std::move(first);
+                break;
+            }
+            data[current] = std::move(data[next]);
+            current = next;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,411 @@
+#include "pipeline.h"
+#include "affine.h"
+#include "skytale.h"
+#include "table.h"
+#include "arena.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const uint64_t PAD = static_cast<uint64_t>(-1);
+
+enum class StepKind {
+    SKYTALE_ENCRYPT,
+    SKYTALE_DECRYPT,
+    TABLE_ENCRYPT,
+    TABLE_DECRYPT
+};
+
+// Одна перестановка в составе прохода: по индексу выхода даёт индекс входа
+// (или PAD, если на этом месте стоит символ дополнения).
+struct Step {
+    StepKind kind;
+    uint64_t inputLength;
+    uint64_t outputLength;
+    uint64_t key;
+    uint64_t rows;
+    const uint64_t* order;
+};
+
+inline uint64_t stepSource(const Step& step, uint64_t o) {
+    uint64_t i = 0;
+    switch (step.kind) {
+        case StepKind::SKYTALE_ENCRYPT:
+            i = (o % step.key) * step.rows + o / step.key;
+            break;
+        case StepKind::SKYTALE_DECRYPT:
+            i = (o % step.rows) * step.key + o / step.rows;
+            break;
+        case StepKind::TABLE_ENCRYPT:
+            i = step.order[o % step.key] * step.rows + o / step.key;
+            break;
+        case StepKind::TABLE_DECRYPT:
+            i = (o % step.rows) * step.key + (step.order[o / step.rows] - 1);
+            break;
+    }
+    return i < step.inputLength ? i : PAD;
+}
+
+// Композиция аффинных замен в виде таблицы. Для байтов таблица полная,
+// для текста покрывает диапазон до 'я' - остальные символы шифр не меняет.
+template <typename T>
+class Substitution {
+public:
+    static constexpr size_t RANGE = sizeof(T) == 1 ? 256 : static_cast<size_t>(L'я') + 1;
+
+    explicit Substitution(ScratchArena& arena) : table(arena.allocate<T>(RANGE)) {
+        reset();
+    }
+
+    void reset() {
+        iota(table.begin(), table.end(), T(0));
+    }
+
+    T operator()(T c) const {
+        if constexpr (sizeof(T) == 1) {
+            return table[static_cast<unsigned char>(c)];
+        } else {
+            return static_cast<size_t>(c) < RANGE ? table[static_cast<size_t>(c)] : c;
+        }
+    }
+
+    // Аффинная замена поверх накопленных: применяется к значениям таблицы
+    void thenAffine(uint64_t a, uint64_t b, bool encrypt) {
+        applyAffine(table, a, b, encrypt);
+    }
+
+    static void applyAffine(span<T> values, uint64_t a, uint64_t b, bool encrypt) {
+        if constexpr (sizeof(T) == 1) {
+            if (encrypt) affineEncryptBinary(span<const T>(values), values, a, b);
+            else affineDecryptBinary(span<const T>(values), values, a, b);
+        } else {
+            if (encrypt) affineEncryptWide(span<const T>(values), values, a, b);
+            else affineDecryptWide(span<const T>(values), values, a, b);
+        }
+    }
+
+private:
+    span<T> table;
+};
+
+template <typename T>
+constexpr T skytalePad() {
+    if constexpr (sizeof(T) == 1) return T(0);
+    else return L' ';
+}
+
+template <typename T>
+constexpr T tablePad() {
+    if constexpr (sizeof(T) == 1) return T(0);
+    else return L'x';
+}
+
+// Накопленный участок цепочки, выполняемый одной выборкой. Память под шаги
+// и таблицу замены берётся из арены один раз на весь вызов.
+template <typename T>
+struct Segment {
+    span<Step> steps;
+    span<T> pads;
+    size_t stepCount = 0;
+    Substitution<T> substitution;
+    bool substituted = false;
+    uint64_t inputLength = 0;
+    uint64_t outputLength = 0;
+
+    Segment(ScratchArena& arena, size_t capacity, uint64_t length)
+        : steps(arena.allocate<Step>(capacity)), pads(arena.allocate<T>(capacity)), substitution(arena),
+          inputLength(length), outputLength(length) {}
+
+    void reset(uint64_t length) {
+        stepCount = 0;
+        if (substituted) substitution.reset();
+        substituted = false;
+        inputLength = length;
+        outputLength = length;
+    }
+
+    bool trivial() const {
+        return stepCount == 0 && !substituted;
+    }
+
+    void addAffine(uint64_t a, uint64_t b, bool encrypt) {
+        substitution.thenAffine(a, b, encrypt);
+        Substitution<T>::applyAffine(pads.first(stepCount), a, b, encrypt);
+        substituted = true;
+    }
+
+    void addStep(const Step& step, T pad) {
+        steps[stepCount] = step;
+        pads[stepCount] = pad;
+        stepCount++;
+        outputLength = step.outputLength;
+    }
+
+    void run(const T* input, T* output) const {
+        if (stepCount == 0) {
+            for (uint64_t o = 0; o < outputLength; o++) {
+                output[o] = substitution(input[o]);
+            }
+            return;
+        }
+        if (stepCount == 1) {
+            runSingle(steps[0], pads[0], input, output);
+            return;
+        }
+        for (uint64_t o = 0; o < outputLength; o++) {
+            uint64_t index = o;
+            size_t s = stepCount;
+            while (s > 0) {
+                index = stepSource(steps[s - 1], index);
+                if (index == PAD) break;
+                s--;
+            }
+            output[o] = index == PAD ? pads[s - 1] : substitution(input[index]);
+        }
+    }
+
+    // Одна перестановка: обход вложенными циклами без деления на каждый элемент
+    void runSingle(const Step& step, T pad, const T* input, T* output) const {
+        const uint64_t length = step.inputLength;
+        switch (step.kind) {
+            case StepKind::SKYTALE_ENCRYPT:
+                for (uint64_t c = 0; c < step.rows; c++) {
+                    T* out = output + c * step.key;
+                    for (uint64_t r = 0; r < step.key; r++) {
+                        uint64_t i = r * step.rows + c;
+                        out[r] = i < length ? substitution(input[i]) : pad;
+                    }
+                }
+                break;
+            case StepKind::SKYTALE_DECRYPT: {
+                uint64_t o = 0;
+                for (uint64_t r = 0; r < step.key && o < step.outputLength; r++) {
+                    for (uint64_t c = 0; c < step.rows && o < step.outputLength; c++, o++) {
+                        uint64_t i = c * step.key + r;
+                        output[o] = i < length ? substitution(input[i]) : pad;
+                    }
+                }
+                break;
+            }
+            case StepKind::TABLE_ENCRYPT:
+                for (uint64_t i = 0; i < step.rows; i++) {
+                    T* out = output + i * step.key;
+                    for (uint64_t c = 0; c < step.key; c++) {
+                        uint64_t source = step.order[c] * step.rows + i;
+                        out[c] = source < length ? substitution(input[source]) : pad;
+                    }
+                }
+                break;
+            case StepKind::TABLE_DECRYPT:
+                for (uint64_t c = 0; c < step.key; c++) {
+                    const T* column = input + (step.order[c] - 1);
+                    T* out = output + c * step.rows;
+                    for (uint64_t i = 0; i < step.rows; i++) {
+                        out[i] = substitution(column[i * step.key]);
+                    }
+                }
+                break;
+        }
+    }
+};
+
+template <typename T>
+size_t runPipeline(const vector<CipherPipeline::Stage>& stages, span<const T> input, span<T> output, bool encrypt) {
+    constexpr bool binary = sizeof(T) == 1;
+
+    // Длина промежуточных данных не превышает ни входа, ни итогового
+    // размера при шифровании: каждый шаг лишь дополняет до полной матрицы.
+    uint64_t capacity = static_cast<uint64_t>(input.size());
+    if (encrypt) {
+        for (const CipherPipeline::Stage& stage : stages) {
+            if (stage.type == CipherPipeline::StageType::SKYTALE) {
+                capacity = skytaleOutputSize(capacity, stage.key, true);
+            } else if (stage.type == CipherPipeline::StageType::TABLE) {
+                capacity = tableOutputSize(capacity, stage.columnOrder.size(), true);
+            }
+        }
+        capacity = max(capacity, static_cast<uint64_t>(input.size()));
+    }
+
+    ScratchArena& arena = threadArena();
+    ArenaScope scope(arena);
+    span<T> buffers[2] = { arena.allocate<T>(static_cast<size_t>(capacity)), arena.allocate<T>(static_cast<size_t>(capacity)) };
+    int current = 0;
+    span<const T> source = input;
+
+    Segment<T> segment(arena, stages.size(), static_cast<uint64_t>(input.size()));
+
+    auto flush = [&]() {
+        span<T> target = buffers[current].first(static_cast<size_t>(segment.outputLength));
+        current ^= 1;
+        segment.run(source.data(), target.data());
+        source = target;
+        segment.reset(static_cast<uint64_t>(target.size()));
+    };
+
+    for (size_t n = 0; n < stages.size(); n++) {
+        const CipherPipeline::Stage& stage = stages[encrypt ? n : stages.size() - 1 - n];
+        uint64_t length = segment.outputLength;
+
+        switch (stage.type) {
+            case CipherPipeline::StageType::AFFINE:
+                segment.addAffine(stage.a, stage.b, encrypt);
+                break;
+
+            case CipherPipeline::StageType::SKYTALE: {
+                if (stage.key == 0 || length == 0) break;
+                uint64_t columns = (length + stage.key - 1) / stage.key;
+                if (encrypt) {
+                    segment.addStep({ StepKind::SKYTALE_ENCRYPT, length, stage.key * columns, stage.key, columns, nullptr }, skytalePad<T>());
+                } else {
+                    segment.addStep({ StepKind::SKYTALE_DECRYPT, length, length, stage.key, columns, nullptr }, skytalePad<T>());
+                }
+                break;
+            }
+
+            case CipherPipeline::StageType::TABLE: {
+                uint64_t keyLength = static_cast<uint64_t>(stage.columnOrder.size());
+                if constexpr (!binary) {
+                    // Табличный шифр над текстом удаляет пробелы - отдельный шаг
+                    if (!segment.trivial()) flush();
+                    span<T> target = buffers[current];
+                    current ^= 1;
+                    uint64_t size = encrypt
+                        ? encryptTable(stage.columnOrder, source, target)
+                        : decryptTable(stage.columnOrder, source, target);
+                    source = target.first(static_cast<size_t>(size));
+                    segment.reset(size);
+                    break;
+                }
+                uint64_t rows = encrypt ? (length + keyLength - 1) / keyLength : length / keyLength;
+                if (encrypt) {
+                    segment.addStep({ StepKind::TABLE_ENCRYPT, length, rows * keyLength, keyLength, rows, stage.sourceColumn.data() }, tablePad<T>());
+                } else {
+                    segment.addStep({ StepKind::TABLE_DECRYPT, length, rows * keyLength, keyLength, rows, stage.columnOrder.data() }, tablePad<T>());
+                    // Отбрасывание дополнения зависит от данных - завершаем проход
+                    flush();
+                    size_t size = source.size();
+                    while (size > 0 && source[size - 1] == tablePad<T>()) {
+                        size--;
+                    }
+                    source = source.first(size);
+                    segment.reset(static_cast<uint64_t>(size));
+                }
+                break;
+            }
+        }
+    }
+
+    uint64_t size = segment.outputLength;
+    if (static_cast<uint64_t>(output.size()) < size) {
+        throw length_error("pipeline: output buffer is too small");
+    }
+    if (segment.trivial()) {
+        copy(source.begin(), source.begin() + static_cast<size_t>(size), output.begin());
+    } else {
+        segment.run(source.data(), output.data());
+    }
+    return static_cast<size_t>(size);
+}
+
+}
+
+CipherPipeline& CipherPipeline::addAffine(uint64_t a, uint64_t b) {
+    Stage stage;
+    stage.type = StageType::AFFINE;
+    stage.a = a;
+    stage.b = b;
+    stages.push_back(stage);
+    return *this;
+}
+
+CipherPipeline& CipherPipeline::addSkytale(uint64_t key) {
+    Stage stage;
+    stage.type = StageType::SKYTALE;
+    stage.key = key;
+    stages.push_back(stage);
+    return *this;
+}
+
+CipherPipeline& CipherPipeline::addTable(const wstring& key) {
+    if (key.empty()) {
+        throw invalid_argument("table: key must not be empty");
+    }
+    Stage stage;
+    stage.type = StageType::TABLE;
+    stage.columnOrder = getColumnOrder(key);
+    stage.sourceColumn.resize(stage.columnOrder.size());
+    for (uint64_t j = 0; j < static_cast<uint64_t>(stage.columnOrder.size()); j++) {
+        stage.sourceColumn[stage.columnOrder[j] - 1] = j;
+    }
+    stages.push_back(stage);
+    return *this;
+}
+
+bool CipherPipeline::empty() const {
+    return stages.empty();
+}
+
+size_t CipherPipeline::requiredOutputSize(size_t inputSize, bool encrypt) const {
+    if (!encrypt) return inputSize;
+
+    uint64_t size = inputSize;
+    for (const Stage& stage : stages) {
+        if (stage.type == StageType::SKYTALE) {
+            size = skytaleOutputSize(size, stage.key, true);
+        } else if (stage.type == StageType::TABLE) {
+            size = tableOutputSize(size, stage.columnOrder.size(), true);
+        }
+    }
+    return static_cast<size_t>(size);
+}
+
+size_t CipherPipeline::transform(span<const unsigned char> input, span<unsigned char> output, bool encrypt) const {
+    return runPipeline<unsigned char>(stages, input, output, encrypt);
+}
+
+size_t CipherPipeline::transform(span<const wchar_t> input, span<wchar_t> output, bool encrypt) const {
+    return runPipeline<wchar_t>(stages, input, output, encrypt);
+}
+
+size_t CipherPipeline::transformInPlace(span<unsigned char> buffer, size_t length, bool encrypt) const {
+    ArenaScope scope;
+    span<unsigned char> input = scope.allocate<unsigned char>(length);
+    copy(buffer.begin(), buffer.begin() + length, input.begin());
+    return transform(span<const unsigned char>(input), buffer, encrypt);
+}
+
+size_t CipherPipeline::transformInPlace(span<wchar_t> buffer, size_t length, bool encrypt) const {
+    ArenaScope scope;
+    span<wchar_t> input = scope.allocate<wchar_t>(length);
+    copy(buffer.begin(), buffer.begin() + length, input.begin());
+    return transform(span<const wchar_t>(input), buffer, encrypt);
+}
+
+vector<unsigned char> CipherPipeline::encryptBinary(const vector<unsigned char>& data) const {
+    vector<unsigned char> result(requiredOutputSize(data.size(), true));
+    result.resize(transform(span<const unsigned char>(data), span<unsigned char>(result), true));
+    return result;
+}
+
+vector<unsigned char> CipherPipeline::decryptBinary(const vector<unsigned char>& data) const {
+    vector<unsigned char> result(requiredOutputSize(data.size(), false));
+    result.resize(transform(span<const unsigned char>(data), span<unsigned char>(result), false));
+    return result;
+}
+
+wstring CipherPipeline::encryptText(const wstring& text) const {
+    wstring result(requiredOutputSize(text.size(), true), L' ');
+    result.resize(transform(span<const wchar_t>(text), span<wchar_t>(result), true));
+    return result;
+}
+
+wstring CipherPipeline::decryptText(const wstring& text) const {
+    wstring result(requiredOutputSize(text.size(), false), L' ');
+    result.resize(transform(span<const wchar_t>(text), span<wchar_t>(result), false));
+    return result;
+}
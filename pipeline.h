@@ -0,0 +1,53 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "cipher.h"
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Цепочка шифров, выполняемая за один проход: перестановки (Скитала, таблица)
+// объединяются в одну выборку по составной перестановке, а аффинные замены
+// применяются к каждому элементу при чтении. Промежуточные буферы появляются
+// только там, где длина зависит от данных: при расшифровании таблицы
+// (отбрасывание дополнения) и для табличного шифра над текстом (удаление пробелов).
+class CipherPipeline : public Cipher {
+public:
+    CipherPipeline& addAffine(uint64_t a, uint64_t b);
+    CipherPipeline& addSkytale(uint64_t key);
+    CipherPipeline& addTable(const std::wstring& key);
+
+    bool empty() const;
+
+    std::vector<unsigned char> encryptBinary(const std::vector<unsigned char>& data) const;
+    std::vector<unsigned char> decryptBinary(const std::vector<unsigned char>& data) const;
+    std::wstring encryptText(const std::wstring& text) const;
+    std::wstring decryptText(const std::wstring& text) const;
+
+    size_t requiredOutputSize(size_t inputSize, bool encrypt) const override;
+    size_t transform(std::span<const unsigned char> input, std::span<unsigned char> output, bool encrypt) const override;
+    size_t transform(std::span<const wchar_t> input, std::span<wchar_t> output, bool encrypt) const override;
+    size_t transformInPlace(std::span<unsigned char> buffer, size_t length, bool encrypt) const override;
+    size_t transformInPlace(std::span<wchar_t> buffer, size_t length, bool encrypt) const override;
+
+    enum class StageType {
+        AFFINE,
+        SKYTALE,
+        TABLE
+    };
+
+    struct Stage {
+        StageType type = StageType::AFFINE;
+        uint64_t a = 0;
+        uint64_t b = 0;
+        uint64_t key = 0;
+        std::vector<uint64_t> columnOrder;
+        std::vector<uint64_t> sourceColumn;
+    };
+
+private:
+    std::vector<Stage> stages;
+};
+
+#endif
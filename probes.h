@@ -0,0 +1,46 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// Статические точки трассировки (USDT, провайдер rgr) для perf и bpftrace.
+// Если при сборке доступен <sys/sdt.h> (пакет systemtap-sdt-dev), каждая
+// точка - одна инструкция nop и запись в разделе .note.stapsdt; пока
+// трассировщик не подключён, она ничего не стоит. Без заголовка или с
+// -DRGR_NO_PROBES точки исчезают при компиляции.
+//
+// Точки и аргументы:
+//   operation__begin/end (имя)                  - операция меню над файлом
+//   stage__begin/end     (стадия, байты)        - стадии metrics.h, в том числе чтение и запись
+//   transform__begin     (шифр, шифрование, элементы, размер элемента)
+//   transform__end       (шифр, записано элементов) - Cipher::transform*
+//   request__begin       (шифр, шифрование, вид данных, длина данных)
+//   request__end         (статус, длина ответа)  - запрос сервера
+//   chunk__begin/end     (шифр, номер блока, байты) - блоки контейнера
+//   band__begin/end      (первая строка, конец)  - полосы table_file
+//   io__begin            (fd, байты, смещение, запись)
+//   io__end              (fd, байты, успех)      - preadAll / pwriteAll
+// Номера шифров - как в DaemonCipher и ContainerCipher.
+
+#if !defined(RGR_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RGR_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef RGR_PROBES_ENABLED
+#define RGR_PROBE(name, ...) STAP_PROBEV(rgr, name, ##__VA_ARGS__)
+#else
+// Аргументы не вычисляются, но считаются использованными
+#define RGR_PROBE(name, ...) do { if (false) probeArguments(0, ##__VA_ARGS__); } while (0)
+#endif
+
+template <typename... Arguments>
+inline void probeArguments(const Arguments&...) {}
+
+enum class ProbeCipher : int {
+    SKYTALE = 1,
+    AFFINE = 2,
+    TABLE = 3
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include "result_cache.h"
+#include "file_utils.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+const size_t COPY_BLOCK = 1 << 20;
+const char* ENTRY_SUFFIX = ".out";
+
+uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t load32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+uint64_t merge64(uint64_t acc, uint64_t lane) {
+    acc ^= round64(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Свёртка полос, длины и хвоста короче полосы - как в конце XXH64. Вторая
+// половина хеша сворачивает те же полосы в другом порядке от другого начала.
+uint64_t finish64(const uint64_t (&lanes)[4], int first, uint64_t start, uint64_t total,
+                  const unsigned char* tail, size_t length) {
+    uint64_t h;
+    if (total >= 32) {
+        const uint64_t v1 = lanes[first % 4], v2 = lanes[(first + 1) % 4];
+        const uint64_t v3 = lanes[(first + 2) % 4], v4 = lanes[(first + 3) % 4];
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(merge64(merge64(merge64(h, v1), v2), v3), v4);
+    } else {
+        h = start + PRIME5;
+    }
+    h += total;
+
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) h = rotl(h ^ round64(0, load64(tail + i)), 27) * PRIME1 + PRIME4;
+    if (i + 4 <= length) {
+        h = rotl(h ^ (uint64_t(load32(tail + i)) * PRIME1), 23) * PRIME2 + PRIME3;
+        i += 4;
+    }
+    for (; i < length; i++) h = rotl(h ^ (tail[i] * PRIME5), 11) * PRIME1;
+    return avalanche(h);
+}
+
+string hex64(uint64_t value) {
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+// Копия содержимого: клон экстентов, если файловая система умеет, иначе
+// copy_file_range, а между файловыми системами без него - через буфер.
+bool copyFileData(int from, int to, uint64_t size) {
+    if (ioctl(to, FICLONE, from) == 0) return true;
+
+    loff_t inOffset = 0;
+    loff_t outOffset = 0;
+    while (static_cast<uint64_t>(inOffset) < size) {
+        ssize_t n = copy_file_range(from, &inOffset, to, &outOffset, static_cast<size_t>(size - inOffset), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) continue;
+        if (n == 0 || inOffset > 0) return false;
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) return false;
+
+        vector<char> buffer(COPY_BLOCK);
+        for (uint64_t offset = 0; offset < size;) {
+            ssize_t got = pread(from, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            for (ssize_t done = 0; done < got;) {
+                ssize_t put = pwrite(to, buffer.data() + done, static_cast<size_t>(got - done),
+                                     static_cast<off_t>(offset + done));
+                if (put < 0 && errno == EINTR) continue;
+                if (put <= 0) return false;
+                done += put;
+            }
+            offset += static_cast<uint64_t>(got);
+        }
+        return true;
+    }
+    return true;
+}
+
+bool endsWith(const string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+}
+
+ContentHasher::ContentHasher() {
+    lanes[0] = PRIME1 + PRIME2;
+    lanes[1] = PRIME2;
+    lanes[2] = 0;
+    lanes[3] = 0 - PRIME1;
+}
+
+void ContentHasher::update(span<const unsigned char> data) {
+    const unsigned char* p = data.data();
+    size_t length = data.size();
+    total += length;
+
+    if (pendingLength > 0) {
+        size_t take = min(length, sizeof(pending) - pendingLength);
+        memcpy(pending + pendingLength, p, take);
+        pendingLength += take;
+        p += take;
+        length -= take;
+        if (pendingLength < sizeof(pending)) return;
+        for (int lane = 0; lane < 4; lane++) lanes[lane] = round64(lanes[lane], load64(pending + lane * 8));
+        pendingLength = 0;
+    }
+
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    for (; length >= 32; p += 32, length -= 32) {
+        v1 = round64(v1, load64(p));
+        v2 = round64(v2, load64(p + 8));
+        v3 = round64(v3, load64(p + 16));
+        v4 = round64(v4, load64(p + 24));
+    }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+
+    memcpy(pending, p, length);
+    pendingLength = length;
+}
+
+ContentHash ContentHasher::finish() const {
+    ContentHash hash;
+    hash.low = finish64(lanes, 0, 0, total, pending, pendingLength);
+    hash.high = finish64(lanes, 2, PRIME4, total, pending, pendingLength) ^ PRIME3;
+    return hash;
+}
+
+ResultCache::ResultCache(const string& directory, uint64_t capacity, bool decrypt)
+    : directory(directory), capacity(capacity), decrypt(decrypt) {
+}
+
+string ResultCache::entryPath(const CacheKey& key) const {
+    char kind[8];
+    snprintf(kind, sizeof(kind), "-%u%c-", key.cipher, key.encrypt ? 'e' : 'd');
+    return directory + "/" + hex64(key.content.high) + hex64(key.content.low) + "-" + hex64(key.keyFingerprint) +
+           kind + hex64(key.length) + ENTRY_SUFFIX;
+}
+
+bool ResultCache::fetch(const CacheKey& key, const wstring& output) const {
+    if (!covers(key.encrypt)) return false;
+    int entry = ::open(entryPath(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (entry < 0) return false;
+    struct stat info;
+    bool ok = fstat(entry, &info) == 0;
+    int out = ok ? ::open(ws2s(output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    if (out >= 0) {
+        StageTimer timer(MetricStage::WRITE, static_cast<uint64_t>(info.st_size));
+        ok = copyFileData(entry, out, static_cast<uint64_t>(info.st_size));
+        ok = ::close(out) == 0 && ok;
+    } else {
+        ok = false;
+    }
+    // Время изменения - время последнего использования для вытеснения
+    if (ok) futimens(entry, nullptr);
+    ::close(entry);
+    return ok;
+}
+
+void ResultCache::store(const CacheKey& key, const wstring& result) const {
+    if (!covers(key.encrypt)) return;
+    int from = ::open(ws2s(result).c_str(), O_RDONLY | O_CLOEXEC);
+    if (from < 0) return;
+    struct stat info;
+    if (fstat(from, &info) != 0 || static_cast<uint64_t>(info.st_size) > capacity) {
+        ::close(from);
+        return;
+    }
+
+    string path = entryPath(key);
+    string temporary = path + ".tmp." + to_string(getpid());
+    int to = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = to >= 0 && copyFileData(from, to, static_cast<uint64_t>(info.st_size));
+    // Запись появляется под своим именем только целиком и на диске: битая
+    // запись после сбоя питания выдала бы чужой результат
+    ok = ok && fdatasync(to) == 0;
+    if (to >= 0) ok = ::close(to) == 0 && ok;
+    ::close(from);
+    if (ok && rename(temporary.c_str(), path.c_str()) == 0) {
+        evict();
+    } else if (to >= 0) {
+        unlink(temporary.c_str());
+    }
+}
+
+void ResultCache::evict() const {
+    struct Entry {
+        string path;
+        uint64_t size;
+        struct timespec used;
+    };
+    vector<Entry> entries;
+    uint64_t total = 0;
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (dirent* item = readdir(dir)) {
+        string name = item->d_name;
+        if (!endsWith(name, ENTRY_SUFFIX)) continue;
+        Entry entry{ directory + "/" + name, 0, {} };
+        struct stat info;
+        if (stat(entry.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+        entry.size = static_cast<uint64_t>(info.st_size);
+        entry.used = info.st_mtim;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    closedir(dir);
+    if (total <= capacity) return;
+
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+        return a.used.tv_nsec < b.used.tv_nsec;
+    });
+    for (const Entry& entry : entries) {
+        if (total <= capacity) break;
+        // Запись мог уже удалить другой процесс - место всё равно освободилось
+        unlink(entry.path.c_str());
+        total -= entry.size;
+    }
+}
+
+const ResultCache& defaultResultCache() {
+    static const ResultCache cache = [] {
+        const char* directory = getenv("RGR_CACHE");
+        if (!directory || !*directory) return ResultCache();
+        const char* size = getenv("RGR_CACHE_SIZE");
+        uint64_t capacity = size ? strtoull(size, nullptr, 10) : RESULT_CACHE_DEFAULT_SIZE;
+        const char* decrypt = getenv("RGR_CACHE_DECRYPT");
+        mkdir(directory, 0700);
+        struct stat info;
+        if (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode) || capacity == 0) return ResultCache();
+        return ResultCache(directory, capacity, decrypt && strcmp(decrypt, "1") == 0);
+    }();
+    return cache;
+}
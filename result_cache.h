@@ -0,0 +1,85 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <string>
+#include <span>
+#include <cstdint>
+
+// Кэш результатов на диске: одинаковый вход с тем же ключом не шифруется
+// повторно. Запись адресуется хешем содержимого входа, его длиной, шифром,
+// отпечатком ключа (keyFingerprint, container.h) и направлением. При
+// попадании результат клонируется в выходной файл (FICLONE, на btrfs и XFS
+// без копирования данных) или копируется ядром (copy_file_range).
+//
+// Включается переменной RGR_CACHE=<каталог>; RGR_CACHE_SIZE=<байт> - предел
+// размера (по умолчанию 1 ГБ), сверх него удаляются давно не читанные записи.
+// Каталогом могут пользоваться несколько процессов сразу: записи появляются
+// атомарно (rename), исчезнувшая запись - просто промах.
+//
+// Записи - результаты шифрования, поэтому каталог создаётся с правами 0700,
+// записи - 0600. По умолчанию кэшируется только зашифрование: результат
+// расшифрования - открытый текст, и оставлять его копию на диске можно лишь
+// явно (RGR_CACHE_DECRYPT=1).
+
+struct ContentHash {
+    uint64_t low = 0;
+    uint64_t high = 0;
+};
+
+// Быстрый потоковый 128-битный хеш (четыре 64-битные полосы, как в xxHash):
+// считается блоками по мере чтения файла, результат не зависит от деления на
+// блоки. Не криптографический - для адресации кэша, не для защиты.
+class ContentHasher {
+public:
+    ContentHasher();
+
+    void update(std::span<const unsigned char> data);
+    ContentHash finish() const;
+
+private:
+    uint64_t lanes[4];
+    unsigned char pending[32];
+    size_t pendingLength = 0;
+    uint64_t total = 0;
+};
+
+struct CacheKey {
+    ContentHash content;
+    uint64_t length = 0;
+    uint64_t keyFingerprint = 0;
+    uint8_t cipher = 0;
+    bool encrypt = true;
+};
+
+const uint64_t RESULT_CACHE_DEFAULT_SIZE = 1ull << 30;
+
+class ResultCache {
+public:
+    ResultCache() = default;  // выключен
+    ResultCache(const std::string& directory, uint64_t capacity, bool decrypt = false);
+
+    bool enabled() const { return !directory.empty(); }
+    // Кэшируется ли это направление; fetch и store для другого ничего не делают.
+    bool covers(bool encrypt) const { return enabled() && (encrypt || decrypt); }
+
+    // Результат из кэша в файл output; false - промах или ошибка копирования
+    // (тогда output надо получить шифрованием, как без кэша).
+    bool fetch(const CacheKey& key, const std::wstring& output) const;
+
+    // Сохранение готового результата из файла result; ошибки не мешают
+    // основной операции и молча пропускаются.
+    void store(const CacheKey& key, const std::wstring& result) const;
+
+private:
+    std::string entryPath(const CacheKey& key) const;
+    void evict() const;
+
+    std::string directory;
+    uint64_t capacity = 0;
+    bool decrypt = false;
+};
+
+// Из RGR_CACHE, RGR_CACHE_SIZE и RGR_CACHE_DECRYPT.
+const ResultCache& defaultResultCache();
+
+#endif
@@ -0,0 +1,227 @@
+#include "rgr_c.h"
+#include "cipher.h"
+#include "affine.h"
+#include "container.h"
+#include "execution_plan.h"
+#include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "arena.h"
+#include "metrics.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+struct rgr_cipher {
+    rgr_cipher_kind kind;
+    CipherKey key;  // для файлов (execution_plan.h) и проверки ключа Аффинного шифра по виду данных
+    unique_ptr<Cipher> engine;
+};
+
+namespace {
+
+// Исключения не должны пересекать границу C.
+template <typename Call>
+rgr_status guarded(Call call) noexcept {
+    try {
+        return call();
+    } catch (const bad_alloc&) {
+        return RGR_OUT_OF_MEMORY;
+    } catch (...) {
+        return RGR_INTERNAL_ERROR;
+    }
+}
+
+rgr_status create(rgr_cipher_kind kind, const CipherKey& key, unique_ptr<Cipher> engine, rgr_cipher** cipher) {
+    *cipher = new rgr_cipher{ kind, key, move(engine) };
+    return RGR_OK;
+}
+
+bool keyValid(const rgr_cipher* cipher, bool text) {
+    if (cipher->kind != RGR_AFFINE) return true;
+    return text ? isValidTextKey(cipher->key.a) : isValidBinaryKey(cipher->key.a);
+}
+
+}
+
+extern "C" {
+
+uint32_t rgr_abi_version(void) {
+    return RGR_ABI_VERSION;
+}
+
+const char* rgr_status_message(rgr_status status) {
+    switch (status) {
+        case RGR_OK: return "ok";
+        case RGR_BAD_ARGUMENT: return "bad argument";
+        case RGR_BAD_KEY: return "key is not valid for this cipher or data";
+        case RGR_BUFFER_TOO_SMALL: return "output buffer is too small";
+        case RGR_BAD_INPUT: return "input is not valid UTF-8";
+        case RGR_IO_ERROR: return "file could not be read or written";
+        case RGR_OUT_OF_MEMORY: return "out of memory";
+        case RGR_INTERNAL_ERROR: return "internal error";
+    }
+    return "unknown status";
+}
+
+rgr_status rgr_affine_create(uint64_t a, uint64_t b, rgr_cipher** cipher) {
+    if (cipher == nullptr) return RGR_BAD_ARGUMENT;
+    *cipher = nullptr;
+    // Ключ годится хотя бы для одного вида данных
+    if (!isValidBinaryKey(a) && !isValidTextKey(a)) return RGR_BAD_KEY;
+    return guarded([&] {
+        CipherKey affine;
+        affine.cipher = ContainerCipher::AFFINE;
+        affine.a = a;
+        affine.b = b;
+        return create(RGR_AFFINE, affine, make_unique<AffineCipher>(a, b), cipher);
+    });
+}
+
+rgr_status rgr_skytale_create(uint64_t key, rgr_cipher** cipher) {
+    if (cipher == nullptr) return RGR_BAD_ARGUMENT;
+    *cipher = nullptr;
+    if (key == 0) return RGR_BAD_KEY;
+    return guarded([&] {
+        CipherKey skytale;
+        skytale.cipher = ContainerCipher::SKYTALE;
+        skytale.key = key;
+        return create(RGR_SKYTALE, skytale, make_unique<SkytaleCipher>(key), cipher);
+    });
+}
+
+rgr_status rgr_table_create(const char* key, size_t key_length, rgr_cipher** cipher) {
+    if (cipher == nullptr || (key == nullptr && key_length > 0)) return RGR_BAD_ARGUMENT;
+    *cipher = nullptr;
+    return guarded([&] {
+        wstring word;
+        try {
+            word = s2ws(string(key, key_length));
+        } catch (const range_error&) {
+            return RGR_BAD_KEY;
+        }
+        if (word.empty()) return RGR_BAD_KEY;
+        CipherKey table;
+        table.cipher = ContainerCipher::TABLE;
+        table.word = word;
+        return create(RGR_TABLE, table, make_unique<TableCipher>(word), cipher);
+    });
+}
+
+void rgr_cipher_destroy(rgr_cipher* cipher) {
+    delete cipher;
+}
+
+rgr_cipher_kind rgr_cipher_type(const rgr_cipher* cipher) {
+    return cipher->kind;
+}
+
+size_t rgr_required_size(const rgr_cipher* cipher, size_t input_length, int encrypt) {
+    return cipher->engine->requiredOutputSize(input_length, encrypt != 0);
+}
+
+size_t rgr_required_text_size(const rgr_cipher* cipher, size_t input_length, int encrypt) {
+    // Символов не больше, чем байт, и каждый занимает до 4 байт
+    return cipher->engine->requiredOutputSize(input_length, encrypt != 0) * 4;
+}
+
+rgr_status rgr_transform(const rgr_cipher* cipher, const unsigned char* input, size_t input_length,
+                         unsigned char* output, size_t output_capacity, int encrypt, size_t* output_length) {
+    if (cipher == nullptr || output_length == nullptr) return RGR_BAD_ARGUMENT;
+    if ((input == nullptr && input_length > 0) || (output == nullptr && output_capacity > 0)) return RGR_BAD_ARGUMENT;
+    if (!keyValid(cipher, false)) return RGR_BAD_KEY;
+
+    size_t required = cipher->engine->requiredOutputSize(input_length, encrypt != 0);
+    if (output_capacity < required) {
+        *output_length = required;
+        return RGR_BUFFER_TOO_SMALL;
+    }
+    return guarded([&] {
+        *output_length = cipher->engine->transform(span<const unsigned char>(input, input_length),
+                                                   span<unsigned char>(output, output_capacity), encrypt != 0);
+        return RGR_OK;
+    });
+}
+
+rgr_status rgr_transform_in_place(const rgr_cipher* cipher, unsigned char* buffer, size_t capacity, size_t length,
+                                  int encrypt, size_t* output_length) {
+    if (cipher == nullptr || output_length == nullptr || length > capacity) return RGR_BAD_ARGUMENT;
+    if (buffer == nullptr && capacity > 0) return RGR_BAD_ARGUMENT;
+    if (!keyValid(cipher, false)) return RGR_BAD_KEY;
+
+    size_t required = cipher->engine->requiredOutputSize(length, encrypt != 0);
+    if (capacity < required) {
+        *output_length = required;
+        return RGR_BUFFER_TOO_SMALL;
+    }
+    return guarded([&] {
+        *output_length = cipher->engine->transformInPlace(span<unsigned char>(buffer, capacity), length, encrypt != 0);
+        return RGR_OK;
+    });
+}
+
+rgr_status rgr_transform_text(const rgr_cipher* cipher, const char* input, size_t input_length,
+                              char* output, size_t output_capacity, int encrypt, size_t* output_length) {
+    if (cipher == nullptr || output_length == nullptr) return RGR_BAD_ARGUMENT;
+    if ((input == nullptr && input_length > 0) || (output == nullptr && output_capacity > 0)) return RGR_BAD_ARGUMENT;
+    if (!keyValid(cipher, true)) return RGR_BAD_KEY;
+
+    return guarded([&] {
+        const Cipher& engine = *cipher->engine;
+        ArenaScope scope;
+        size_t capacity = max(input_length, engine.requiredOutputSize(input_length, encrypt != 0));
+        span<wchar_t> wide = scope.allocate<wchar_t>(capacity);
+        size_t count = cipherKernels().decodeUtf8(reinterpret_cast<const unsigned char*>(input), input_length, wide.data());
+        if (count == UTF8_ERROR) return RGR_BAD_INPUT;
+        size_t size = engine.transformInPlace(wide, count, encrypt != 0);
+
+        // Сразу в output, если места там хватит при любом составе текста
+        char* target = output_capacity >= size * 4 ? output : scope.allocate<char>(size * 4).data();
+        size_t bytes = encodeUtf8(wide.data(), size, target);
+        if (bytes == UTF8_ERROR) return RGR_INTERNAL_ERROR;
+        *output_length = bytes;
+        if (target != output) {
+            if (bytes > output_capacity) return RGR_BUFFER_TOO_SMALL;
+            copy(target, target + bytes, output);
+        }
+        return RGR_OK;
+    });
+}
+
+rgr_status rgr_transform_file(const rgr_cipher* cipher, const char* input_path, const char* output_path,
+                              rgr_file_mode mode, int encrypt) {
+    if (cipher == nullptr || input_path == nullptr || output_path == nullptr) return RGR_BAD_ARGUMENT;
+    if (mode != RGR_FILE_BINARY && mode != RGR_FILE_TEXT) return RGR_BAD_ARGUMENT;
+    if (!keyValid(cipher, mode == RGR_FILE_TEXT)) return RGR_BAD_KEY;
+
+    return guarded([&] {
+        wstring input = s2ws(input_path);
+        wstring output = s2ws(output_path);
+
+        if (mode == RGR_FILE_TEXT) {
+            const Cipher& engine = *cipher->engine;
+            OperationMetrics metrics("library.text_file");
+            wstring text;
+            switch (readTextFile(input, text)) {
+                case TextFileResult::OK: break;
+                case TextFileResult::READ_FAILED: return RGR_IO_ERROR;
+                case TextFileResult::BAD_ENCODING: return RGR_BAD_INPUT;
+            }
+            wstring result(engine.requiredOutputSize(text.size(), encrypt != 0), L' ');
+            result.resize(engine.transform(span<const wchar_t>(text), span<wchar_t>(result), encrypt != 0));
+            return writeTextFile(output, result) ? RGR_OK : RGR_IO_ERROR;
+        }
+
+        // По плану, как файлы программы: поток, mmap, потоки или внешняя сортировка
+        OperationMetrics metrics("library.image_file");
+        return transformBinaryFile("library.image_file", input, output, cipher->key, encrypt != 0) == FileResult::OK
+                   ? RGR_OK
+                   : RGR_IO_ERROR;
+    });
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef RGR_C_H
+#define RGR_C_H
+
+/*
+ * C-интерфейс движка шифров для встраивания (librgr.so). Вызовы не печатают
+ * сообщений и не бросают исключений: результат - код rgr_status.
+ *
+ * Шифр с ключом - непрозрачный дескриптор rgr_cipher: ключ разбирается и
+ * проверяется один раз при создании (для табличного шифра здесь же
+ * вычисляется порядок столбцов). После создания дескриптор не меняется,
+ * и одним дескриптором можно пользоваться из нескольких потоков сразу.
+ *
+ * Совместимость: функции и значения перечислений только добавляются;
+ * RGR_ABI_VERSION растёт при добавлении.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define RGR_API __attribute__((visibility("default")))
+#else
+#define RGR_API
+#endif
+
+#define RGR_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum rgr_status {
+    RGR_OK = 0,
+    RGR_BAD_ARGUMENT = 1,      /* нулевой указатель, неизвестный режим */
+    RGR_BAD_KEY = 2,           /* ключ не подходит для шифра или вида данных */
+    RGR_BUFFER_TOO_SMALL = 3,  /* *out_length - сколько нужно */
+    RGR_BAD_INPUT = 4,         /* текст не в UTF-8 */
+    RGR_IO_ERROR = 5,
+    RGR_OUT_OF_MEMORY = 6,
+    RGR_INTERNAL_ERROR = 7
+} rgr_status;
+
+/* Номера - как в протоколе сервера и в контейнере. */
+typedef enum rgr_cipher_kind {
+    RGR_SKYTALE = 1,
+    RGR_AFFINE = 2,
+    RGR_TABLE = 3
+} rgr_cipher_kind;
+
+typedef enum rgr_file_mode {
+    RGR_FILE_BINARY = 0,
+    RGR_FILE_TEXT = 1          /* UTF-8, алфавит текстового режима */
+} rgr_file_mode;
+
+typedef struct rgr_cipher rgr_cipher;
+
+RGR_API uint32_t rgr_abi_version(void);
+RGR_API const char* rgr_status_message(rgr_status status);
+
+RGR_API rgr_status rgr_affine_create(uint64_t a, uint64_t b, rgr_cipher** cipher);
+RGR_API rgr_status rgr_skytale_create(uint64_t key, rgr_cipher** cipher);
+/* Ключевое слово в UTF-8, key_length байт. */
+RGR_API rgr_status rgr_table_create(const char* key, size_t key_length, rgr_cipher** cipher);
+RGR_API void rgr_cipher_destroy(rgr_cipher* cipher);
+
+RGR_API rgr_cipher_kind rgr_cipher_type(const rgr_cipher* cipher);
+
+/* Размер буфера под результат для двоичных данных длины input_length. */
+RGR_API size_t rgr_required_size(const rgr_cipher* cipher, size_t input_length, int encrypt);
+
+/* Верхняя граница результата в байтах для UTF-8 текста длины input_length. */
+RGR_API size_t rgr_required_text_size(const rgr_cipher* cipher, size_t input_length, int encrypt);
+
+/* Двоичные данные. output не должен перекрываться с input. */
+RGR_API rgr_status rgr_transform(const rgr_cipher* cipher, const unsigned char* input, size_t input_length,
+                                 unsigned char* output, size_t output_capacity, int encrypt, size_t* output_length);
+
+/* На месте: первые length байт buffer - вход, capacity >= rgr_required_size(). */
+RGR_API rgr_status rgr_transform_in_place(const rgr_cipher* cipher, unsigned char* buffer, size_t capacity, size_t length,
+                                          int encrypt, size_t* output_length);
+
+/* Текст в UTF-8, как в текстовом режиме программы. */
+RGR_API rgr_status rgr_transform_text(const rgr_cipher* cipher, const char* input, size_t input_length,
+                                      char* output, size_t output_capacity, int encrypt, size_t* output_length);
+
+/* Файл в файл; пути в UTF-8. Двоичный файл обрабатывается по плану, как в
+ * программе (execution_plan.h); пустой двоичный вход - RGR_IO_ERROR. Текст не
+ * в UTF-8 - RGR_BAD_INPUT, пустой текст даёт пустой выход. */
+RGR_API rgr_status rgr_transform_file(const rgr_cipher* cipher, const char* input_path, const char* output_path,
+                                      rgr_file_mode mode, int encrypt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
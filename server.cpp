@@ -0,0 +1,656 @@
+#include "server.h"
+#include "daemon_protocol.h"
+#include "cipher.h"
+#include "affine.h"
+#include "file_utils.h"
+#include "cpu_dispatch.h"
+#include "arena.h"
+#include "probes.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <span>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+int stopPipe[2] = { -1, -1 };
+
+const size_t SERVER_READ_STEP = 64 << 10;         // начальный буфер данных запроса
+const size_t SERVER_RETAIN_BUFFER = 1 << 20;      // больший буфер освобождается после ответа
+const int SERVER_STALL_TIMEOUT_MS = 30000;        // запрос или ответ без движения - соединение закрывается
+const int SERVER_SWEEP_INTERVAL_MS = 1000;
+
+void onStopSignal(int) {
+    char byte = 1;
+    ssize_t ignored = write(stopPipe[1], &byte, 1);
+    (void)ignored;
+}
+
+// Подготовленные шифры по ключу. Объекты неизменяемы, поэтому один
+// экземпляр используется всеми потоками одновременно. При заполнении
+// вытесняется ключ, дольше всех не использовавшийся.
+class CipherCache {
+public:
+    shared_ptr<const Cipher> get(DaemonCipher type, span<const char> key) {
+        // Строка поиска своя у каждого потока: её буфер не выделяется заново
+        thread_local string lookup;
+        lookup.assign(1, static_cast<char>(type));
+        lookup.append(key.data(), key.size());
+
+        {
+            lock_guard<mutex> guard(lock);
+            auto found = entries.find(lookup);
+            if (found != entries.end()) {
+                recent.splice(recent.begin(), recent, found->second);
+                return found->second->second;
+            }
+        }
+
+        shared_ptr<const Cipher> cipher = create(type, key);
+        lock_guard<mutex> guard(lock);
+        auto found = entries.find(lookup);
+        if (found != entries.end()) {
+            // Другой поток успел добавить тот же ключ
+            recent.splice(recent.begin(), recent, found->second);
+            return found->second->second;
+        }
+        if (entries.size() >= CAPACITY) {
+            entries.erase(recent.back().first);
+            recent.pop_back();
+        }
+        recent.emplace_front(lookup, cipher);
+        entries.emplace(lookup, recent.begin());
+        return cipher;
+    }
+
+private:
+    static const size_t CAPACITY = 4096;
+
+    static shared_ptr<const Cipher> create(DaemonCipher type, span<const char> key) {
+        switch (type) {
+            case DaemonCipher::AFFINE: {
+                uint64_t ab[2];
+                if (key.size() != sizeof(ab)) throw invalid_argument("affine: key must be two uint64 values");
+                memcpy(ab, key.data(), sizeof(ab));
+                return make_shared<AffineCipher>(ab[0], ab[1]);
+            }
+            case DaemonCipher::SKYTALE: {
+                uint64_t value;
+                if (key.size() != sizeof(value)) throw invalid_argument("skytale: key must be one uint64 value");
+                memcpy(&value, key.data(), sizeof(value));
+                if (value == 0) throw invalid_argument("skytale: key must be positive");
+                return make_shared<SkytaleCipher>(value);
+            }
+            case DaemonCipher::TABLE:
+                return make_shared<TableCipher>(s2ws(string(key.data(), key.size())));
+        }
+        throw invalid_argument("unknown cipher");
+    }
+
+    using Entry = pair<string, shared_ptr<const Cipher>>;
+
+    mutex lock;
+    list<Entry> recent;  // в начале - использованные последними
+    unordered_map<string, list<Entry>::iterator> entries;
+};
+
+// Соединение и его текущий запрос. Пока запрос не пришёл целиком,
+// соединением владеет цикл epoll: сокет неблокирующий, и цикл забирает из
+// него то, что уже пришло, в буферы соединения. Целый запрос переходит к
+// потоку пула (busy); поток выполняет его, отправляет ответ и возвращает
+// соединение в epoll (EPOLLONESHOT - событие получает только владелец).
+// Поэтому медленный или простаивающий клиент поток не держит, а соединений
+// может быть сколько угодно больше, чем потоков.
+struct Connection {
+    enum class Stage { HEADER, KEY, PAYLOAD, REPLY };
+
+    int fd = -1;
+    Stage stage = Stage::HEADER;
+    size_t received = 0;  // байт текущей части: заголовка, ключа или данных
+    RequestHeader header = {};
+    vector<char> key;
+    vector<char> payload;  // растёт по мере приёма; не меньше результата двоичного запроса
+    shared_ptr<const Cipher> cipher;
+
+    ResponseHeader response = {};
+    vector<char> reply;          // результат текстового запроса; двоичный - на месте в payload
+    span<const char> replyData;
+    size_t sent = 0;
+    bool closeAfterReply = false;  // отклонённый запрос: данные не читались
+
+    chrono::steady_clock::time_point lastActivity;
+    atomic<bool> busy{ false };  // запрос у потока пула; цикл epoll соединение не трогает
+};
+
+// Целые запросы для потоков пула.
+class RequestQueue {
+public:
+    void push(Connection* connection) {
+        {
+            lock_guard<mutex> guard(lock);
+            ready.push_back(connection);
+        }
+        available.notify_one();
+    }
+
+    bool pop(Connection*& connection) {
+        unique_lock<mutex> guard(lock);
+        available.wait(guard, [this] { return stopped || !ready.empty(); });
+        if (stopped) return false;
+        connection = ready.front();
+        ready.pop_front();
+        return true;
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopped = true;
+            ready.clear();
+        }
+        available.notify_all();
+    }
+
+private:
+    mutex lock;
+    condition_variable available;
+    deque<Connection*> ready;
+    bool stopped = false;
+};
+
+// Открытые соединения по дескриптору.
+class ConnectionSet {
+public:
+    Connection* add(int fd) {
+        auto connection = make_unique<Connection>();
+        connection->fd = fd;
+        connection->lastActivity = chrono::steady_clock::now();
+        lock_guard<mutex> guard(lock);
+        return (open[fd] = move(connection)).get();
+    }
+
+    Connection* find(int fd) {
+        lock_guard<mutex> guard(lock);
+        auto found = open.find(fd);
+        return found != open.end() ? found->second.get() : nullptr;
+    }
+
+    void close(int fd) {
+        lock_guard<mutex> guard(lock);
+        open.erase(fd);
+        ::close(fd);
+    }
+
+    // Соединения, которые начали запрос или ответ и не продвинулись с deadline:
+    // буферы такого соединения заняты, а клиент, похоже, пропал.
+    void closeStalled(chrono::steady_clock::time_point deadline) {
+        lock_guard<mutex> guard(lock);
+        for (auto it = open.begin(); it != open.end();) {
+            // Соединение у потока пула не трогается: его поля сейчас пишет поток
+            const Connection& connection = *it->second;
+            bool stalled = !connection.busy.load(memory_order_acquire) &&
+                           (connection.stage != Connection::Stage::HEADER || connection.received > 0) &&
+                           connection.lastActivity < deadline;
+            if (stalled) {
+                ::close(it->first);
+                it = open.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void closeAll() {
+        lock_guard<mutex> guard(lock);
+        for (auto& entry : open) ::close(entry.first);
+        open.clear();
+    }
+
+private:
+    mutex lock;
+    unordered_map<int, unique_ptr<Connection>> open;
+};
+
+bool affineKeyValid(span<const char> key, bool text) {
+    uint64_t a;
+    memcpy(&a, key.data(), sizeof(a));
+    return text ? isValidTextKey(a) : isValidBinaryKey(a);
+}
+
+void setReply(Connection& connection, DaemonStatus status, span<const char> data = {}) {
+    RGR_PROBE(request__end, static_cast<int>(status), data.size());
+    connection.response = { DAEMON_MAGIC, static_cast<uint32_t>(status), data.size() };
+    connection.replyData = data;
+    connection.sent = 0;
+}
+
+enum class SendState { DONE, PENDING, FAILED };
+
+// Отправка ответа, сколько примет сокет; PENDING - остаток ждёт EPOLLOUT.
+SendState sendReply(Connection& connection) {
+    const size_t headerSize = sizeof(connection.response);
+    const size_t total = headerSize + connection.replyData.size();
+    while (connection.sent < total) {
+        iovec parts[2];
+        int count = 0;
+        if (connection.sent < headerSize) {
+            parts[count++] = { reinterpret_cast<char*>(&connection.response) + connection.sent,
+                               headerSize - connection.sent };
+        }
+        size_t offset = connection.sent > headerSize ? connection.sent - headerSize : 0;
+        if (offset < connection.replyData.size()) {
+            parts[count++] = { const_cast<char*>(connection.replyData.data()) + offset,
+                               connection.replyData.size() - offset };
+        }
+        msghdr message = {};
+        message.msg_iov = parts;
+        message.msg_iovlen = static_cast<size_t>(count);
+        ssize_t n = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SendState::PENDING;
+        if (n < 0) return SendState::FAILED;
+        connection.sent += static_cast<size_t>(n);
+        connection.lastActivity = chrono::steady_clock::now();
+    }
+    return SendState::DONE;
+}
+
+// Размещение буферов по флагам запроса; незаданные поля - по умолчанию сервера.
+BufferPolicy requestBufferPolicy(uint8_t flags) {
+    BufferPolicy policy = defaultBufferPolicy();
+    switch (flags & DAEMON_PAGES_MASK) {
+        case DAEMON_PAGES_NONE: policy.pages = HugePages::NONE; break;
+        case DAEMON_PAGES_TRANSPARENT: policy.pages = HugePages::TRANSPARENT; break;
+        case DAEMON_PAGES_EXPLICIT: policy.pages = HugePages::EXPLICIT; break;
+    }
+    switch (flags & DAEMON_NUMA_MASK) {
+        case DAEMON_NUMA_DEFAULT: policy.numa = NumaPlacement::DEFAULT; break;
+        case DAEMON_NUMA_FIRST_TOUCH: policy.numa = NumaPlacement::FIRST_TOUCH; break;
+        case DAEMON_NUMA_INTERLEAVE: policy.numa = NumaPlacement::INTERLEAVE; break;
+    }
+    return policy;
+}
+
+DaemonStatus processFile(const Cipher& cipher, DaemonPayload kind, bool encrypt, uint8_t flags, span<const char> paths) {
+    auto separator = find(paths.begin(), paths.end(), '\0');
+    if (separator == paths.end()) return DaemonStatus::BAD_REQUEST;
+    wstring input = s2ws(string(paths.begin(), separator));
+    wstring output = s2ws(string(separator + 1, paths.end()));
+
+    if (kind == DaemonPayload::TEXT_FILE) {
+        wstring text = readTextFile(input);
+        if (text.empty()) return DaemonStatus::IO_ERROR;
+        wstring result(cipher.requiredOutputSize(text.size(), encrypt), L' ');
+        result.resize(cipher.transform(span<const wchar_t>(text), span<wchar_t>(result), encrypt));
+        return writeTextFile(output, result) ? DaemonStatus::OK : DaemonStatus::IO_ERROR;
+    }
+
+    BufferPolicy policy = requestBufferPolicy(flags);
+    LargeBuffer data;
+    if (!readBinaryFile(input, data, policy)) return DaemonStatus::IO_ERROR;
+    LargeBuffer result(cipher.requiredOutputSize(data.size(), encrypt), policy);
+    result.shrink(cipher.transform(data.bytes(), result.bytes(), encrypt));
+    return writeBinaryFile(output, result.bytes()) ? DaemonStatus::OK : DaemonStatus::IO_ERROR;
+}
+
+enum class ReadState { WAIT, READY, REJECTED, CLOSED };
+
+// Проверка запроса по заголовку и ключу, до приёма данных: иначе клиент
+// заставил бы сервер выделить и принять предельный объём под запрос,
+// который всё равно будет отклонён.
+DaemonStatus checkRequest(Connection& connection, CipherCache& cache, uint64_t maxPayload) {
+    const RequestHeader& header = connection.header;
+    if (header.payload > static_cast<uint8_t>(DaemonPayload::TEXT_FILE) || header.payloadLength > maxPayload) {
+        return DaemonStatus::BAD_REQUEST;
+    }
+    DaemonCipher type = static_cast<DaemonCipher>(header.cipher);
+    DaemonPayload kind = static_cast<DaemonPayload>(header.payload);
+    bool text = kind == DaemonPayload::TEXT || kind == DaemonPayload::TEXT_FILE;
+    span<const char> key(connection.key.data(), header.keyLength);
+    try {
+        connection.cipher = cache.get(type, key);
+        if (type == DaemonCipher::AFFINE && !affineKeyValid(key, text)) return DaemonStatus::BAD_KEY;
+    } catch (const exception&) {
+        return DaemonStatus::BAD_KEY;
+    }
+    return DaemonStatus::OK;
+}
+
+// Приём запроса в буферы соединения без блокировки: забирает из сокета всё,
+// что уже пришло. READY - запрос принят целиком; REJECTED - ответ с ошибкой
+// готов, после него соединение закрывается; CLOSED - разрыв или нарушение
+// протокола.
+ReadState readRequest(Connection& connection, CipherCache& cache, uint64_t maxPayload) {
+    while (true) {
+        char* target = nullptr;
+        size_t part = 0;
+        switch (connection.stage) {
+            case Connection::Stage::HEADER:
+                target = reinterpret_cast<char*>(&connection.header);
+                part = sizeof(connection.header);
+                break;
+            case Connection::Stage::KEY:
+                target = connection.key.data();
+                part = connection.header.keyLength;
+                break;
+            default: {
+                // Буфер данных растёт по мере прихода: заявленная длина сама
+                // по себе памяти не занимает
+                part = static_cast<size_t>(connection.header.payloadLength);
+                if (connection.received == connection.payload.size() && connection.received < part) {
+                    connection.payload.resize(min(part, max(connection.payload.size() * 2, SERVER_READ_STEP)));
+                }
+                target = connection.payload.data();
+                break;
+            }
+        }
+
+        size_t limit = connection.stage == Connection::Stage::PAYLOAD ? min(part, connection.payload.size()) : part;
+        if (connection.received < limit) {
+            ssize_t n = recv(connection.fd, target + connection.received, limit - connection.received, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReadState::WAIT;
+            if (n <= 0) return ReadState::CLOSED;
+            connection.received += static_cast<size_t>(n);
+            connection.lastActivity = chrono::steady_clock::now();
+            if (connection.received < part) continue;
+        }
+
+        connection.received = 0;
+        switch (connection.stage) {
+            case Connection::Stage::HEADER: {
+                const RequestHeader& header = connection.header;
+                if (header.magic != DAEMON_MAGIC || header.keyLength > DAEMON_MAX_KEY) return ReadState::CLOSED;
+                RGR_PROBE(request__begin, static_cast<int>(header.cipher), static_cast<int>(header.encrypt), static_cast<int>(header.payload), header.payloadLength);
+                if (connection.key.size() < header.keyLength) connection.key.resize(header.keyLength);
+                connection.stage = Connection::Stage::KEY;
+                break;
+            }
+            case Connection::Stage::KEY: {
+                DaemonStatus status = checkRequest(connection, cache, maxPayload);
+                if (status != DaemonStatus::OK) {
+                    setReply(connection, status);
+                    connection.closeAfterReply = true;
+                    return ReadState::REJECTED;
+                }
+                connection.stage = Connection::Stage::PAYLOAD;
+                break;
+            }
+            default: {
+                // Двоичные данные шифруются на месте - буфер вмещает результат
+                size_t capacity = static_cast<size_t>(connection.header.payloadLength);
+                if (static_cast<DaemonPayload>(connection.header.payload) == DaemonPayload::BINARY) {
+                    capacity = max(capacity, connection.cipher->requiredOutputSize(capacity, connection.header.encrypt != 0));
+                }
+                if (connection.payload.size() < capacity) connection.payload.resize(capacity);
+                return ReadState::READY;
+            }
+        }
+    }
+}
+
+// Выполнение целиком принятого запроса в потоке пула; ответ остаётся в
+// соединении (setReply).
+void serveRequest(Connection& connection) {
+    const Cipher& cipher = *connection.cipher;
+    DaemonPayload kind = static_cast<DaemonPayload>(connection.header.payload);
+    bool encrypt = connection.header.encrypt != 0;
+    size_t length = static_cast<size_t>(connection.header.payloadLength);
+    span<char> payload(connection.payload);
+
+    ArenaScope scope;
+    try {
+        switch (kind) {
+            case DaemonPayload::BINARY: {
+                span<unsigned char> buffer(reinterpret_cast<unsigned char*>(payload.data()), payload.size());
+                size_t size = cipher.transformInPlace(buffer, length, encrypt);
+                setReply(connection, DaemonStatus::OK, payload.first(size));
+                return;
+            }
+            case DaemonPayload::TEXT: {
+                span<wchar_t> wide = scope.allocate<wchar_t>(cipher.requiredOutputSize(length, encrypt));
+                size_t count = cipherKernels().decodeUtf8(reinterpret_cast<const unsigned char*>(payload.data()), length, wide.data());
+                if (count == UTF8_ERROR) {
+                    setReply(connection, DaemonStatus::BAD_REQUEST);
+                    return;
+                }
+                size_t size = cipher.transformInPlace(wide, count, encrypt);
+                if (connection.reply.size() < size * 4) connection.reply.resize(size * 4);
+                size_t bytes = encodeUtf8(wide.data(), size, connection.reply.data());
+                if (bytes == UTF8_ERROR) {
+                    setReply(connection, DaemonStatus::INTERNAL_ERROR);
+                    return;
+                }
+                setReply(connection, DaemonStatus::OK, span<const char>(connection.reply.data(), bytes));
+                return;
+            }
+            case DaemonPayload::BINARY_FILE:
+            case DaemonPayload::TEXT_FILE:
+                setReply(connection, processFile(cipher, kind, encrypt, connection.header.flags, payload.first(length)));
+                return;
+        }
+    } catch (const exception& e) {
+        wcerr << L"Ошибка обработки запроса: " << e.what() << endl;
+    }
+    setReply(connection, DaemonStatus::INTERNAL_ERROR);
+}
+
+// Соединение снова ждёт в epoll: следующего запроса (EPOLLIN) или места в
+// сокете для остатка ответа (EPOLLOUT).
+bool watchConnection(int epoll, int fd, int operation, uint32_t events = EPOLLIN) {
+    epoll_event event = {};
+    event.events = events | EPOLLONESHOT;
+    event.data.fd = fd;
+    return epoll_ctl(epoll, operation, fd, &event) == 0;
+}
+
+// После попытки отправить ответ: готовит соединение к следующему запросу или
+// к дописыванию ответа и возвращает его в epoll. false - соединение закрыть.
+bool continueConnection(Connection& connection, SendState state, int epoll) {
+    if (state == SendState::FAILED || (state == SendState::DONE && connection.closeAfterReply)) return false;
+    uint32_t events = EPOLLOUT;
+    if (state == SendState::DONE) {
+        connection.stage = Connection::Stage::HEADER;
+        connection.received = 0;
+        connection.cipher.reset();
+        connection.replyData = {};
+        // Буферы остаются для следующих запросов, кроме больших
+        if (connection.payload.size() > SERVER_RETAIN_BUFFER) vector<char>().swap(connection.payload);
+        if (connection.reply.size() > SERVER_RETAIN_BUFFER) vector<char>().swap(connection.reply);
+        events = EPOLLIN;
+    } else {
+        connection.stage = Connection::Stage::REPLY;
+    }
+    connection.lastActivity = chrono::steady_clock::now();
+    // После busy == false соединением снова владеет цикл и может закрыть и
+    // удалить его, как только оно вернётся в epoll, - дальше только копия fd
+    const int fd = connection.fd;
+    connection.busy.store(false, memory_order_release);
+    return watchConnection(epoll, fd, EPOLL_CTL_MOD, events);
+}
+
+// Предел данных одного запроса: RGR_MAX_PAYLOAD (байт) или DAEMON_DEFAULT_MAX_PAYLOAD.
+// Текст при обработке занимает ещё до восьми таких объёмов (wchar_t и UTF-8).
+uint64_t serverMaxPayload() {
+    const char* value = getenv("RGR_MAX_PAYLOAD");
+    if (value && *value) {
+        char* end = nullptr;
+        unsigned long long parsed = strtoull(value, &end, 10);
+        if (end && *end == '\0' && parsed > 0) return parsed;
+        wcerr << L"Недопустимое значение RGR_MAX_PAYLOAD, используется " << DAEMON_DEFAULT_MAX_PAYLOAD << endl;
+    }
+    return DAEMON_DEFAULT_MAX_PAYLOAD;
+}
+
+int openListener(const string& socketPath) {
+    sockaddr_un address;
+    if (!fillSocketAddress(socketPath.c_str(), address)) {
+        wcerr << L"Слишком длинный путь к сокету." << endl;
+        return -1;
+    }
+
+    // Сокет от завершившегося сервера удаляем, работающий не трогаем
+    int probe = connectDaemon(socketPath.c_str());
+    if (probe >= 0) {
+        close(probe);
+        wcerr << L"Сервер уже запущен на этом сокете." << endl;
+        return -1;
+    }
+    unlink(socketPath.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    // Сокет сразу создаётся доступным только владельцу: chmod после bind
+    // оставил бы окно, в которое может подключиться кто угодно. Потоков ещё
+    // нет, поэтому смена umask процесса ни на что больше не влияет
+    mode_t previous = umask(0077);
+    bool bound = bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    umask(previous);
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}
+
+int runServer(const string& socketPath, unsigned workers) {
+    if (workers == 0) {
+        workers = max(1u, thread::hardware_concurrency());
+    }
+
+    int listener = openListener(socketPath);
+    if (listener < 0) {
+        wcerr << L"Не удалось открыть сокет " << s2ws(socketPath) << endl;
+        return 1;
+    }
+    if (pipe2(stopPipe, O_CLOEXEC) != 0) {
+        close(listener);
+        return 1;
+    }
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event control = {};
+    control.events = EPOLLIN;
+    control.data.fd = listener;
+    bool watching = epoll >= 0 && epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &control) == 0;
+    control.data.fd = stopPipe[0];
+    watching = watching && epoll_ctl(epoll, EPOLL_CTL_ADD, stopPipe[0], &control) == 0;
+    if (!watching) {
+        if (epoll >= 0) close(epoll);
+        close(listener);
+        unlink(socketPath.c_str());
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+        return 1;
+    }
+
+    uint64_t maxPayload = serverMaxPayload();
+    CipherCache cache;
+    RequestQueue queue;
+    ConnectionSet connections;
+    vector<thread> pool;
+    for (unsigned i = 0; i < workers; i++) {
+        pool.emplace_back([&queue, &connections, epoll]() {
+            Connection* connection;
+            while (queue.pop(connection)) {
+                const int fd = connection->fd;
+                serveRequest(*connection);
+                if (!continueConnection(*connection, sendReply(*connection), epoll)) connections.close(fd);
+            }
+        });
+    }
+
+    wcout << L"Сервер слушает " << s2ws(socketPath) << L", потоков: " << workers
+          << L", предел данных запроса: " << maxPayload << L" байт" << endl;
+
+    epoll_event events[64];
+    bool running = true;
+    auto lastSweep = chrono::steady_clock::now();
+    while (running) {
+        int count = epoll_wait(epoll, events, 64, SERVER_SWEEP_INTERVAL_MS);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stopPipe[0]) {
+                running = false;
+            } else if (fd == listener) {
+                int accepted = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+                if (accepted < 0) continue;
+                connections.add(accepted);
+                if (!watchConnection(epoll, accepted, EPOLL_CTL_ADD)) connections.close(accepted);
+            } else if (Connection* connection = connections.find(fd)) {
+                // Пока запрос не принят целиком, соединение обслуживает этот цикл.
+                // Событие приходит только после того, как поток пула вернул
+                // соединение; чтение busy (acquire) делает его записи видимыми
+                if (connection->busy.load(memory_order_acquire)) continue;
+                bool keep;
+                if (connection->stage == Connection::Stage::REPLY) {
+                    keep = continueConnection(*connection, sendReply(*connection), epoll);
+                } else {
+                    switch (readRequest(*connection, cache, maxPayload)) {
+                        case ReadState::WAIT:
+                            keep = watchConnection(epoll, fd, EPOLL_CTL_MOD);
+                            break;
+                        case ReadState::READY:
+                            connection->busy.store(true, memory_order_relaxed);
+                            queue.push(connection);
+                            keep = true;
+                            break;
+                        case ReadState::REJECTED:
+                            keep = continueConnection(*connection, sendReply(*connection), epoll);
+                            break;
+                        default:
+                            keep = false;
+                            break;
+                    }
+                }
+                if (!keep) connections.close(fd);
+            }
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (now - lastSweep >= chrono::milliseconds(SERVER_SWEEP_INTERVAL_MS)) {
+            connections.closeStalled(now - chrono::milliseconds(SERVER_STALL_TIMEOUT_MS));
+            lastSweep = now;
+        }
+    }
+
+    queue.stop();
+    for (thread& worker : pool) {
+        worker.join();
+    }
+    connections.closeAll();
+    close(epoll);
+    close(listener);
+    unlink(socketPath.c_str());
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    wcout << L"Сервер остановлен." << endl;
+    return 0;
+}
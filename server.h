@@ -0,0 +1,17 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+// Резидентный режим: запросы на шифрование принимаются через Unix-сокет
+// (протокол - daemon_protocol.h) и выполняются пулом потоков. Соединения
+// неблокирующие и ждут в epoll; запрос принимается в буферы соединения
+// циклом epoll и попадает к потоку, только когда пришёл целиком. Соединение,
+// застрявшее посреди запроса или ответа, закрывается. Объекты шифров
+// с подготовленными ключами (порядок столбцов таблицы и т.п.) кэшируются
+// между запросами. Работает до SIGINT/SIGTERM; workers == 0 - по числу ядер.
+const unsigned SERVER_MAX_WORKERS = 1024;
+
+int runServer(const std::string& socketPath, unsigned workers);
+
+#endif
@@ -0,0 +1,167 @@
+#include "shard.h"
+#include "table_file.h"
+#include "execution_plan.h"
+#include "file_utils.h"
+#include "large_buffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace {
+
+const uint64_t SHARD_ALIGN = 4096;  // границы байтовых частей - по страницам
+
+struct ShardLayout {
+    uint64_t inputSize = 0;
+    uint64_t units = 0;       // байт у Аффинного шифра, строк матрицы у перестановок
+    uint64_t outputSize = 0;
+    vector<uint64_t> columnOrder;
+};
+
+bool shardLayout(int in, const CipherKey& key, bool encrypt, ShardLayout& layout) {
+    struct stat info;
+    if (fstat(in, &info) != 0 || info.st_size == 0) return false;
+    layout.inputSize = static_cast<uint64_t>(info.st_size);
+    if (key.cipher == ContainerCipher::AFFINE) {
+        layout.units = layout.inputSize;
+        layout.outputSize = layout.inputSize;
+        return true;
+    }
+    layout.columnOrder = permutationColumns(key);
+    uint64_t width = static_cast<uint64_t>(layout.columnOrder.size());
+    if (width == 0) return false;
+    if (key.cipher == ContainerCipher::SKYTALE && !encrypt && layout.inputSize % width != 0) return false;
+    layout.units = tableFileRows(layout.inputSize, width, encrypt);
+    layout.outputSize = layout.units * width;
+    return true;
+}
+
+// Выход - сам вход (в том числе через ссылку): части пишутся, пока другие
+// процессы ещё читают вход, а подготовка выхода его усекла бы.
+bool isInputFile(int in, const wstring& output) {
+    struct stat input, info;
+    return fstat(in, &input) == 0 && stat(ws2s(output).c_str(), &info) == 0 && input.st_dev == info.st_dev &&
+           input.st_ino == info.st_ino;
+}
+
+void shardRange(const ShardLayout& layout, bool bytes, unsigned index, unsigned count, uint64_t& first,
+                uint64_t& last) {
+    uint64_t step = (layout.units + count - 1) / count;
+    if (bytes) step = (step + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+    first = min(layout.units, index * step);
+    last = min(layout.units, first + step);
+}
+
+// Аффинный шифр: байт результата на месте байта входа.
+bool substituteRange(int in, int out, const Cipher& cipher, bool encrypt, uint64_t first, uint64_t last,
+                     uint64_t memoryBudget) {
+    LargeBuffer buffer(static_cast<size_t>(min(last - first, max(SHARD_ALIGN, memoryBudget))));
+    posix_fadvise(in, static_cast<off_t>(first), static_cast<off_t>(last - first), POSIX_FADV_SEQUENTIAL);
+    for (uint64_t offset = first; offset < last; offset += buffer.size()) {
+        size_t length = static_cast<size_t>(min<uint64_t>(buffer.size(), last - offset));
+        if (!preadAll(in, buffer.data(), length, offset)) return false;
+        cipher.transformInPlace(buffer.bytes(), length, encrypt);
+        if (!pwriteAll(out, buffer.data(), length, offset)) return false;
+    }
+    return true;
+}
+
+}
+
+bool prepareShardedOutput(const wstring& input, const wstring& output, const CipherKey& key, bool encrypt) {
+    makeCipher(key);
+    int in = ::open(ws2s(input).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    ShardLayout layout;
+    bool ok = !isInputFile(in, output) && shardLayout(in, key, encrypt, layout);
+    ::close(in);
+    if (!ok) return false;
+
+    int out = ::open(ws2s(output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return false;
+    ok = ftruncate(out, static_cast<off_t>(layout.outputSize)) == 0;
+    return ::close(out) == 0 && ok;
+}
+
+bool runShard(const wstring& input, const wstring& output, const CipherKey& key, bool encrypt, unsigned index,
+              unsigned count, uint64_t memoryBudget) {
+    unique_ptr<Cipher> cipher = makeCipher(key);
+    if (count == 0 || index >= count) return false;
+    int in = ::open(ws2s(input).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    ShardLayout layout;
+    struct stat info;
+    int out = -1;
+    // Выход должен быть подготовлен: по его размеру видно, что это тот же вход и ключ
+    bool ok = !isInputFile(in, output) && shardLayout(in, key, encrypt, layout) &&
+              (out = ::open(ws2s(output).c_str(), O_WRONLY | O_CLOEXEC)) >= 0 &&
+              fstat(out, &info) == 0 && static_cast<uint64_t>(info.st_size) == layout.outputSize;
+
+    if (ok) {
+        const bool bytes = key.cipher == ContainerCipher::AFFINE;
+        uint64_t first, last;
+        shardRange(layout, bytes, index, count, first, last);
+        if (first < last) {
+            ok = bytes ? substituteRange(in, out, *cipher, encrypt, first, last, memoryBudget)
+                       : transposeTableRows(in, layout.inputSize, out, layout.columnOrder, encrypt, first, last,
+                                            tableBandRows(layout.columnOrder.size(), memoryBudget));
+        }
+    }
+    if (out >= 0) ok = ::close(out) == 0 && ok;
+    ::close(in);
+    return ok;
+}
+
+bool finishShardedOutput(const wstring& output, const CipherKey& key, bool encrypt) {
+    if (key.cipher != ContainerCipher::TABLE || encrypt) return true;
+    int fd = ::open(ws2s(output).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && trimTablePadding(fd, static_cast<uint64_t>(info.st_size));
+    return ::close(fd) == 0 && ok;
+}
+
+bool transformFileSharded(const wstring& input, const wstring& output, const CipherKey& key, bool encrypt,
+                          unsigned processes, uint64_t memoryBudget) {
+    if (!prepareShardedOutput(input, output, key, encrypt)) {
+        return transformBinaryFile("shard.fallback", input, output, key, encrypt) == FileResult::OK;
+    }
+
+    processes = max(1u, processes);
+    vector<pid_t> workers;
+    bool ok = true;
+    for (unsigned index = 0; index < processes; index++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            bool done = false;
+            try {
+                done = runShard(input, output, key, encrypt, index, processes, memoryBudget);
+            } catch (const exception&) {
+                done = false;
+            }
+            _exit(done ? 0 : 1);
+        }
+        if (pid < 0) {
+            ok = false;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    for (pid_t pid : workers) {
+        int status = -1;  // waitpid не удался - как ошибка процесса
+        pid_t waited;
+        do {
+            waited = waitpid(pid, &status, 0);
+        } while (waited < 0 && errno == EINTR);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok && finishShardedOutput(output, key, encrypt);
+}
@@ -0,0 +1,46 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "container.h"
+#include <string>
+#include <cstdint>
+
+// Обработка одного большого файла несколькими процессами: у каждого свои
+// ограничения памяти и дескрипторов. Вход делится на части, каждый процесс
+// пишет свою часть прямо на её место в заранее созданном выходном файле:
+//   - Аффинный шифр - по диапазонам байт, результат лежит там же, где вход
+//     (части просто идут подряд);
+//   - Скитала и таблица - по диапазонам строк матрицы (transposeTableRows,
+//     table_file.h), место каждой строки в выходе вычисляется.
+// Шаги доступны по отдельности - для процессов на других машинах с общим
+// хранилищем: prepareShardedOutput один раз, runShard для каждой части в любом
+// порядке и где угодно, finishShardedOutput после всех частей.
+//
+// Скиталу нельзя делить при расшифровании входа, длина которого не кратна
+// ключу (такой вход не получается шифрованием): prepareShardedOutput вернёт false.
+
+const uint64_t SHARD_DEFAULT_MEMORY = 256 << 20;  // бюджет полос или блока одного процесса
+
+// Создаёт выходной файл нужного размера. false при ошибке ввода-вывода, пустом
+// или неделимом входе, а также если выход - сам вход (тот же st_dev/st_ino):
+// части на месте входа испортили бы его для остальных процессов;
+// invalid_argument для недопустимого ключа.
+bool prepareShardedOutput(const std::wstring& input, const std::wstring& output, const CipherKey& key,
+                          bool encrypt);
+
+// Часть index из count (index < count); выход - сам вход - false.
+bool runShard(const std::wstring& input, const std::wstring& output, const CipherKey& key, bool encrypt,
+              unsigned index, unsigned count, uint64_t memoryBudget = SHARD_DEFAULT_MEMORY);
+
+// После всех частей: при расшифровании таблицей отрезает нулевое дополнение.
+bool finishShardedOutput(const std::wstring& output, const CipherKey& key, bool encrypt);
+
+// Все шаги на processes локальных процессах (fork). Вызывать до запуска
+// других потоков: дочерний процесс получает только вызвавший поток. Неделимый
+// вход и выход на месте входа обрабатываются в этом процессе
+// (transformBinaryFile, execution_plan.h; на месте входа - через временный файл).
+// false, если какой-то процесс завершился с ошибкой или был убит.
+bool transformFileSharded(const std::wstring& input, const std::wstring& output, const CipherKey& key,
+                          bool encrypt, unsigned processes, uint64_t memoryBudget = SHARD_DEFAULT_MEMORY);
+
+#endif
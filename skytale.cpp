@@ -1,5 +1,10 @@
 #include "skytale.h"
 #include "file_utils.h"
+#include "metrics.h"
+#include "execution_plan.h"
+#include "parallel.h"
+#include "transposition.h"
+#include "arena.h"
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -9,6 +14,8 @@
 #include <random>
 #include <stdexcept>
 #include <cstdint>
+#include <span>
+#include <algorithm>
 
 using namespace std;
 
@@ -19,79 +26,96 @@ enum class ObjectType {
     KEY_GENERATION = 4
 };
 
+uint64_t skytaleOutputSize(uint64_t length, uint64_t key, bool encrypt) {
+    if (key <= 0 || length == 0 || !encrypt) return length;
+
+    uint64_t columns = (length + key - 1) / key;
+    return key * columns;
+}
+
+// Скитала - перестановка строк матрицы key x columns в столбцы (transposition.h)
+template <typename T>
+static uint64_t skytaleKernel(span<const T> input, span<T> result, uint64_t key, bool encrypt, T pad) {
+    uint64_t length = static_cast<uint64_t>(input.size());
+    uint64_t outputSize = skytaleOutputSize(length, key, encrypt);
+    if (static_cast<uint64_t>(result.size()) < outputSize) {
+        throw length_error("skytale: output buffer is too small");
+    }
+    if (key <= 0 || length == 0) {
+        copy(input.begin(), input.end(), result.begin());
+        return length;
+    }
+
+    uint64_t columns = (length + key - 1) / key;
+    if (encrypt) {
+        transposeEncrypt(input.data(), length, result.data(), columns, SkytaleOrder{ key }, pad);
+    } else {
+        transposeDecrypt(input.data(), length, result.data(), length, columns, SkytaleOrder{ key }, pad);
+    }
+    return outputSize;
+}
+
+template <typename T>
+static uint64_t skytaleInPlaceKernel(span<T> buffer, uint64_t length, uint64_t key, bool encrypt, T pad) {
+    uint64_t outputSize = skytaleOutputSize(length, key, encrypt);
+    if (static_cast<uint64_t>(buffer.size()) < outputSize || static_cast<uint64_t>(buffer.size()) < length) {
+        throw length_error("skytale: buffer is too small");
+    }
+    if (key <= 0 || length == 0) return length;
+
+    uint64_t columns = (length + key - 1) / key;
+    if (encrypt) {
+        transposeEncryptInPlace(buffer.data(), length, columns, SkytaleOrder{ key }, pad);
+    } else if (length == key * columns) {
+        transposeDecryptInPlace(buffer.data(), columns, SkytaleOrder{ key });
+    } else {
+        // Длина не кратна ключу - это не перестановка, работаем через копию
+        ArenaScope scope;
+        span<T> source = scope.allocate<T>(static_cast<size_t>(length));
+        copy(buffer.begin(), buffer.begin() + length, source.begin());
+        skytaleKernel<T>(span<const T>(source), buffer, key, false, pad);
+    }
+    return outputSize;
+}
+
+uint64_t transformSkytaleText(span<const wchar_t> text, span<wchar_t> result, uint64_t key, bool encrypt) {
+    return skytaleKernel<wchar_t>(text, result, key, encrypt, L' ');
+}
+
+uint64_t transformSkytaleBinary(span<const unsigned char> data, span<unsigned char> result, uint64_t key, bool encrypt) {
+    return skytaleKernel<unsigned char>(data, result, key, encrypt, 0);
+}
+
+uint64_t transformSkytaleTextInPlace(span<wchar_t> buffer, uint64_t length, uint64_t key, bool encrypt) {
+    return skytaleInPlaceKernel<wchar_t>(buffer, length, key, encrypt, L' ');
+}
+
+uint64_t transformSkytaleBinaryInPlace(span<unsigned char> buffer, uint64_t length, uint64_t key, bool encrypt) {
+    return skytaleInPlaceKernel<unsigned char>(buffer, length, key, encrypt, 0);
+}
+
 wstring transformSkytaleConsole(const wstring& text, uint64_t key, bool encrypt) {
-    if (key <= 0) return text;
+    if (key <= 0 || text.empty()) return text;
 
     uint64_t length = static_cast<uint64_t>(text.length());
     uint64_t columns = (length - 1) / key + 1;
 
-    wstring result(key*columns, L' ');
-    for (uint64_t i = 0; i < length; i++) {
-        uint64_t index = key * (i % columns) + i / columns;
-        if (encrypt) {
-            result[index] = text[i];
-        } else {
-            result[i] = text[index];
-        }
-    }
+    wstring result = transformSkytaleText(text, key, encrypt);
+    result.resize(static_cast<size_t>(key * columns), L' ');
     return result;
 }
 
 wstring transformSkytaleText(const wstring& text, uint64_t key, bool encrypt) {
-    if (key <= 0) return text;
-
     uint64_t length = static_cast<uint64_t>(text.length());
-    if (length == 0) return text;
-    
-    uint64_t columns = (length + key - 1) / key;
-    uint64_t matrix_size = key * columns;
-    uint64_t padding = matrix_size - length;
-    
-    wstring work_text = text;
-    
-    if (encrypt) {
-        work_text += wstring(padding, L' ');
-    }
-    wstring result(work_text.length(), L' ');
-    for (uint64_t i = 0; i < work_text.length(); i++) {
-        uint64_t index = key * (i % columns) + i / columns;
-        if (encrypt) {
-            result[index] = work_text[i];
-        } else {
-            result[i] = work_text[index];
-        }
-    }
-    if (!encrypt) {
-        result = result.substr(0, static_cast<size_t>(length));
-    }
+    wstring result(static_cast<size_t>(skytaleOutputSize(length, key, encrypt)), L' ');
+    transformSkytaleText(span<const wchar_t>(text), span<wchar_t>(result), key, encrypt);
     return result;
 }
 
 vector<unsigned char> transformSkytaleBinary(const vector<unsigned char>& data, uint64_t key, bool encrypt) {
-    if (key <= 0 || data.empty()) return data;
-
     uint64_t length = static_cast<uint64_t>(data.size());
-    uint64_t columns = (length + key - 1) / key;
-    uint64_t matrix_size = key * columns;
-    uint64_t padding = matrix_size - length;
-    
-    vector<unsigned char> work_data = data;
-    
-    if (encrypt) {
-        work_data.insert(work_data.end(), static_cast<size_t>(padding), 0);
-    }
-    vector<unsigned char> result(work_data.size(), 0);
-    for (uint64_t i = 0; i < static_cast<uint64_t>(work_data.size()); i++) {
-        uint64_t index = key * (i % columns) + i / columns;
-        if (encrypt) {
-            result[static_cast<size_t>(index)] = work_data[static_cast<size_t>(i)];
-        } else {
-            result[static_cast<size_t>(i)] = work_data[static_cast<size_t>(index)];
-        }
-    }
-    if (!encrypt) {
-        result.resize(static_cast<size_t>(length));
-    }
+    vector<unsigned char> result(static_cast<size_t>(skytaleOutputSize(length, key, encrypt)));
+    transformSkytaleBinary(span<const unsigned char>(data), span<unsigned char>(result), key, encrypt);
     return result;
 }
 
@@ -170,13 +194,19 @@ void skytale() {
                 wstring decryptedFilename;
                 getline(wcin, decryptedFilename);
 
+                OperationMetrics metrics("skytale.text_file");
+                WorkerThreadsScope threads(planTextThreads("skytale.text_file", inputFilename, ContainerCipher::SKYTALE, true));
                 wstring originalText = readTextFile(inputFilename);
                 if (originalText.empty()) {
                     wcout << L"Не удалось прочитать файл или файл пуст." << endl;
                     break;
                 }
 
-                wstring encryptedText = transformSkytaleText(originalText, key, true);
+                wstring encryptedText;
+                {
+                    StageTimer timer(MetricStage::ENCRYPT, originalText.size() * sizeof(wchar_t));
+                    encryptedText = transformSkytaleText(originalText, key, true);
+                }
                 if (writeTextFile(encryptedFilename, encryptedText)) {
                     wcout << L"Текст успешно зашифрован и записан в: " << encryptedFilename << endl;
                 } else {
@@ -184,7 +214,11 @@ void skytale() {
                     break;
                 }
 
-                wstring decryptedText = transformSkytaleText(encryptedText, key, false);
+                wstring decryptedText;
+                {
+                    StageTimer timer(MetricStage::DECRYPT, encryptedText.size() * sizeof(wchar_t));
+                    decryptedText = transformSkytaleText(encryptedText, key, false);
+                }
                 if (writeTextFile(decryptedFilename, decryptedText)) {
                     wcout << L"Текст успешно расшифрован и записан в: " << decryptedFilename << endl;
                 } else {
@@ -206,22 +240,23 @@ void skytale() {
                 wstring decryptedImage;
                 getline(wcin, decryptedImage);
 
-                vector<unsigned char> originalData = readBinaryFile(inputImage);
-                if (originalData.empty()) {
+                OperationMetrics metrics("skytale.image_file");
+                CipherKey cipherKey;
+                cipherKey.cipher = ContainerCipher::SKYTALE;
+                cipherKey.key = key;
+                FileResult result = transformBinaryFile("skytale.image_file", inputImage, encryptedImage, cipherKey, true);
+                if (result == FileResult::READ_FAILED) {
                     wcout << L"Не удалось прочитать изображение или файл пуст." << endl;
                     break;
                 }
-
-                vector<unsigned char> encryptedData = transformSkytaleBinary(originalData, key, true);
-                if (writeBinaryFile(encryptedImage, encryptedData)) {
+                if (result == FileResult::OK) {
                     wcout << L"Изображение зашифровано и записано в: " << encryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи зашифрованного изображения." << endl;
                     break;
                 }
 
-                vector<unsigned char> decryptedData = transformSkytaleBinary(encryptedData, key, false);
-                if (writeBinaryFile(decryptedImage, decryptedData)) {
+                if (transformBinaryFile("skytale.image_file", encryptedImage, decryptedImage, cipherKey, false) == FileResult::OK) {
                     wcout << L"Изображение расшифровано и записано в: " << decryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи расшифрованного изображения." << endl;
@@ -4,11 +4,25 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <span>
 
 std::wstring transformSkytaleConsole(const std::wstring& text, uint64_t key, bool encrypt);
 std::wstring transformSkytaleText(const std::wstring& text, uint64_t key, bool encrypt);
 std::vector<unsigned char> transformSkytaleBinary(const std::vector<unsigned char>& data, uint64_t key, bool encrypt);
 
+// Размер результата для входа длины length (при шифровании - с дополнением до key * columns).
+uint64_t skytaleOutputSize(uint64_t length, uint64_t key, bool encrypt);
+
+// Варианты без выделения памяти: возвращают число записанных элементов.
+// Входной и выходной буферы не должны пересекаться.
+uint64_t transformSkytaleText(std::span<const wchar_t> text, std::span<wchar_t> result, uint64_t key, bool encrypt);
+uint64_t transformSkytaleBinary(std::span<const unsigned char> data, std::span<unsigned char> result, uint64_t key, bool encrypt);
+
+// Преобразование на месте: первые length элементов buffer - вход,
+// buffer должен вмещать skytaleOutputSize(length, key, encrypt) элементов.
+uint64_t transformSkytaleTextInPlace(std::span<wchar_t> buffer, uint64_t length, uint64_t key, bool encrypt);
+uint64_t transformSkytaleBinaryInPlace(std::span<unsigned char> buffer, uint64_t length, uint64_t key, bool encrypt);
+
 uint64_t generateSkytaleKey(uint64_t min_value, uint64_t max_value);
 
 void skytale();
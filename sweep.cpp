@@ -0,0 +1,211 @@
+#include "sweep.h"
+#include "file_utils.h"
+#include "large_buffer.h"
+#include "metrics.h"
+#include "arena.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <atomic>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+const size_t SWEEP_BLOCK = 256 << 10;      // байт входа на один проход по ключам - остаётся в L2
+const size_t SWEEP_TEXT_BLOCK = 64 << 10;  // символов текста (256 КБ wchar_t)
+
+struct PreparedSweep {
+    vector<unique_ptr<Cipher>> ciphers;
+    vector<size_t> substitution;  // Аффинный шифр - общий проход
+    vector<size_t> permutation;
+};
+
+// Все шифры создаются до начала работы: недопустимый ключ не оставит
+// половину выходов записанными.
+PreparedSweep prepareSweep(const vector<SweepTarget>& targets) {
+    PreparedSweep prepared;
+    for (size_t i = 0; i < targets.size(); i++) {
+        prepared.ciphers.push_back(makeCipher(targets[i].key));
+        if (targets[i].key.cipher == ContainerCipher::AFFINE) prepared.substitution.push_back(i);
+        else prepared.permutation.push_back(i);
+    }
+    return prepared;
+}
+
+// Перестановки: по ключу на поток; если ключей меньше потоков, - по одному,
+// и тогда каждый сам делит матрицу на полосы по всем потокам.
+template <typename Job>
+void forEachPermutation(const vector<size_t>& indices, Job job) {
+    if (indices.size() >= workerThreads()) {
+        parallelFor(indices.size(), 0, [&](uint64_t i) {
+            job(indices[i]);
+            return true;
+        });
+    } else {
+        for (size_t i : indices) job(i);
+    }
+}
+
+// Выход, который оказался самим входом (в том числе через ссылку), не
+// пишется: его усечение испортило бы вход, пока его читают остальные ключи.
+void rejectInputTargets(const struct stat& input, const vector<SweepTarget>& targets, vector<atomic<bool>>& failed) {
+    for (size_t i = 0; i < targets.size(); i++) {
+        struct stat info;
+        if (stat(ws2s(targets[i].output).c_str(), &info) == 0 && info.st_dev == input.st_dev &&
+            info.st_ino == input.st_ino) {
+            failed[i] = true;
+        }
+    }
+}
+
+MetricStage cipherStage(bool encrypt) {
+    return encrypt ? MetricStage::ENCRYPT : MetricStage::DECRYPT;
+}
+
+}
+
+bool sweepBinaryFile(const wstring& input, const vector<SweepTarget>& targets, bool encrypt, vector<bool>& written) {
+    PreparedSweep prepared = prepareSweep(targets);
+    written.assign(targets.size(), false);
+
+    int in = ::open(ws2s(input).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat info;
+    const uint64_t size = fstat(in, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    if (size == 0) {
+        ::close(in);
+        return false;
+    }
+
+    // Вход из страничного кэша без копии; не отобразился - читается в память
+    LargeBuffer copy;
+    void* mapped = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, in, 0);
+    const unsigned char* data = static_cast<const unsigned char*>(mapped);
+    if (mapped == MAP_FAILED) {
+        copy = LargeBuffer(static_cast<size_t>(size));
+        StageTimer timer(MetricStage::READ, size);
+        if (!preadAll(in, copy.data(), copy.size(), 0)) {
+            ::close(in);
+            return false;
+        }
+        data = copy.data();
+    } else {
+        madvise(mapped, static_cast<size_t>(size), MADV_WILLNEED);
+    }
+    ::close(in);
+    span<const unsigned char> source(data, static_cast<size_t>(size));
+
+    vector<atomic<bool>> failed(targets.size());
+    rejectInputTargets(info, targets, failed);
+    vector<int> outputs(targets.size(), -1);
+    for (size_t i : prepared.substitution) {
+        if (failed[i]) continue;
+        outputs[i] = ::open(ws2s(targets[i].output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (outputs[i] < 0) failed[i] = true;
+    }
+    if (!prepared.substitution.empty()) {
+        // Потоки делят вход по блокам; блок проходит все аффинные ключи подряд
+        StageTimer timer(cipherStage(encrypt), size * prepared.substitution.size());
+        uint64_t blocks = (size + SWEEP_BLOCK - 1) / SWEEP_BLOCK;
+        parallelFor(blocks, 0, [&](uint64_t block) {
+            uint64_t offset = block * SWEEP_BLOCK;
+            size_t length = static_cast<size_t>(min<uint64_t>(SWEEP_BLOCK, size - offset));
+            span<const unsigned char> chunk = source.subspan(static_cast<size_t>(offset), length);
+            ArenaScope scope;
+            span<unsigned char> result = scope.allocate<unsigned char>(length);
+            for (size_t i : prepared.substitution) {
+                if (failed[i]) continue;
+                prepared.ciphers[i]->transform(chunk, result, encrypt);
+                if (!pwriteAll(outputs[i], result.data(), length, offset)) failed[i] = true;
+            }
+            return true;
+        });
+    }
+    for (size_t i : prepared.substitution) {
+        if (outputs[i] >= 0 && ::close(outputs[i]) != 0) failed[i] = true;
+    }
+
+    forEachPermutation(prepared.permutation, [&](size_t i) {
+        if (failed[i]) return;
+        const Cipher& cipher = *prepared.ciphers[i];
+        LargeBuffer result(cipher.requiredOutputSize(source.size(), encrypt));
+        {
+            StageTimer timer(cipherStage(encrypt), size);
+            result.shrink(cipher.transform(source, result.bytes(), encrypt));
+        }
+        if (!writeBinaryFile(targets[i].output, result.bytes())) failed[i] = true;
+    });
+
+    if (mapped != MAP_FAILED) munmap(mapped, static_cast<size_t>(size));
+    for (size_t i = 0; i < targets.size(); i++) written[i] = !failed[i];
+    return true;
+}
+
+bool sweepTextFile(const wstring& input, const vector<SweepTarget>& targets, bool encrypt, vector<bool>& written) {
+    PreparedSweep prepared = prepareSweep(targets);
+    written.assign(targets.size(), false);
+
+    struct stat info;
+    if (stat(ws2s(input).c_str(), &info) != 0) return false;
+    const wstring text = readTextFile(input);
+    if (text.empty()) return false;
+    span<const wchar_t> source(text);
+    vector<atomic<bool>> failed(targets.size());
+    rejectInputTargets(info, targets, failed);
+
+    if (!prepared.substitution.empty()) {
+        // Длина UTF-8 выхода известна только по порядку, поэтому потоки делят
+        // не вход, а ключи: у каждого своя группа и общий проход по входу
+        size_t groups = min<size_t>(workerThreads(), prepared.substitution.size());
+        StageTimer timer(cipherStage(encrypt), text.size() * sizeof(wchar_t) * prepared.substitution.size());
+        parallelFor(groups, static_cast<unsigned>(groups), [&](uint64_t group) {
+            vector<size_t> mine;
+            for (size_t j = group; j < prepared.substitution.size(); j += groups) mine.push_back(prepared.substitution[j]);
+            vector<int> outputs;
+            vector<uint64_t> offsets(mine.size(), 0);
+            for (size_t i : mine) {
+                outputs.push_back(failed[i] ? -1 : ::open(ws2s(targets[i].output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+                if (outputs.back() < 0) failed[i] = true;
+            }
+
+            ArenaScope scope;
+            span<wchar_t> result = scope.allocate<wchar_t>(SWEEP_TEXT_BLOCK);
+            span<char> utf8 = scope.allocate<char>(4 * SWEEP_TEXT_BLOCK);
+            for (size_t position = 0; position < text.size(); position += SWEEP_TEXT_BLOCK) {
+                size_t length = min(SWEEP_TEXT_BLOCK, text.size() - position);
+                span<const wchar_t> chunk = source.subspan(position, length);
+                for (size_t k = 0; k < mine.size(); k++) {
+                    size_t i = mine[k];
+                    if (failed[i]) continue;
+                    prepared.ciphers[i]->transform(chunk, result, encrypt);
+                    size_t bytes = encodeUtf8(result.data(), length, utf8.data());
+                    if (bytes == UTF8_ERROR || !pwriteAll(outputs[k], utf8.data(), bytes, offsets[k])) failed[i] = true;
+                    offsets[k] += bytes;
+                }
+            }
+            for (size_t k = 0; k < mine.size(); k++) {
+                if (outputs[k] >= 0 && ::close(outputs[k]) != 0) failed[mine[k]] = true;
+            }
+            return true;
+        });
+    }
+
+    forEachPermutation(prepared.permutation, [&](size_t i) {
+        if (failed[i]) return;
+        const Cipher& cipher = *prepared.ciphers[i];
+        wstring result(cipher.requiredOutputSize(text.size(), encrypt), L'\0');
+        {
+            StageTimer timer(cipherStage(encrypt), text.size() * sizeof(wchar_t));
+            result.resize(cipher.transform(source, span<wchar_t>(result), encrypt));
+        }
+        if (!writeTextFile(targets[i].output, result)) failed[i] = true;
+    });
+
+    for (size_t i = 0; i < targets.size(); i++) written[i] = !failed[i];
+    return true;
+}
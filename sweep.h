@@ -0,0 +1,32 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "container.h"
+#include <string>
+#include <vector>
+
+// Один вход под многими ключами (смена ключей, контрольные примеры): файл
+// читается и декодируется один раз, шифртексты для всех ключей получаются из
+// общего входа в памяти. Аффинный шифр заменяет символы по одному, поэтому все
+// его ключи применяются за один проход: вход идёт блоками, и каждый блок, пока
+// он в кэше процессора, шифруется под всеми аффинными ключами. Скитала и
+// табличный шифр переставляют весь вход - они выполняются параллельно по
+// ключам (или по одному, но каждый на всех потоках, если ключей меньше потоков).
+
+struct SweepTarget {
+    CipherKey key;
+    std::wstring output;
+};
+
+// Двоичный файл: вход отображается в память. written[i] - записан ли
+// targets[i]. false, если вход не открылся или пуст; недопустимый ключ -
+// исключение invalid_argument до начала работы. Выход, который является самим
+// входом (тот же st_dev/st_ino), не пишется: written[i] == false.
+bool sweepBinaryFile(const std::wstring& input, const std::vector<SweepTarget>& targets, bool encrypt,
+                     std::vector<bool>& written);
+
+// Текст в UTF-8, как readTextFile/writeTextFile.
+bool sweepTextFile(const std::wstring& input, const std::vector<SweepTarget>& targets, bool encrypt,
+                   std::vector<bool>& written);
+
+#endif
@@ -1,5 +1,10 @@
 #include "table.h"
 #include "file_utils.h"
+#include "metrics.h"
+#include "execution_plan.h"
+#include "parallel.h"
+#include "transposition.h"
+#include "arena.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -9,6 +14,7 @@
 #include <stdexcept>
 #include <cstdint>
 #include <sstream>
+#include <span>
 
 using namespace std;
 
@@ -145,112 +151,194 @@ wstring readMatrixByColumns(const vector<vector<wchar_t>>& matrix) {
     return result;
 }
 
-vector<unsigned char> encryptTableBinary(const vector<unsigned char>& data, const wstring& key) {
-    vector<uint64_t> columnOrder = getColumnOrder(key);
-    uint64_t keyLength = static_cast<uint64_t>(key.length());
-    uint64_t dataLength = static_cast<uint64_t>(data.size());
-    uint64_t numRows = (dataLength + keyLength - 1) / keyLength;
+uint64_t tableOutputSize(uint64_t length, uint64_t keyLength, bool encrypt) {
+    if (keyLength == 0 || !encrypt) return length;
+    return (length + keyLength - 1) / keyLength * keyLength;
+}
 
-    vector<vector<unsigned char>> matrix(numRows, vector<unsigned char>(keyLength, 0));
-    uint64_t pos = 0;
+// Таблица - перестановка столбцов матрицы по ключу (transposition.h):
+// столбец j открытого текста становится столбцом columnOrder[j] - 1.
+static KeyedOrder tableOrder(const vector<uint64_t>& columnOrder) {
+    return KeyedOrder{ columnOrder.data(), static_cast<uint64_t>(columnOrder.size()) };
+}
 
-    for (uint64_t j = 0; j < keyLength; j++) {
-        for (uint64_t i = 0; i < numRows; i++) {
-            if (pos < dataLength) {
-                matrix[i][j] = data[pos++];
-            } else {
-                matrix[i][j] = 0; 
-            }
-        }
+template <typename T>
+static uint64_t tableDecryptKernel(const T* data, uint64_t length, T* result, const vector<uint64_t>& columnOrder, T pad) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t numRows = length / keyLength;
+    uint64_t size = numRows * keyLength;
+    transposeDecrypt(data, length, result, size, numRows, tableOrder(columnOrder), pad);
+
+    while (size > 0 && result[size - 1] == pad) {
+        size--;
     }
+    return size;
+}
 
-    vector<vector<unsigned char>> transposed(numRows, vector<unsigned char>(keyLength, 0));
-    for (uint64_t j = 0; j < keyLength; j++) {
-        uint64_t newCol = columnOrder[j] - 1;
-        for (uint64_t i = 0; i < numRows; i++) {
-            transposed[i][newCol] = matrix[i][j];
-        }
+static void checkTableOutput(uint64_t required, size_t available) {
+    if (static_cast<uint64_t>(available) < required) {
+        throw length_error("table: output buffer is too small");
     }
+}
 
-    vector<unsigned char> result;
-    for (const auto& row : transposed) {
-        for (unsigned char byte : row) {
-            result.push_back(byte);
+static uint64_t compactSpaces(wchar_t* text, uint64_t length) {
+    uint64_t size = 0;
+    for (uint64_t i = 0; i < length; i++) {
+        if (text[i] != L' ') {
+            text[size++] = text[i];
         }
     }
-    return result;
+    return size;
 }
 
-vector<unsigned char> decryptTableBinary(const vector<unsigned char>& data, const wstring& key) {
-    vector<uint64_t> columnOrder = getColumnOrder(key);
-    uint64_t keyLength = static_cast<uint64_t>(key.length());
+uint64_t encryptTableBinary(span<const unsigned char> data, span<unsigned char> result, const vector<uint64_t>& columnOrder) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
     uint64_t dataLength = static_cast<uint64_t>(data.size());
-    uint64_t numRows = dataLength / keyLength;
+    uint64_t outputSize = tableOutputSize(dataLength, keyLength, true);
+    checkTableOutput(outputSize, result.size());
+    if (keyLength == 0) {
+        copy(data.begin(), data.end(), result.begin());
+        return dataLength;
+    }
 
-    vector<vector<unsigned char>> matrix(numRows, vector<unsigned char>(keyLength));
-    uint64_t pos = 0;
-    for (uint64_t i = 0; i < numRows; i++) {
-        for (uint64_t j = 0; j < keyLength; j++) {
-            matrix[i][j] = data[pos++];
-        }
+    transposeEncrypt<unsigned char>(data.data(), dataLength, result.data(), outputSize / keyLength, tableOrder(columnOrder), 0);
+    return outputSize;
+}
+
+uint64_t decryptTableBinary(span<const unsigned char> data, span<unsigned char> result, const vector<uint64_t>& columnOrder) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t dataLength = static_cast<uint64_t>(data.size());
+    checkTableOutput(dataLength, result.size());
+    if (keyLength == 0) {
+        copy(data.begin(), data.end(), result.begin());
+        return dataLength;
     }
+    return tableDecryptKernel<unsigned char>(data.data(), dataLength, result.data(), columnOrder, 0);
+}
 
-    vector<vector<unsigned char>> restored(numRows, vector<unsigned char>(keyLength, 0));
-    for (uint64_t j = 0; j < keyLength; j++) {
-        uint64_t originalCol = static_cast<uint64_t>(-1);
-        for (uint64_t k = 0; k < keyLength; k++) {
-            if (columnOrder[k] == j + 1) {
-                originalCol = k;
-                break;
-            }
-        }
-        for (uint64_t i = 0; i < numRows; i++) {
-            restored[i][originalCol] = matrix[i][j];
-        }
+uint64_t encryptTable(const vector<uint64_t>& columnOrder, span<const wchar_t> text, span<wchar_t> result) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t textLength = static_cast<uint64_t>(text.size());
+    if (keyLength == 0) {
+        checkTableOutput(textLength, result.size());
+        copy(text.begin(), text.end(), result.begin());
+        return textLength;
     }
 
-    vector<unsigned char> result;
-    for (uint64_t j = 0; j < keyLength; j++) {
-        for (uint64_t i = 0; i < numRows; i++) {
-            result.push_back(restored[i][j]);
-        }
+    uint64_t cleanLength = static_cast<uint64_t>(count_if(text.begin(), text.end(), [](wchar_t c) { return c != L' '; }));
+    uint64_t outputSize = tableOutputSize(cleanLength, keyLength, true);
+    checkTableOutput(outputSize, result.size());
+
+    // Пробелы не шифруются: при их наличии работаем с копией без них
+    ArenaScope scope;
+    const wchar_t* clean = text.data();
+    if (cleanLength != textLength) {
+        span<wchar_t> compacted = scope.allocate<wchar_t>(static_cast<size_t>(cleanLength));
+        copy_if(text.begin(), text.end(), compacted.begin(), [](wchar_t c) { return c != L' '; });
+        clean = compacted.data();
     }
+    transposeEncrypt<wchar_t>(clean, cleanLength, result.data(), outputSize / keyLength, tableOrder(columnOrder), L'x');
+    return outputSize;
+}
 
-    while (!result.empty() && result.back() == 0) {
-        result.pop_back();
+uint64_t decryptTable(const vector<uint64_t>& columnOrder, span<const wchar_t> encryptedText, span<wchar_t> result) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t textLength = static_cast<uint64_t>(encryptedText.size());
+    checkTableOutput(textLength, result.size());
+    if (keyLength == 0) {
+        copy(encryptedText.begin(), encryptedText.end(), result.begin());
+        return textLength;
     }
 
-    return result;
+    if (find(encryptedText.begin(), encryptedText.end(), L' ') == encryptedText.end()) {
+        return tableDecryptKernel<wchar_t>(encryptedText.data(), textLength, result.data(), columnOrder, L'x');
+    }
+    ArenaScope scope;
+    span<wchar_t> cleanEncryptedText = scope.allocate<wchar_t>(encryptedText.size());
+    copy(encryptedText.begin(), encryptedText.end(), cleanEncryptedText.begin());
+    uint64_t cleanLength = compactSpaces(cleanEncryptedText.data(), textLength);
+    return tableDecryptKernel<wchar_t>(cleanEncryptedText.data(), cleanLength, result.data(), columnOrder, L'x');
 }
 
-wstring encryptTable(const wstring& key, const wstring& text) {
-    wstring cleanText = removeSpaces(text);
-    vector<uint64_t> columnOrder = getColumnOrder(key);
+template <typename T>
+static uint64_t tableEncryptInPlaceKernel(T* buffer, uint64_t length, const vector<uint64_t>& columnOrder, T pad) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t outputSize = tableOutputSize(length, keyLength, true);
+    transposeEncryptInPlace(buffer, length, outputSize / keyLength, tableOrder(columnOrder), pad);
+    return outputSize;
+}
 
-    auto matrix = createMatrixByColumns(cleanText, static_cast<uint64_t>(key.length()));
-    auto transposedMatrix = transposeColumns(matrix, columnOrder);
+template <typename T>
+static uint64_t tableDecryptInPlaceKernel(T* buffer, uint64_t length, const vector<uint64_t>& columnOrder, T pad) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    uint64_t numRows = length / keyLength;
+    uint64_t size = numRows * keyLength;
+    if (numRows > 0) {
+        transposeDecryptInPlace(buffer, numRows, tableOrder(columnOrder));
+    }
+    while (size > 0 && buffer[size - 1] == pad) {
+        size--;
+    }
+    return size;
+}
 
-    return readMatrixByRows(transposedMatrix);
+uint64_t encryptTableBinaryInPlace(span<unsigned char> buffer, uint64_t length, const vector<uint64_t>& columnOrder) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    checkTableOutput(max(length, tableOutputSize(length, keyLength, true)), buffer.size());
+    if (keyLength == 0) return length;
+    return tableEncryptInPlaceKernel<unsigned char>(buffer.data(), length, columnOrder, 0);
 }
 
-wstring decryptTable(const wstring& key, const wstring& encryptedText) {
-    wstring cleanEncryptedText = removeSpaces(encryptedText);
+uint64_t decryptTableBinaryInPlace(span<unsigned char> buffer, uint64_t length, const vector<uint64_t>& columnOrder) {
+    checkTableOutput(length, buffer.size());
+    if (columnOrder.empty()) return length;
+    return tableDecryptInPlaceKernel<unsigned char>(buffer.data(), length, columnOrder, 0);
+}
+
+uint64_t encryptTableInPlace(const vector<uint64_t>& columnOrder, span<wchar_t> buffer, uint64_t length) {
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    checkTableOutput(max(length, tableOutputSize(length, keyLength, true)), buffer.size());
+    if (keyLength == 0) return length;
+    uint64_t cleanLength = compactSpaces(buffer.data(), length);
+    return tableEncryptInPlaceKernel<wchar_t>(buffer.data(), cleanLength, columnOrder, L'x');
+}
+
+uint64_t decryptTableInPlace(const vector<uint64_t>& columnOrder, span<wchar_t> buffer, uint64_t length) {
+    checkTableOutput(length, buffer.size());
+    if (columnOrder.empty()) return length;
+    uint64_t cleanLength = compactSpaces(buffer.data(), length);
+    return tableDecryptInPlaceKernel<wchar_t>(buffer.data(), cleanLength, columnOrder, L'x');
+}
+
+vector<unsigned char> encryptTableBinary(const vector<unsigned char>& data, const wstring& key) {
     vector<uint64_t> columnOrder = getColumnOrder(key);
+    vector<unsigned char> result(static_cast<size_t>(tableOutputSize(data.size(), columnOrder.size(), true)));
+    encryptTableBinary(span<const unsigned char>(data), span<unsigned char>(result), columnOrder);
+    return result;
+}
 
-    uint64_t keyLength = static_cast<uint64_t>(key.length());
-    uint64_t textLength = static_cast<uint64_t>(cleanEncryptedText.length());
-    uint64_t numRows = textLength / keyLength;
+vector<unsigned char> decryptTableBinary(const vector<unsigned char>& data, const wstring& key) {
+    vector<uint64_t> columnOrder = getColumnOrder(key);
+    vector<unsigned char> result(data.size());
+    uint64_t size = decryptTableBinary(span<const unsigned char>(data), span<unsigned char>(result), columnOrder);
+    result.resize(static_cast<size_t>(size));
+    return result;
+}
 
-    vector<vector<wchar_t>> matrix(numRows, vector<wchar_t>(keyLength));
-    uint64_t pos = 0;
-    for (uint64_t i = 0; i < numRows; i++) {
-        for (uint64_t j = 0; j < keyLength; j++) {
-            matrix[i][j] = cleanEncryptedText[pos++];
-        }
-    }
+wstring encryptTable(const wstring& key, const wstring& text) {
+    vector<uint64_t> columnOrder = getColumnOrder(key);
+    wstring result(static_cast<size_t>(tableOutputSize(text.size(), columnOrder.size(), true)), L' ');
+    uint64_t size = encryptTable(columnOrder, span<const wchar_t>(text), span<wchar_t>(result));
+    result.resize(static_cast<size_t>(size));
+    return result;
+}
 
-    auto restoredMatrix = restoreColumns(matrix, columnOrder);
-    return readMatrixByColumns(restoredMatrix);
+wstring decryptTable(const wstring& key, const wstring& encryptedText) {
+    vector<uint64_t> columnOrder = getColumnOrder(key);
+    wstring result(encryptedText.size(), L' ');
+    uint64_t size = decryptTable(columnOrder, span<const wchar_t>(encryptedText), span<wchar_t>(result));
+    result.resize(static_cast<size_t>(size));
+    return result;
 }
 
 wstring generateTableKey(uint64_t min_value, uint64_t max_value) {
@@ -332,13 +420,19 @@ void table() {
                 wstring decryptedFilename;
                 getline(wcin, decryptedFilename);
 
+                OperationMetrics metrics("table.text_file");
+                WorkerThreadsScope threads(planTextThreads("table.text_file", inputFilename, ContainerCipher::TABLE, true));
                 wstring originalText = readTextFile(inputFilename);
                 if (originalText.empty()) {
                     wcout << L"Не удалось прочитать файл или файл пуст." << endl;
                     break;
                 }
 
-                wstring encryptedText = encryptTable(key, originalText);
+                wstring encryptedText;
+                {
+                    StageTimer timer(MetricStage::ENCRYPT, originalText.size() * sizeof(wchar_t));
+                    encryptedText = encryptTable(key, originalText);
+                }
                 wstring formattedEncryptedText = addSpacesToGroups(encryptedText, groupSize);
                 
                 if (writeTextFile(encryptedFilename, formattedEncryptedText)) {
@@ -348,7 +442,11 @@ void table() {
                     break;
                 }
 
-                wstring decryptedText = decryptTable(key, formattedEncryptedText);
+                wstring decryptedText;
+                {
+                    StageTimer timer(MetricStage::DECRYPT, formattedEncryptedText.size() * sizeof(wchar_t));
+                    decryptedText = decryptTable(key, formattedEncryptedText);
+                }
                 if (writeTextFile(decryptedFilename, decryptedText)) {
                     wcout << L"Текст успешно расшифрован и записан в: " << decryptedFilename << endl;
                 } else {
@@ -370,22 +468,23 @@ void table() {
                 wstring decryptedImage;
                 getline(wcin, decryptedImage);
 
-                vector<unsigned char> originalData = readBinaryFile(inputImage);
-                if (originalData.empty()) {
+                OperationMetrics metrics("table.image_file");
+                CipherKey cipherKey;
+                cipherKey.cipher = ContainerCipher::TABLE;
+                cipherKey.word = key;
+                FileResult result = transformBinaryFile("table.image_file", inputImage, encryptedImage, cipherKey, true);
+                if (result == FileResult::READ_FAILED) {
                     wcout << L"Не удалось прочитать изображение или файл пуст." << endl;
                     break;
                 }
-
-                vector<unsigned char> encryptedData = encryptTableBinary(originalData, key);
-                if (writeBinaryFile(encryptedImage, encryptedData)) {
+                if (result == FileResult::OK) {
                     wcout << L"Изображение зашифровано и записано в: " << encryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи зашифрованного изображения." << endl;
                     break;
                 }
 
-                vector<unsigned char> decryptedData = decryptTableBinary(encryptedData, key);
-                if (writeBinaryFile(decryptedImage, decryptedData)) {
+                if (transformBinaryFile("table.image_file", encryptedImage, decryptedImage, cipherKey, false) == FileResult::OK) {
                     wcout << L"Изображение расшифровано и записано в: " << decryptedImage << endl;
                 } else {
                     wcout << L"Ошибка записи расшифрованного изображения." << endl;
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <span>
 
 std::vector<uint64_t> getColumnOrder(const std::wstring& key);
 
@@ -22,6 +23,22 @@ std::vector<unsigned char> decryptTableBinary(const std::vector<unsigned char>&
 std::wstring encryptTable(const std::wstring& key, const std::wstring& text);
 std::wstring decryptTable(const std::wstring& key, const std::wstring& encryptedText);
 
+// Размер результата (верхняя граница) для входа длины length.
+uint64_t tableOutputSize(uint64_t length, uint64_t keyLength, bool encrypt);
+
+// Варианты без выделения памяти по готовому порядку столбцов (getColumnOrder):
+// возвращают число записанных элементов. Буферы не должны пересекаться.
+uint64_t encryptTableBinary(std::span<const unsigned char> data, std::span<unsigned char> result, const std::vector<uint64_t>& columnOrder);
+uint64_t decryptTableBinary(std::span<const unsigned char> data, std::span<unsigned char> result, const std::vector<uint64_t>& columnOrder);
+uint64_t encryptTable(const std::vector<uint64_t>& columnOrder, std::span<const wchar_t> text, std::span<wchar_t> result);
+uint64_t decryptTable(const std::vector<uint64_t>& columnOrder, std::span<const wchar_t> encryptedText, std::span<wchar_t> result);
+
+// Преобразование на месте: первые length элементов buffer - вход.
+uint64_t encryptTableBinaryInPlace(std::span<unsigned char> buffer, uint64_t length, const std::vector<uint64_t>& columnOrder);
+uint64_t decryptTableBinaryInPlace(std::span<unsigned char> buffer, uint64_t length, const std::vector<uint64_t>& columnOrder);
+uint64_t encryptTableInPlace(const std::vector<uint64_t>& columnOrder, std::span<wchar_t> buffer, uint64_t length);
+uint64_t decryptTableInPlace(const std::vector<uint64_t>& columnOrder, std::span<wchar_t> buffer, uint64_t length);
+
 std::wstring generateTableKey(uint64_t min_value, uint64_t max_value);
 
 void table();
@@ -0,0 +1,124 @@
+#include "table_file.h"
+#include "table.h"
+#include "file_utils.h"
+#include "large_buffer.h"
+#include "transposition.h"
+#include "probes.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+const size_t TRIM_BLOCK = 64 * 1024;
+
+bool transformTableFile(const wstring& input, const wstring& output, const wstring& key, uint64_t memoryBudget, bool encrypt) {
+    vector<uint64_t> columnOrder = getColumnOrder(key);
+    uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+
+    int in = ::open(ws2s(input).c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    int out = ::open(ws2s(output).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+
+    struct stat info;
+    bool ok = fstat(in, &info) == 0;
+    uint64_t length = ok ? static_cast<uint64_t>(info.st_size) : 0;
+
+    if (ok && keyLength == 0) {
+        // Без ключа данные не меняются, как и в encryptTableBinary
+        LargeBuffer buffer(static_cast<size_t>(min<uint64_t>(max<uint64_t>(length, 1), memoryBudget)));
+        for (uint64_t offset = 0; ok && offset < length; offset += buffer.size()) {
+            size_t n = static_cast<size_t>(min<uint64_t>(buffer.size(), length - offset));
+            ok = preadAll(in, buffer.data(), n, offset) && pwriteAll(out, buffer.data(), n, offset);
+        }
+    } else if (ok) {
+        uint64_t rows = tableFileRows(length, keyLength, encrypt);
+        posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ok = ftruncate(out, static_cast<off_t>(rows * keyLength)) == 0 &&
+             transposeTableRows(in, length, out, columnOrder, encrypt, 0, rows, tableBandRows(keyLength, memoryBudget));
+        if (ok && !encrypt) ok = trimTablePadding(out, rows * keyLength);
+    }
+
+    ::close(in);
+    ok = ::close(out) == 0 && ok;
+    return ok;
+}
+
+}
+
+uint64_t tableFileRows(uint64_t inputLength, uint64_t keyLength, bool encrypt) {
+    if (keyLength == 0) return 0;
+    return encrypt ? (inputLength + keyLength - 1) / keyLength : inputLength / keyLength;
+}
+
+uint64_t tableBandRows(uint64_t keyLength, uint64_t memoryBudget) {
+    // Под полосу два буфера: столбцы и строки
+    return max(TABLE_FILE_MIN_BAND_ROWS, memoryBudget / (2 * max<uint64_t>(keyLength, 1)));
+}
+
+bool transposeTableRows(int input, uint64_t inputLength, int output, const vector<uint64_t>& columnOrder,
+                        bool encrypt, uint64_t firstRow, uint64_t lastRow, uint64_t bandRows) {
+    const uint64_t keyLength = static_cast<uint64_t>(columnOrder.size());
+    const uint64_t rows = tableFileRows(inputLength, keyLength, encrypt);
+    if (keyLength == 0 || bandRows == 0 || firstRow >= lastRow || lastRow > rows) return firstRow >= lastRow;
+
+    KeyedOrder order{ columnOrder.data(), keyLength };
+    size_t capacity = static_cast<size_t>(min(bandRows, lastRow - firstRow) * keyLength);
+    LargeBuffer columns(capacity);
+    LargeBuffer band(capacity);
+
+    for (uint64_t first = firstRow; first < lastRow; first += bandRows) {
+        uint64_t n = min(bandRows, lastRow - first);
+        RGR_PROBE(band__begin, first, first + n);
+        if (encrypt) {
+            for (uint64_t d = 0; d < keyLength; d++) {
+                unsigned char* piece = columns.data() + d * n;
+                uint64_t begin = d * rows + first;
+                uint64_t available = begin < inputLength ? min(n, inputLength - begin) : 0;
+                if (available > 0 && !preadAll(input, piece, static_cast<size_t>(available), begin)) return false;
+                fill(piece + available, piece + n, 0);
+            }
+            transposeEncrypt<unsigned char>(columns.data(), n * keyLength, band.data(), n, order, 0);
+            if (!pwriteAll(output, band.data(), static_cast<size_t>(n * keyLength), first * keyLength)) return false;
+        } else {
+            if (!preadAll(input, band.data(), static_cast<size_t>(n * keyLength), first * keyLength)) return false;
+            transposeDecrypt<unsigned char>(band.data(), n * keyLength, columns.data(), n * keyLength, n, order, 0);
+            for (uint64_t d = 0; d < keyLength; d++) {
+                if (!pwriteAll(output, columns.data() + d * n, static_cast<size_t>(n), d * rows + first)) return false;
+            }
+        }
+        RGR_PROBE(band__end, first, first + n);
+    }
+    return true;
+}
+
+bool trimTablePadding(int fd, uint64_t length) {
+    unsigned char block[TRIM_BLOCK];
+    uint64_t size = length;
+    while (size > 0) {
+        size_t n = static_cast<size_t>(min<uint64_t>(TRIM_BLOCK, size));
+        if (!preadAll(fd, block, n, size - n)) return false;
+        size_t kept = n;
+        while (kept > 0 && block[kept - 1] == 0) {
+            kept--;
+        }
+        size -= n - kept;
+        if (kept > 0) break;
+    }
+    return size == length || ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+bool encryptTableFile(const wstring& input, const wstring& output, const wstring& key, uint64_t memoryBudget) {
+    return transformTableFile(input, output, key, memoryBudget, true);
+}
+
+bool decryptTableFile(const wstring& input, const wstring& output, const wstring& key, uint64_t memoryBudget) {
+    return transformTableFile(input, output, key, memoryBudget, false);
+}
@@ -0,0 +1,42 @@
+#ifndef TABLE_FILE_H
+#define TABLE_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Табличный шифр для файлов больше оперативной памяти. Файл - матрица rows x
+// keyLength; при шифровании столбец d открытого текста - непрерывный участок
+// входа [d * rows, (d + 1) * rows), строка шифртекста - непрерывный участок
+// выхода. Поэтому хватает одного прохода полосами строк: из каждого столбца
+// читается отрезок полосы, полоса переставляется в памяти (transposition.h) и
+// записывается одним куском; при расшифровании - наоборот. Памяти нужно
+// 2 * keyLength * bandRows байт, ввод-вывод - крупными последовательными
+// отрезками. Результат совпадает с encryptTableBinary/decryptTableBinary.
+
+const uint64_t TABLE_FILE_DEFAULT_MEMORY = 256 << 20;
+const uint64_t TABLE_FILE_MIN_BAND_ROWS = 4096;
+
+// Число строк матрицы для входа длины inputLength.
+uint64_t tableFileRows(uint64_t inputLength, uint64_t keyLength, bool encrypt);
+
+// Строк в полосе при бюджете памяти memoryBudget байт (не меньше
+// TABLE_FILE_MIN_BAND_ROWS, чтобы чтение столбцов оставалось последовательным).
+uint64_t tableBandRows(uint64_t keyLength, uint64_t memoryBudget);
+
+// Строки матрицы [firstRow, lastRow) полосами по bandRows: input длины
+// inputLength, output уже имеет размер tableFileRows * keyLength. Полосы не
+// пересекаются по записи, так что диапазоны строк можно выполнять параллельно.
+bool transposeTableRows(int input, uint64_t inputLength, int output, const std::vector<uint64_t>& columnOrder,
+                        bool encrypt, uint64_t firstRow, uint64_t lastRow, uint64_t bandRows);
+
+// Отбрасывает нулевые байты в конце файла длины length, как decryptTableBinary.
+bool trimTablePadding(int fd, uint64_t length);
+
+// false при ошибке ввода-вывода; bad_alloc, если не выделена память под полосу.
+bool encryptTableFile(const std::wstring& input, const std::wstring& output, const std::wstring& key,
+                      uint64_t memoryBudget = TABLE_FILE_DEFAULT_MEMORY);
+bool decryptTableFile(const std::wstring& input, const std::wstring& output, const std::wstring& key,
+                      uint64_t memoryBudget = TABLE_FILE_DEFAULT_MEMORY);
+
+#endif
@@ -0,0 +1,239 @@
+// Проверки контейнера (container.h): формат с индексом, сжатие, дописывание
+// и догоняние растущего файла. Сборка и запуск из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tests/container_test.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o container_test && ./container_test
+//
+// Содержимое сверяется с исходными данными, несжатые блоки на диске - с
+// Cipher::transform соответствующего участка. Файлы - во временном каталоге.
+#include "container.h"
+#include "file_utils.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace {
+
+// Случайные байты не сжимаются, повторяющиеся строки - сжимаются.
+vector<unsigned char> testData(mt19937_64& random, size_t size, bool compressible) {
+    vector<unsigned char> data(size);
+    const string line = "2026-03-01 12:00:00 INFO request served in 3 ms\n";
+    for (size_t i = 0; i < size; i++) {
+        data[i] = compressible ? static_cast<unsigned char>(line[i % line.size()]) : static_cast<unsigned char>(random());
+    }
+    if (compressible) {
+        for (size_t i = 0; i < size / 64; i++) data[random() % size] = static_cast<unsigned char>(random());
+    }
+    return data;
+}
+
+vector<unsigned char> readContainer(const wstring& path, const CipherKey& key, bool& ok) {
+    ContainerReader reader;
+    vector<unsigned char> content;
+    ok = reader.open(path, key) && reader.readAll(content);
+    return content;
+}
+
+// Каждый блок: расшифровка - свой участок данных; несжатый блок на диске -
+// Cipher::transform этого участка.
+void checkChunks(const wstring& path, const CipherKey& key, const vector<unsigned char>& data, const string& name) {
+    ContainerReader reader;
+    if (!reader.open(path, key)) {
+        check(false, name + ": open");
+        return;
+    }
+    unique_ptr<Cipher> cipher = makeCipher(key);
+    int fd = ::open(ws2s(path).c_str(), O_RDONLY | O_CLOEXEC);
+    uint64_t position = 0;
+    bool chunksOk = true;
+    bool storedOk = true;
+    for (uint64_t i = 0; i < reader.chunkCount(); i++) {
+        const ChunkEntry& entry = reader.chunk(i);
+        span<const unsigned char> expected(data.data() + position, entry.plainLength);
+        vector<unsigned char> plain(entry.plainLength);
+        chunksOk = chunksOk && position + entry.plainLength <= data.size() && reader.readChunk(i, plain) &&
+                   equal(plain.begin(), plain.end(), expected.begin());
+        if (!reader.compressed()) {
+            vector<unsigned char> stored(entry.storedLength);
+            vector<unsigned char> reference(cipher->requiredOutputSize(expected.size(), true));
+            reference.resize(cipher->transform(expected, span<unsigned char>(reference), true));
+            storedOk = storedOk && preadAll(fd, stored.data(), stored.size(), entry.offset) && stored == reference;
+        }
+        position += entry.plainLength;
+    }
+    ::close(fd);
+    check(chunksOk, name + ": every chunk decrypts to its part of the data");
+    check(storedOk, name + ": stored chunks match Cipher::transform");
+    check(position == data.size(), name + ": chunks cover the data");
+}
+
+void testRoundTrip(const wstring& path, mt19937_64& random) {
+    for (const CipherKey& key : testKeys()) {
+        for (bool compress : { false, true }) {
+            for (size_t size : { 1, 4095, 4096, 3 * 4096 + 5, 200000 }) {
+                string name = keyName(key) + (compress ? ", compressed, " : ", plain, ") + to_string(size) + " bytes";
+                vector<unsigned char> data = testData(random, size, compress);
+                check(writeContainer(path, data, key, 4096, 0, compress), name + ": write");
+                bool ok;
+                check(readContainer(path, key, ok) == data && ok, name + ": readAll returns the data");
+                checkChunks(path, key, data, name);
+
+                ContainerReader reader;
+                check(reader.open(path, key) && reader.size() == size && reader.compressed() == compress,
+                      name + ": header");
+                bool rangesOk = true;
+                for (int i = 0; i < 20; i++) {
+                    uint64_t offset = random() % size;
+                    uint64_t length = 1 + random() % (size - offset);
+                    vector<unsigned char> part(length);
+                    rangesOk = rangesOk && reader.readRange(offset, part) &&
+                               equal(part.begin(), part.end(), data.begin() + static_cast<ptrdiff_t>(offset));
+                }
+                check(rangesOk, name + ": readRange returns the requested bytes");
+            }
+        }
+    }
+}
+
+// Чужой ключ и испорченный блок не дают неверных данных.
+void testDamage(const wstring& path, mt19937_64& random) {
+    vector<CipherKey> keys = testKeys();
+    vector<unsigned char> data = testData(random, 50000, false);
+    check(writeContainer(path, data, keys[0], 4096), "damage: write");
+
+    ContainerReader reader;
+    check(!reader.open(path, keys[1]), "damage: another key is refused");
+
+    check(reader.open(path, keys[0]), "damage: open");
+    const ChunkEntry entry = reader.chunk(3);
+    reader.close();
+    int fd = ::open(ws2s(path).c_str(), O_RDWR | O_CLOEXEC);
+    unsigned char byte = 0;
+    check(preadAll(fd, &byte, 1, entry.offset + 5), "damage: read stored byte");
+    byte ^= 0x40;
+    check(pwriteAll(fd, &byte, 1, entry.offset + 5), "damage: corrupt stored byte");
+    ::close(fd);
+
+    check(reader.open(path, keys[0]), "damage: open after corruption");
+    vector<unsigned char> plain(entry.plainLength);
+    check(!reader.readChunk(3, plain), "damage: corrupted chunk fails its checksum");
+    check(reader.readChunk(2, plain), "damage: other chunks still readable");
+}
+
+// Дописывание частями даёт то же содержимое и те же блоки, что и запись целиком.
+void testAppend(const wstring& path, mt19937_64& random) {
+    for (const CipherKey& key : testKeys()) {
+        for (bool compress : { false, true }) {
+            string name = keyName(key) + (compress ? ", compressed" : ", plain") + ", append";
+            vector<unsigned char> data = testData(random, 60000, compress);
+            size_t written = 1 + random() % 5000;
+            check(writeContainer(path, span<const unsigned char>(data.data(), written), key, 4096, 0, compress),
+                  name + ": write first part");
+            bool appendOk = true;
+            while (written < data.size()) {
+                size_t length = min<size_t>(data.size() - written, 1 + random() % 9000);
+                appendOk = appendOk && appendContainer(path, span<const unsigned char>(data.data() + written, length), key);
+                written += length;
+            }
+            check(appendOk, name + ": append");
+            bool ok;
+            check(readContainer(path, key, ok) == data && ok, name + ": content equals all parts");
+            checkChunks(path, key, data, name);
+        }
+    }
+}
+
+// Контейнер догоняет растущий файл; переписанный файл отвергается.
+void testSync(const wstring& source, const wstring& path, mt19937_64& random) {
+    for (const CipherKey& key : testKeys()) {
+        for (bool compress : { false, true }) {
+            string name = keyName(key) + (compress ? ", compressed" : ", plain") + ", sync";
+            vector<unsigned char> data = testData(random, 40000, compress);
+            unlink(ws2s(path).c_str());
+            bool syncOk = true;
+            bool contentOk = true;
+            for (size_t size = 3000; size <= data.size(); size += 7000) {
+                syncOk = syncOk && writeBinaryFile(source, span<const unsigned char>(data.data(), size)) &&
+                         syncContainer(source, path, key, 4096, 0, compress);
+                bool ok;
+                vector<unsigned char> content = readContainer(path, key, ok);
+                contentOk = contentOk && ok && content.size() == size &&
+                            equal(content.begin(), content.end(), data.begin());
+            }
+            check(syncOk, name + ": sync after each growth");
+            check(contentOk, name + ": content follows the source");
+
+            vector<unsigned char> before = readBinaryFile(path);
+            vector<unsigned char> rewritten(data.begin(), data.begin() + 30000);
+            rewritten[100] ^= 1;
+            rewritten.resize(rewritten.size() + 10000, 'x');
+            check(writeBinaryFile(source, rewritten) && !syncContainer(source, path, key, 4096, 0, compress),
+                  name + ": rewritten source is refused");
+            check(writeBinaryFile(source, span<const unsigned char>(data.data(), 1000)) &&
+                      !syncContainer(source, path, key, 4096, 0, compress),
+                  name + ": shrunk source is refused");
+            check(readBinaryFile(path) == before, name + ": refused sync leaves the container unchanged");
+        }
+    }
+}
+
+// Процесс, убитый во время дописывания, оставляет прежний или новый
+// контейнер, но не испорченный. Дописывание 16 МБ занимает десятки
+// миллисекунд; убийство через 0, 2.5, 5, ... мс попадает до, во время и после.
+void testInterruptedAppend(const wstring& path, mt19937_64& random) {
+    CipherKey key;
+    key.cipher = ContainerCipher::TABLE;
+    key.word = L"ключ";
+    vector<unsigned char> first = testData(random, 100000, false);
+    vector<unsigned char> second = testData(random, 16 << 20, false);
+    vector<unsigned char> both = first;
+    both.insert(both.end(), second.begin(), second.end());
+    int interrupted = 0;
+    for (int attempt = 0; attempt < 16; attempt++) {
+        string name = "interrupted append, attempt " + to_string(attempt);
+        check(writeContainer(path, first, key, 4096), name + ": write");
+        pid_t pid = fork();
+        if (pid == 0) _exit(appendContainer(path, second, key, 1) ? 0 : 1);
+        usleep(static_cast<unsigned>(attempt) * 2500);
+        kill(pid, SIGKILL);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFSIGNALED(status)) interrupted++;
+        bool ok;
+        vector<unsigned char> content = readContainer(path, key, ok);
+        check(ok && (content == first || content == both), name + ": old or new content");
+    }
+    check(interrupted > 0, "interrupted append: at least one append was killed midway");
+}
+
+}
+
+int main() {
+    char directory[] = "/tmp/rgr_container_test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const wstring path = s2ws(string(directory) + "/data.rgrc");
+    const wstring source = s2ws(string(directory) + "/source.log");
+    mt19937_64 random(20260302);
+
+    testRoundTrip(path, random);
+    testDamage(path, random);
+    testAppend(path, random);
+    testSync(source, path, random);
+    testInterruptedAppend(path, random);
+
+    unlink(ws2s(path).c_str());
+    unlink(ws2s(source).c_str());
+    rmdir(directory);
+    return finishChecks("container_test");
+}
@@ -0,0 +1,165 @@
+// Проверки шифрования на месте (inplace_file.h). Сборка и запуск из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tests/inplace_test.cpp inplace_file.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o inplace_test && ./inplace_test
+//
+// Результат сравнивается с Cipher::transform над тем же содержимым в памяти:
+// обычный проход, зашифрование и расшифрование обратно, процесс, убитый
+// посреди порции, после resume и после rollback. Файлы - во временном каталоге.
+#include "inplace_file.h"
+#include "file_utils.h"
+#include "test_support.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace {
+
+vector<unsigned char> randomData(mt19937_64& random, size_t size) {
+    vector<unsigned char> data(size);
+    // Нули встречаются часто: дополнение таблицы - тоже нули
+    for (unsigned char& byte : data) byte = random() % 4 == 0 ? 0 : static_cast<unsigned char>(random());
+    return data;
+}
+
+vector<unsigned char> transformed(const CipherKey& key, const vector<unsigned char>& data, bool encrypt) {
+    unique_ptr<Cipher> cipher = makeCipher(key);
+    vector<unsigned char> result(cipher->requiredOutputSize(data.size(), encrypt));
+    result.resize(cipher->transform(span<const unsigned char>(data), span<unsigned char>(result), encrypt));
+    return result;
+}
+
+// Обычный проход и обратно: то же, что Cipher::transform.
+void testRoundTrip(const wstring& path, mt19937_64& random) {
+    for (const CipherKey& key : testKeys()) {
+        for (size_t size : { 1, 17, 4096, 100003 }) {
+            string name = keyName(key) + ", " + to_string(size) + " bytes";
+            vector<unsigned char> plain = randomData(random, size);
+            vector<unsigned char> encrypted = transformed(key, plain, true);
+            check(writeBinaryFile(path, plain), name + ": write input");
+
+            check(transformFileInPlace(path, key, true, 1 + random() % 64), name + ": encrypt");
+            check(readBinaryFile(path) == encrypted, name + ": encrypt matches Cipher::transform");
+            check(!inPlaceJournalExists(path), name + ": journal removed after encrypt");
+
+            check(transformFileInPlace(path, key, false, 1 + random() % 64), name + ": decrypt");
+            check(readBinaryFile(path) == transformed(key, encrypted, false),
+                  name + ": decrypt matches Cipher::transform");
+            check(!inPlaceJournalExists(path), name + ": journal removed after decrypt");
+        }
+    }
+}
+
+// Недопустимые случаи не трогают файл.
+void testRefusals(const wstring& path, mt19937_64& random) {
+    CipherKey key;
+    key.cipher = ContainerCipher::SKYTALE;
+    key.key = 7;
+    vector<unsigned char> data = randomData(random, 7 * 100 + 3);
+    check(writeBinaryFile(path, data), "refusals: write input");
+    check(!transformFileInPlace(path, key, false), "refusals: decrypt of a length not divisible by the key");
+    check(readBinaryFile(path) == data, "refusals: file unchanged");
+    check(!resumeFileInPlace(path, key), "refusals: resume without a journal");
+    check(!rollbackFileInPlace(path, key), "refusals: rollback without a journal");
+
+    CipherKey bad;
+    bad.cipher = ContainerCipher::AFFINE;
+    bad.a = 2;
+    bool thrown = false;
+    try {
+        transformFileInPlace(path, bad, true);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    check(thrown, "refusals: invalid key throws invalid_argument");
+    check(readBinaryFile(path) == data, "refusals: file unchanged by invalid key");
+}
+
+// Процесс с операцией убивается, как только появился журнал и прошло delay
+// микросекунд; true, если он действительно был убит, а не завершился сам.
+bool killMidway(const wstring& path, const CipherKey& key, bool encrypt, uint64_t batch, unsigned delay) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        bool done = false;
+        try {
+            done = transformFileInPlace(path, key, encrypt, batch);
+        } catch (const exception&) {
+        }
+        _exit(done ? 0 : 1);
+    }
+    int status = 0;
+    while (!inPlaceJournalExists(path) && waitpid(pid, &status, WNOHANG) == 0) usleep(50);
+    usleep(delay);
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status);
+}
+
+// Прерванная операция: resume доводит до результата Cipher::transform,
+// rollback возвращает исходный файл (или отказывает, если файл уже получил
+// окончательную длину, - тогда остаётся resume).
+void testInterrupted(const wstring& path, mt19937_64& random) {
+    int interrupted = 0;
+    for (const CipherKey& key : testKeys()) {
+        for (bool encrypt : { true, false }) {
+            for (int attempt = 0; attempt < 4; attempt++) {
+                string name = keyName(key) + (encrypt ? ", encrypt" : ", decrypt") + ", attempt " +
+                              to_string(attempt);
+                vector<unsigned char> original = randomData(random, 300000);
+                if (!encrypt) original = transformed(key, original, true);
+                vector<unsigned char> expected = transformed(key, original, encrypt);
+                const uint64_t batch = 16 + random() % 256;
+                check(writeBinaryFile(path, original), name + ": write input");
+
+                if (!killMidway(path, key, encrypt, batch, static_cast<unsigned>(random() % 20000))) {
+                    check(readBinaryFile(path) == expected, name + ": finished before kill");
+                    continue;
+                }
+                interrupted++;
+                if (!inPlaceJournalExists(path)) {
+                    // Убит до создания журнала или после его удаления
+                    vector<unsigned char> now = readBinaryFile(path);
+                    check(now == original || now == expected, name + ": no journal, file intact or done");
+                    continue;
+                }
+                if (attempt % 2 == 0) {
+                    check(resumeFileInPlace(path, key, batch), name + ": resume");
+                    check(readBinaryFile(path) == expected, name + ": resume matches Cipher::transform");
+                } else if (rollbackFileInPlace(path, key, batch)) {
+                    check(readBinaryFile(path) == original, name + ": rollback restores the input");
+                } else {
+                    check(resumeFileInPlace(path, key, batch), name + ": resume after refused rollback");
+                    check(readBinaryFile(path) == expected, name + ": resume after refused rollback matches");
+                }
+                check(!inPlaceJournalExists(path), name + ": journal removed");
+            }
+        }
+    }
+    check(interrupted > 0, "interrupted: at least one operation was killed midway");
+}
+
+}
+
+int main() {
+    char directory[] = "/tmp/rgr_inplace_test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const wstring path = s2ws(string(directory) + "/data.bin");
+    mt19937_64 random(20260301);
+
+    testRoundTrip(path, random);
+    testRefusals(path, random);
+    testInterrupted(path, random);
+
+    unlink(ws2s(path).c_str());
+    unlink(ws2s(inPlaceJournalPath(path)).c_str());
+    rmdir(directory);
+    return finishChecks("inplace_test");
+}
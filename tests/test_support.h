@@ -0,0 +1,65 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include "container.h"
+#include "file_utils.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Общее для проверок в tests/: счётчик неудач, ключи всех шифров и их имена.
+
+inline int failures = 0;
+
+inline void check(bool condition, const std::string& name) {
+    if (condition) return;
+    fprintf(stderr, "FAIL: %s\n", name.c_str());
+    failures++;
+}
+
+// Итог проверок: код возврата main.
+inline int finishChecks(const char* test) {
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", test);
+    return 0;
+}
+
+// Ключи всех шифров, включая вырожденные: Скитала в один столбец и таблица
+// из одной буквы.
+inline std::vector<CipherKey> testKeys() {
+    std::vector<CipherKey> keys;
+    CipherKey key;
+    key.cipher = ContainerCipher::AFFINE;
+    key.a = 5;
+    key.b = 7;
+    keys.push_back(key);
+    key = CipherKey();
+    key.cipher = ContainerCipher::SKYTALE;
+    for (uint64_t width : { 1, 7, 13 }) {
+        key.key = width;
+        keys.push_back(key);
+    }
+    key = CipherKey();
+    key.cipher = ContainerCipher::TABLE;
+    for (const wchar_t* word : { L"ключ", L"zebra", L"a" }) {
+        key.word = word;
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+inline std::string keyName(const CipherKey& key) {
+    switch (key.cipher) {
+        case ContainerCipher::AFFINE:
+            return "affine " + std::to_string(key.a) + " " + std::to_string(key.b);
+        case ContainerCipher::SKYTALE:
+            return "skytale " + std::to_string(key.key);
+        default:
+            return "table " + ws2s(key.word);
+    }
+}
+
+#endif
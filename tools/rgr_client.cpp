@@ -0,0 +1,171 @@
+// Клиент резидентного режима (rgr --serve). Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -I. tools/rgr_client.cpp -o rgr_client
+//
+//   rgr_client <сокет> affine  encrypt|decrypt <a> <b> [--text] [--file <вход> <выход>]
+//   rgr_client <сокет> skytale encrypt|decrypt <ключ>  [--text] [--file <вход> <выход>]
+//   rgr_client <сокет> table   encrypt|decrypt <слово> [--text] [--file <вход> <выход>]
+//
+// Без --file данные читаются из stdin, результат пишется в stdout.
+// Для --file без --text: --huge-pages none|thp|explicit, --numa default|first-touch|interleave
+// задают размещение буферов сервера для этого запроса (large_buffer.h).
+// Код возврата - статус ответа сервера (0 - успех).
+#include "daemon_protocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+            "usage: rgr_client <socket> affine|skytale|table encrypt|decrypt <key...> [--text] [--file <in> <out>]\n"
+            "                  [--huge-pages none|thp|explicit] [--numa default|first-touch|interleave]\n");
+}
+
+uint8_t pagesFlag(const string& name) {
+    if (name == "none") return DAEMON_PAGES_NONE;
+    if (name == "thp") return DAEMON_PAGES_TRANSPARENT;
+    if (name == "explicit") return DAEMON_PAGES_EXPLICIT;
+    return 0;
+}
+
+uint8_t numaFlag(const string& name) {
+    if (name == "default") return DAEMON_NUMA_DEFAULT;
+    if (name == "first-touch") return DAEMON_NUMA_FIRST_TOUCH;
+    if (name == "interleave") return DAEMON_NUMA_INTERLEAVE;
+    return 0;
+}
+
+const char* statusName(DaemonStatus status) {
+    switch (status) {
+        case DaemonStatus::OK: return "ok";
+        case DaemonStatus::BAD_REQUEST: return "bad request";
+        case DaemonStatus::BAD_KEY: return "bad key";
+        case DaemonStatus::IO_ERROR: return "i/o error";
+        case DaemonStatus::INTERNAL_ERROR: return "internal error";
+    }
+    return "unknown status";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        usage();
+        return 2;
+    }
+
+    const char* socketPath = argv[1];
+    string cipherName = argv[2];
+    string direction = argv[3];
+    int next = 4;
+
+    RequestHeader header = {};
+    header.magic = DAEMON_MAGIC;
+    if (direction != "encrypt" && direction != "decrypt") {
+        usage();
+        return 2;
+    }
+    header.encrypt = direction == "encrypt";
+
+    string key;
+    if (cipherName == "affine") {
+        if (argc < 6) {
+            usage();
+            return 2;
+        }
+        uint64_t ab[2] = { strtoull(argv[4], nullptr, 10), strtoull(argv[5], nullptr, 10) };
+        key.assign(reinterpret_cast<const char*>(ab), sizeof(ab));
+        header.cipher = static_cast<uint8_t>(DaemonCipher::AFFINE);
+        next = 6;
+    } else if (cipherName == "skytale") {
+        uint64_t value = strtoull(argv[4], nullptr, 10);
+        key.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+        header.cipher = static_cast<uint8_t>(DaemonCipher::SKYTALE);
+        next = 5;
+    } else if (cipherName == "table") {
+        key = argv[4];
+        header.cipher = static_cast<uint8_t>(DaemonCipher::TABLE);
+        next = 5;
+    } else {
+        usage();
+        return 2;
+    }
+
+    bool text = false;
+    string inputFile;
+    string outputFile;
+    for (int i = next; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--text") {
+            text = true;
+        } else if (arg == "--file" && i + 2 < argc) {
+            inputFile = argv[++i];
+            outputFile = argv[++i];
+        } else if (arg == "--huge-pages" && i + 1 < argc && pagesFlag(argv[i + 1])) {
+            header.flags |= pagesFlag(argv[++i]);
+        } else if (arg == "--numa" && i + 1 < argc && numaFlag(argv[i + 1])) {
+            header.flags |= numaFlag(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    vector<char> payload;
+    if (!inputFile.empty()) {
+        // У сервера своя рабочая папка - передаём абсолютные пути
+        string paths = filesystem::absolute(inputFile).string();
+        paths += '\0';
+        paths += filesystem::absolute(outputFile).string();
+        payload.assign(paths.begin(), paths.end());
+        header.payload = static_cast<uint8_t>(text ? DaemonPayload::TEXT_FILE : DaemonPayload::BINARY_FILE);
+    } else {
+        char chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            payload.insert(payload.end(), chunk, chunk + n);
+        }
+        header.payload = static_cast<uint8_t>(text ? DaemonPayload::TEXT : DaemonPayload::BINARY);
+    }
+    header.keyLength = static_cast<uint32_t>(key.size());
+    header.payloadLength = payload.size();
+
+    int fd = connectDaemon(socketPath);
+    if (fd < 0) {
+        fprintf(stderr, "rgr_client: cannot connect to %s: %s\n", socketPath, strerror(errno));
+        return 3;
+    }
+
+    // Отклонённый запрос сервер закрывает, не дочитав данные, и отправка
+    // обрывается - но ответ со статусом уже ждёт в сокете
+    ResponseHeader response;
+    bool sent = sendRequest(fd, header, key.data(), payload.data());
+    if (!recvAll(fd, &response, sizeof(response)) || response.magic != DAEMON_MAGIC ||
+        (!sent && response.status == static_cast<uint32_t>(DaemonStatus::OK))) {
+        fprintf(stderr, "rgr_client: connection failed\n");
+        close(fd);
+        return 3;
+    }
+
+    vector<char> result(static_cast<size_t>(response.payloadLength));
+    if (!recvAll(fd, result.data(), result.size())) {
+        fprintf(stderr, "rgr_client: connection failed\n");
+        close(fd);
+        return 3;
+    }
+    close(fd);
+
+    DaemonStatus status = static_cast<DaemonStatus>(response.status);
+    if (status != DaemonStatus::OK) {
+        fprintf(stderr, "rgr_client: %s\n", statusName(status));
+        return static_cast<int>(response.status);
+    }
+    fwrite(result.data(), 1, result.size(), stdout);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Работа с контейнерами (container.h) из командной строки. Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tools/rgr_container.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o rgr_container
+//
+//   rgr_container pack   <шифр> <ключ...> <файл> <контейнер> [--chunk РАЗМЕР] [--threads N] [--compress]
+//   rgr_container append <шифр> <ключ...> <файл> <контейнер> [--chunk РАЗМЕР] [--threads N] [--compress]
+//   rgr_container unpack <шифр> <ключ...> <контейнер> <файл> [--threads N]
+//   rgr_container range  <шифр> <ключ...> <контейнер> <смещение> <длина>   (результат в stdout)
+//
+// Шифр и ключ: affine <a> <b> | skytale <ключ> | table <слово>.
+// append шифрует только то, что дописано в файл после прошлого запуска
+// (контейнера нет - как pack); --chunk и --compress действуют при создании.
+// Размещение буферов файла задаётся RGR_HUGEPAGES и RGR_NUMA (large_buffer.h).
+#include "container.h"
+#include "file_utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+            "usage: rgr_container pack   <cipher> <key...> <input> <container> [--chunk SIZE] [--threads N] [--compress]\n"
+            "       rgr_container append <cipher> <key...> <input> <container> [--chunk SIZE] [--threads N] [--compress]\n"
+            "       rgr_container unpack <cipher> <key...> <container> <output> [--threads N]\n"
+            "       rgr_container range  <cipher> <key...> <container> <offset> <length>\n"
+            "cipher and key: affine <a> <b> | skytale <key> | table <word>\n");
+}
+
+// Разбор шифра и ключа начиная с argv[next]; next сдвигается за ключ.
+bool parseKey(int argc, char* argv[], int& next, CipherKey& key) {
+    if (next >= argc) return false;
+    string name = argv[next++];
+    if (name == "affine" && next + 1 < argc) {
+        key.cipher = ContainerCipher::AFFINE;
+        key.a = strtoull(argv[next++], nullptr, 10);
+        key.b = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "skytale" && next < argc) {
+        key.cipher = ContainerCipher::SKYTALE;
+        key.key = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "table" && next < argc) {
+        key.cipher = ContainerCipher::TABLE;
+        key.word = s2ws(argv[next++]);
+        return true;
+    }
+    return false;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    string command = argv[1];
+    int next = 2;
+    CipherKey key;
+    if (!parseKey(argc, argv, next, key) || next + 1 >= argc) {
+        usage();
+        return 2;
+    }
+    wstring first = s2ws(argv[next++]);
+    string second = argv[next++];
+
+    uint64_t chunkSize = CONTAINER_DEFAULT_CHUNK;
+    unsigned threads = 0;
+    bool compress = false;
+    vector<string> rest;
+    for (; next < argc; next++) {
+        string arg = argv[next];
+        if (arg == "--chunk" && next + 1 < argc) chunkSize = strtoull(argv[++next], nullptr, 10);
+        else if (arg == "--threads" && next + 1 < argc) threads = static_cast<unsigned>(strtoul(argv[++next], nullptr, 10));
+        else if (arg == "--compress" && (command == "pack" || command == "append")) compress = true;
+        else rest.push_back(arg);
+    }
+
+    try {
+        if (command == "pack" && rest.empty()) {
+            LargeBuffer data;
+            readBinaryFile(first, data, defaultBufferPolicy());  // пустой файл - пустой контейнер
+            if (!writeContainer(s2ws(second), data.bytes(), key, chunkSize, threads, compress)) {
+                fprintf(stderr, "rgr_container: cannot write %s\n", second.c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        if (command == "append" && rest.empty()) {
+            if (!syncContainer(first, s2ws(second), key, chunkSize, threads, compress)) {
+                fprintf(stderr, "rgr_container: cannot append to %s (damaged, wrong key, or input was rewritten)\n",
+                        second.c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        ContainerReader reader;
+        if ((command == "unpack" && rest.empty()) || (command == "range" && rest.size() == 1)) {
+            if (!reader.open(first, key)) {
+                fprintf(stderr, "rgr_container: not a container, damaged, or wrong key\n");
+                return 1;
+            }
+        } else {
+            usage();
+            return 2;
+        }
+
+        if (command == "unpack") {
+            LargeBuffer data(static_cast<size_t>(reader.size()));
+            if (!reader.readAll(data.bytes(), threads) || !writeBinaryFile(s2ws(second), data.bytes())) {
+                fprintf(stderr, "rgr_container: unpack failed\n");
+                return 1;
+            }
+            return 0;
+        }
+
+        uint64_t offset = strtoull(second.c_str(), nullptr, 10);
+        uint64_t length = strtoull(rest[0].c_str(), nullptr, 10);
+        vector<unsigned char> data(static_cast<size_t>(length));
+        if (!reader.readRange(offset, data)) {
+            fprintf(stderr, "rgr_container: range is out of bounds or damaged\n");
+            return 1;
+        }
+        fwrite(data.data(), 1, data.size(), stdout);
+        return 0;
+    } catch (const exception& e) {
+        fprintf(stderr, "rgr_container: %s\n", e.what());
+        return 1;
+    }
+}
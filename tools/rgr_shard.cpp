@@ -0,0 +1,111 @@
+// Обработка файла несколькими процессами (shard.h). Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tools/rgr_shard.cpp shard.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o rgr_shard
+//
+//   rgr_shard run     encrypt|decrypt <шифр> <ключ...> <вход> <выход> [--processes N] [--memory БАЙТ]
+//   rgr_shard prepare encrypt|decrypt <шифр> <ключ...> <вход> <выход>
+//   rgr_shard worker  encrypt|decrypt <шифр> <ключ...> <вход> <выход> <часть> <всего> [--memory БАЙТ]
+//   rgr_shard finish  encrypt|decrypt <шифр> <ключ...> <вход> <выход>
+//
+// Шифр и ключ: affine <a> <b> | skytale <ключ> | table <слово>. run делает всё
+// на локальных процессах; prepare, worker и finish - те же шаги по отдельности,
+// например на разных машинах с общим хранилищем.
+#include "shard.h"
+#include "file_utils.h"
+#include "parallel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+            "usage: rgr_shard run     encrypt|decrypt <cipher> <key...> <input> <output> [--processes N] [--memory BYTES]\n"
+            "       rgr_shard prepare encrypt|decrypt <cipher> <key...> <input> <output>\n"
+            "       rgr_shard worker  encrypt|decrypt <cipher> <key...> <input> <output> <index> <count> [--memory BYTES]\n"
+            "       rgr_shard finish  encrypt|decrypt <cipher> <key...> <input> <output>\n"
+            "cipher and key: affine <a> <b> | skytale <key> | table <word>\n");
+}
+
+// Разбор шифра и ключа начиная с argv[next]; next сдвигается за ключ.
+bool parseKey(int argc, char* argv[], int& next, CipherKey& key) {
+    if (next >= argc) return false;
+    string name = argv[next++];
+    if (name == "affine" && next + 1 < argc) {
+        key.cipher = ContainerCipher::AFFINE;
+        key.a = strtoull(argv[next++], nullptr, 10);
+        key.b = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "skytale" && next < argc) {
+        key.cipher = ContainerCipher::SKYTALE;
+        key.key = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "table" && next < argc) {
+        key.cipher = ContainerCipher::TABLE;
+        key.word = s2ws(argv[next++]);
+        return true;
+    }
+    return false;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    string command = argv[1];
+    string direction = argv[2];
+    int next = 3;
+    CipherKey key;
+    if ((direction != "encrypt" && direction != "decrypt") || !parseKey(argc, argv, next, key) || next + 1 >= argc) {
+        usage();
+        return 2;
+    }
+    bool encrypt = direction == "encrypt";
+    wstring input = s2ws(argv[next++]);
+    wstring output = s2ws(argv[next++]);
+
+    unsigned processes = workerThreads();
+    uint64_t memory = SHARD_DEFAULT_MEMORY;
+    vector<string> rest;
+    for (; next < argc; next++) {
+        string arg = argv[next];
+        if (arg == "--processes" && next + 1 < argc) processes = static_cast<unsigned>(strtoul(argv[++next], nullptr, 10));
+        else if (arg == "--memory" && next + 1 < argc) memory = strtoull(argv[++next], nullptr, 10);
+        else rest.push_back(arg);
+    }
+
+    try {
+        bool ok;
+        if (command == "run" && rest.empty()) {
+            ok = transformFileSharded(input, output, key, encrypt, processes, memory);
+        } else if (command == "prepare" && rest.empty()) {
+            ok = prepareShardedOutput(input, output, key, encrypt);
+        } else if (command == "worker" && rest.size() == 2) {
+            unsigned index = static_cast<unsigned>(strtoul(rest[0].c_str(), nullptr, 10));
+            unsigned count = static_cast<unsigned>(strtoul(rest[1].c_str(), nullptr, 10));
+            ok = runShard(input, output, key, encrypt, index, count, memory);
+        } else if (command == "finish" && rest.empty()) {
+            ok = finishShardedOutput(output, key, encrypt);
+        } else {
+            usage();
+            return 2;
+        }
+        if (!ok) {
+            fprintf(stderr, "rgr_shard: %s failed\n", command.c_str());
+            return 1;
+        }
+    } catch (const exception& e) {
+        fprintf(stderr, "rgr_shard: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Один вход под многими ключами (sweep.h). Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tools/rgr_sweep.cpp sweep.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o rgr_sweep
+//
+//   rgr_sweep encrypt|decrypt [--text] <вход> <шифр> <ключ...> <выход> [<шифр> <ключ...> <выход> ...]
+//
+// Шифр и ключ: affine <a> <b> | skytale <ключ> | table <слово>. Вход
+// читается один раз; без --text он двоичный, с --text - текст в UTF-8.
+#include "sweep.h"
+#include "file_utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+            "usage: rgr_sweep encrypt|decrypt [--text] <input> <cipher> <key...> <output> [<cipher> <key...> <output> ...]\n"
+            "cipher and key: affine <a> <b> | skytale <key> | table <word>\n");
+}
+
+// Разбор шифра и ключа начиная с argv[next]; next сдвигается за ключ.
+bool parseKey(int argc, char* argv[], int& next, CipherKey& key) {
+    if (next >= argc) return false;
+    string name = argv[next++];
+    if (name == "affine" && next + 1 < argc) {
+        key.cipher = ContainerCipher::AFFINE;
+        key.a = strtoull(argv[next++], nullptr, 10);
+        key.b = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "skytale" && next < argc) {
+        key.cipher = ContainerCipher::SKYTALE;
+        key.key = strtoull(argv[next++], nullptr, 10);
+        return true;
+    }
+    if (name == "table" && next < argc) {
+        key.cipher = ContainerCipher::TABLE;
+        key.word = s2ws(argv[next++]);
+        return true;
+    }
+    return false;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    string command = argv[1];
+    int next = 2;
+    bool text = next < argc && string(argv[next]) == "--text";
+    if (text) next++;
+    if ((command != "encrypt" && command != "decrypt") || next >= argc) {
+        usage();
+        return 2;
+    }
+    wstring input = s2ws(argv[next++]);
+
+    vector<SweepTarget> targets;
+    while (next < argc) {
+        SweepTarget target;
+        if (!parseKey(argc, argv, next, target.key) || next >= argc) {
+            usage();
+            return 2;
+        }
+        target.output = s2ws(argv[next++]);
+        targets.push_back(target);
+    }
+    if (targets.empty()) {
+        usage();
+        return 2;
+    }
+
+    try {
+        vector<bool> written;
+        bool encrypt = command == "encrypt";
+        bool ok = text ? sweepTextFile(input, targets, encrypt, written)
+                       : sweepBinaryFile(input, targets, encrypt, written);
+        if (!ok) {
+            fprintf(stderr, "rgr_sweep: cannot read %s\n", ws2s(input).c_str());
+            return 1;
+        }
+        int status = 0;
+        for (size_t i = 0; i < targets.size(); i++) {
+            if (!written[i]) {
+                fprintf(stderr, "rgr_sweep: cannot write %s\n", ws2s(targets[i].output).c_str());
+                status = 1;
+            }
+        }
+        return status;
+    } catch (const exception& e) {
+        fprintf(stderr, "rgr_sweep: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,59 @@
+// Табличный шифр для файлов больше оперативной памяти (table_file.h). Сборка из корня репозитория:
+//   g++ -std=c++20 -O2 -pthread -I. tools/rgr_table_file.cpp cipher.cpp affine.cpp skytale.cpp table.cpp container.cpp table_file.cpp execution_plan.cpp result_cache.cpp file_utils.cpp metrics.cpp cpu_dispatch.cpp arena.cpp parallel.cpp large_buffer.cpp lz.cpp transposition_plan.cpp -o rgr_table_file
+//
+//   rgr_table_file encrypt|decrypt <слово> <вход> <выход> [--memory БАЙТ]
+//
+// --memory - бюджет памяти под полосу (по умолчанию 256 МБ); результат
+// совпадает с шифрованием изображения в меню табличного шифра.
+#include "table_file.h"
+#include "file_utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+void usage() {
+    fprintf(stderr, "usage: rgr_table_file encrypt|decrypt <word> <input> <output> [--memory BYTES]\n");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5 && argc != 7) {
+        usage();
+        return 2;
+    }
+    string direction = argv[1];
+    uint64_t memory = TABLE_FILE_DEFAULT_MEMORY;
+    if (argc == 7) {
+        if (string(argv[5]) != "--memory") {
+            usage();
+            return 2;
+        }
+        memory = strtoull(argv[6], nullptr, 10);
+    }
+    if ((direction != "encrypt" && direction != "decrypt") || memory == 0) {
+        usage();
+        return 2;
+    }
+
+    try {
+        wstring key = s2ws(argv[2]);
+        wstring input = s2ws(argv[3]);
+        wstring output = s2ws(argv[4]);
+        bool ok = direction == "encrypt" ? encryptTableFile(input, output, key, memory)
+                                         : decryptTableFile(input, output, key, memory);
+        if (!ok) {
+            fprintf(stderr, "rgr_table_file: cannot process %s\n", argv[3]);
+            return 1;
+        }
+    } catch (const exception& e) {
+        fprintf(stderr, "rgr_table_file: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
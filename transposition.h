@@ -0,0 +1,301 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include "cpu_dispatch.h"
+#include "arena.h"
+#include "permutation.h"
+#include "parallel.h"
+#include "transposition_plan.h"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Общая основа Скиталы и табличного шифра. Вход делится на count отрезков
+// по segment элементов (строки матрицы Скиталы, столбцы таблицы). При
+// шифровании элемент pos отрезка d попадает в out[pos * count + order(d)],
+// расшифрование - обратная выборка. Шифры различаются только политикой
+// порядка, поэтому быстрые пути (ядра cpu_dispatch, работа на месте)
+// написаны один раз для обоих и для любого типа элементов.
+
+// Начиная с этого объёма (в байтах) полная матрица обрабатывается несколькими
+// потоками: позиции 0..segment делятся на полосы, каждая полоса - отдельный
+// непрерывный участок выхода при шифровании и по участку в каждом столбце
+// при расшифровании. Результат не зависит от числа потоков.
+const uint64_t PARALLEL_MIN_BYTES = 4 << 20;
+
+// Полосы по BAND_ALIGN позиций, чтобы потоки не делили строки кэша на границах.
+const uint64_t BAND_ALIGN = 64;
+
+// Выполняет band(begin, end) для полос позиций [0, segment).
+template <typename Band>
+void forEachBand(uint64_t segment, uint64_t bytes, Band band) {
+    unsigned threads = bytes >= PARALLEL_MIN_BYTES && !insideParallelFor ? workerThreads() : 1;
+    if (threads <= 1 || segment < 2 * BAND_ALIGN) {
+        band(uint64_t(0), segment);
+        return;
+    }
+    // Полос больше, чем потоков: медленный поток не задерживает остальных
+    uint64_t bands = std::min<uint64_t>(uint64_t(threads) * 4, segment / BAND_ALIGN);
+    uint64_t step = (segment / bands + BAND_ALIGN - 1) / BAND_ALIGN * BAND_ALIGN;
+    bands = (segment + step - 1) / step;
+    parallelFor(bands, threads, [&](uint64_t i) {
+        band(i * step, std::min(segment, (i + 1) * step));
+        return true;
+    });
+}
+
+// Скитала: отрезки остаются на своих местах.
+struct SkytaleOrder {
+    static constexpr bool identity = true;
+    uint64_t count;
+
+    uint64_t operator()(uint64_t d) const { return d; }
+};
+
+// Таблица: отрезок d встаёт на место columnOrder[d] - 1.
+struct KeyedOrder {
+    static constexpr bool identity = false;
+    const uint64_t* columnOrder;
+    uint64_t count;
+
+    uint64_t operator()(uint64_t d) const { return columnOrder[d] - 1; }
+};
+
+// Способы перестановки для планов (transposition_plan.h). Все дают одинаковый
+// результат; какой быстрее, зависит от count и segment.
+
+template <typename T, typename Order>
+void encryptLoop(const T* in, uint64_t length, T* out, uint64_t segment, const Order& order, T pad) {
+    const uint64_t count = order.count;
+    for (uint64_t d = 0; d < count; d++) {
+        T* column = out + order(d);
+        uint64_t begin = d * segment;
+        for (uint64_t pos = 0; pos < segment; pos++) {
+            uint64_t i = begin + pos;
+            column[pos * count] = i < length ? in[i] : pad;
+        }
+    }
+}
+
+template <typename T, typename Order>
+void encryptKernel(const T* in, uint64_t length, T* out, uint64_t segment, const Order& order, T pad) {
+    const uint64_t count = order.count;
+
+    // Указатели на отрезки в порядке выхода; неполный и пустые - из дополненных копий
+    ArenaScope scope;
+    std::span<const T*> rows = scope.allocate<const T*>(static_cast<size_t>(count));
+    std::span<T> padding;
+    for (uint64_t d = 0; d < count; d++) {
+        uint64_t begin = d * segment;
+        const T* row;
+        if (begin + segment <= length) {
+            row = in + begin;
+        } else if (begin < length) {
+            std::span<T> partial = scope.allocate<T>(static_cast<size_t>(segment));
+            std::fill(std::copy(in + begin, in + length, partial.begin()), partial.end(), pad);
+            row = partial.data();
+        } else {
+            if (padding.empty()) {
+                padding = scope.allocate<T>(static_cast<size_t>(segment));
+                std::fill(padding.begin(), padding.end(), pad);
+            }
+            row = padding.data();
+        }
+        rows[order(d)] = row;
+    }
+    forEachBand(segment, count * segment * sizeof(T), [&](uint64_t begin, uint64_t end) {
+        if (begin == 0 && end == segment) {
+            interleaveRows(rows.data(), count, out, count, segment);
+            return;
+        }
+        ArenaScope bandScope;
+        std::span<const T*> bandRows = bandScope.allocate<const T*>(static_cast<size_t>(count));
+        for (uint64_t d = 0; d < count; d++) {
+            bandRows[d] = rows[d] + begin;
+        }
+        interleaveRows(bandRows.data(), count, out + begin * count, count, end - begin);
+    });
+}
+
+// Полная матрица из count * segment элементов.
+template <typename T, typename Order>
+void decryptLoop(const T* in, T* out, uint64_t segment, const Order& order) {
+    const uint64_t count = order.count;
+    for (uint64_t d = 0; d < count; d++) {
+        const T* column = in + order(d);
+        T* target = out + d * segment;
+        for (uint64_t pos = 0; pos < segment; pos++) {
+            target[pos] = column[pos * count];
+        }
+    }
+}
+
+template <typename T, typename Order>
+void decryptKernel(const T* in, T* out, uint64_t segment, const Order& order) {
+    const uint64_t count = order.count;
+    ArenaScope scope;
+    const uint64_t* offsets = nullptr;
+    if constexpr (!Order::identity) {
+        std::span<uint64_t> table = scope.allocate<uint64_t>(static_cast<size_t>(count));
+        for (uint64_t d = 0; d < count; d++) {
+            table[d] = order(d);
+        }
+        offsets = table.data();
+    }
+    forEachBand(segment, count * segment * sizeof(T), [&](uint64_t begin, uint64_t end) {
+        gatherColumns(in + begin * count, count, offsets, count, out + begin, segment, end - begin);
+    });
+}
+
+// out[i] = in[source[i]], PLAN_PAD - дополнение.
+template <typename T>
+void applyIndex(const T* in, T* out, const std::vector<uint32_t>& source, T pad) {
+    const uint32_t* index = source.data();
+    const size_t size = source.size();
+    for (size_t i = 0; i < size; i++) {
+        out[i] = index[i] == PLAN_PAD ? pad : in[index[i]];
+    }
+}
+
+template <typename Order>
+const uint64_t* planOrder(const Order& order) {
+    if constexpr (Order::identity) return nullptr;
+    else return order.columnOrder;
+}
+
+template <typename Order>
+PlanKey planKey(const Order& order, uint64_t segment, uint64_t length, size_t elementSize, bool encrypt) {
+    PlanKey key;
+    key.count = order.count;
+    key.segment = segment;
+    key.length = length;
+    key.elementSize = static_cast<uint8_t>(elementSize);
+    key.identity = Order::identity;
+    key.encrypt = encrypt;
+    if constexpr (!Order::identity) {
+        key.orderHash = hashOrder(order.columnOrder, order.count);
+    }
+    return key;
+}
+
+// Таблица индексов для способа INDEX; строится при промахе кэша потока.
+template <typename Order>
+const TranspositionPlan& indexPlan(const PlanKey& key, const Order& order) {
+    const TranspositionPlan* cached = threadPlanCache().find(key, planOrder(order));
+    if (cached != nullptr) return *cached;
+
+    TranspositionPlan plan;
+    plan.key = key;
+    if constexpr (!Order::identity) {
+        plan.order.assign(order.columnOrder, order.columnOrder + order.count);
+    }
+    const uint64_t count = key.count;
+    const uint64_t segment = key.segment;
+    plan.source.resize(static_cast<size_t>(count * segment));
+    for (uint64_t d = 0; d < count; d++) {
+        for (uint64_t pos = 0; pos < segment; pos++) {
+            uint64_t plain = d * segment + pos;
+            uint64_t cipher = pos * count + order(d);
+            if (key.encrypt) {
+                plan.source[cipher] = plain < key.length ? static_cast<uint32_t>(plain) : PLAN_PAD;
+            } else {
+                plan.source[plain] = static_cast<uint32_t>(cipher);
+            }
+        }
+    }
+    return *threadPlanCache().insert(std::move(plan));
+}
+
+// out - count * segment элементов; позиции входа от length и дальше заполняются pad.
+template <typename T, typename Order>
+void transposeEncrypt(const T* in, uint64_t length, T* out, uint64_t segment, const Order& order, T pad) {
+    const uint64_t size = order.count * segment;
+
+    if (size == 0 || size > PLAN_MAX_LENGTH) {
+        if (length >= KERNEL_MIN_LENGTH) {
+            encryptKernel(in, length, out, segment, order, pad);
+        } else {
+            encryptLoop(in, length, out, segment, order, pad);
+        }
+        return;
+    }
+
+    switch (choosePlanStrategy(order.count, segment, sizeof(T), true)) {
+    case PlanStrategy::LOOP: encryptLoop(in, length, out, segment, order, pad); break;
+    case PlanStrategy::KERNEL: encryptKernel(in, length, out, segment, order, pad); break;
+    case PlanStrategy::INDEX:
+        applyIndex(in, out, indexPlan(planKey(order, segment, length, sizeof(T), true), order).source, pad);
+        break;
+    }
+}
+
+// Записывает outLength элементов. При неполной матрице (length < count * segment,
+// бывает у Скиталы) недостающие позиции входа дают pad.
+template <typename T, typename Order>
+void transposeDecrypt(const T* in, uint64_t length, T* out, uint64_t outLength, uint64_t segment, const Order& order, T pad) {
+    const uint64_t count = order.count;
+    const uint64_t size = count * segment;
+
+    if (length >= size && outLength == size) {
+        if (size == 0 || size > PLAN_MAX_LENGTH) {
+            if (size >= KERNEL_MIN_LENGTH) {
+                decryptKernel(in, out, segment, order);
+            } else {
+                decryptLoop(in, out, segment, order);
+            }
+            return;
+        }
+
+        switch (choosePlanStrategy(count, segment, sizeof(T), false)) {
+        case PlanStrategy::LOOP: decryptLoop(in, out, segment, order); break;
+        case PlanStrategy::KERNEL: decryptKernel(in, out, segment, order); break;
+        case PlanStrategy::INDEX:
+            applyIndex(in, out, indexPlan(planKey(order, segment, size, sizeof(T), false), order).source, pad);
+            break;
+        }
+        return;
+    }
+
+    uint64_t i = 0;
+    for (uint64_t d = 0; d < count && i < outLength; d++) {
+        for (uint64_t pos = 0; pos < segment && i < outLength; pos++, i++) {
+            uint64_t index = pos * count + order(d);
+            out[i] = index < length ? in[index] : pad;
+        }
+    }
+}
+
+// На месте: buffer вмещает count * segment элементов, первые length - вход.
+template <typename T, typename Order>
+void transposeEncryptInPlace(T* buffer, uint64_t length, uint64_t segment, const Order& order, T pad) {
+    const uint64_t count = order.count;
+    const uint64_t size = count * segment;
+    std::fill(buffer + length, buffer + size, pad);
+
+    if constexpr (Order::identity) {
+        permuteInPlace(buffer, size, [count, segment](uint64_t p) {
+            return (p % count) * segment + p / count;
+        });
+    } else {
+        ArenaScope scope;
+        std::span<uint64_t> source = scope.allocate<uint64_t>(static_cast<size_t>(count));
+        for (uint64_t d = 0; d < count; d++) {
+            source[order(d)] = d;
+        }
+        permuteInPlace(buffer, size, [&source, count, segment](uint64_t p) {
+            return source[p % count] * segment + p / count;
+        });
+    }
+}
+
+// На месте, полная матрица из count * segment элементов.
+template <typename T, typename Order>
+void transposeDecryptInPlace(T* buffer, uint64_t segment, const Order& order) {
+    const uint64_t count = order.count;
+    permuteInPlace(buffer, count * segment, [&order, count, segment](uint64_t p) {
+        return (p % segment) * count + order(p / segment);
+    });
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "transposition_plan.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+uint64_t hashOrder(const uint64_t* order, uint64_t count) {
+    // FNV-1a по значениям порядка
+    uint64_t hash = 1469598103934665603ULL;
+    for (uint64_t d = 0; d < count; d++) {
+        hash ^= order[d];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+PlanStrategy choosePlanStrategy(uint64_t count, uint64_t segment, size_t elementSize, bool encrypt) {
+    const uint64_t size = count * segment;
+    if (segment <= PLAN_INDEX_MAX_SEGMENT || count >= PLAN_INDEX_MIN_COUNT ||
+        (elementSize == 1 && encrypt && size <= PLAN_INDEX_BYTE_ENCRYPT_LENGTH)) {
+        return PlanStrategy::INDEX;
+    }
+    return size >= KERNEL_MIN_LENGTH ? PlanStrategy::KERNEL : PlanStrategy::LOOP;
+}
+
+size_t PlanCache::KeyHash::operator()(const PlanKey& key) const {
+    uint64_t hash = key.orderHash;
+    for (uint64_t value : { key.count, key.segment, key.length,
+                            uint64_t(key.elementSize) | uint64_t(key.identity) << 8 | uint64_t(key.encrypt) << 9 }) {
+        hash = (hash ^ value) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+const TranspositionPlan* PlanCache::find(const PlanKey& key, const uint64_t* order) {
+    // Чаще всего подряд идут сообщения одной длины с одним ключом
+    if (!plans.empty() && plans.front().key == key) {
+        const TranspositionPlan& plan = plans.front();
+        if (key.identity || equal(plan.order.begin(), plan.order.end(), order)) {
+            return &plan;
+        }
+        return nullptr;
+    }
+
+    auto found = index.find(key);
+    if (found == index.end()) return nullptr;
+
+    const TranspositionPlan& plan = *found->second;
+    if (!key.identity && !equal(plan.order.begin(), plan.order.end(), order)) {
+        return nullptr;  // другой ключ с тем же хэшем
+    }
+    plans.splice(plans.begin(), plans, found->second);
+    return &plans.front();
+}
+
+const TranspositionPlan* PlanCache::insert(TranspositionPlan plan) {
+    auto found = index.find(plan.key);
+    if (found != index.end()) {
+        plans.erase(found->second);
+        index.erase(found);
+    }
+    if (plans.size() >= CAPACITY) {
+        index.erase(plans.back().key);
+        plans.pop_back();
+    }
+    plans.push_front(move(plan));
+    index.emplace(plans.front().key, plans.begin());
+    return &plans.front();
+}
+
+void PlanCache::clear() {
+    index.clear();
+    plans.clear();
+}
+
+PlanCache& threadPlanCache() {
+    thread_local PlanCache cache;
+    return cache;
+}
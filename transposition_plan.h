@@ -0,0 +1,89 @@
+#ifndef TRANSPOSITION_PLAN_H
+#define TRANSPOSITION_PLAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Планы перестановок. Для одной и той же перестановки - шифр, ключ, длина,
+// направление и тип элементов - какой способ быстрее, зависит от геометрии
+// матрицы: простой цикл, ядро cpu_dispatch или выборка по готовой таблице
+// индексов. Способ выбирается детерминированным правилом по размерам
+// (choosePlanStrategy), без замеров: время вызова не зависит от того,
+// встречалась ли длина раньше. Кэшируются только таблицы индексов - в
+// LRU-кэше потока; промах стоит одного построения таблицы (порядка одной
+// перестановки), а не замера.
+
+enum class PlanStrategy : uint8_t {
+    LOOP,    // циклы по отрезкам без подготовки
+    KERNEL,  // ядра interleaveRows / gatherColumns
+    INDEX    // out[i] = in[source[i]]
+};
+
+// Таблицы строятся только для матриц не длиннее этого (элементов); дальше
+// выбор между циклом и ядром делает порог KERNEL_MIN_LENGTH.
+const uint64_t PLAN_MAX_LENGTH = 1 << 16;
+
+// Правило выбора (по замерам всех трёх способов на сетке count x segment для
+// байтов и wchar_t): таблица выигрывает, когда отрезки короткие или их очень
+// много - циклам там мешают накладные расходы на каждый отрезок, - и при
+// шифровании байтов в небольших матрицах; иначе ядро от KERNEL_MIN_LENGTH
+// элементов, цикл - до.
+const uint64_t PLAN_INDEX_MAX_SEGMENT = 8;
+const uint64_t PLAN_INDEX_MIN_COUNT = 1024;
+const uint64_t PLAN_INDEX_BYTE_ENCRYPT_LENGTH = 4096;
+
+// Способ для матрицы count x segment (count * segment <= PLAN_MAX_LENGTH).
+PlanStrategy choosePlanStrategy(uint64_t count, uint64_t segment, size_t elementSize, bool encrypt);
+
+// Индекс дополнения в таблице INDEX.
+const uint32_t PLAN_PAD = UINT32_MAX;
+
+struct PlanKey {
+    uint64_t count = 0;
+    uint64_t segment = 0;
+    uint64_t length = 0;
+    uint64_t orderHash = 0;
+    uint8_t elementSize = 0;
+    bool identity = false;
+    bool encrypt = false;
+
+    bool operator==(const PlanKey&) const = default;
+};
+
+// Таблица индексов способа INDEX.
+struct TranspositionPlan {
+    PlanKey key;
+    std::vector<uint64_t> order;    // порядок отрезков - для сверки при совпадении хэша
+    std::vector<uint32_t> source;
+};
+
+uint64_t hashOrder(const uint64_t* order, uint64_t count);
+
+class PlanCache {
+public:
+    static const size_t CAPACITY = 256;
+
+    // nullptr, если плана нет. Указатель действителен до следующего insert.
+    const TranspositionPlan* find(const PlanKey& key, const uint64_t* order);
+    const TranspositionPlan* insert(TranspositionPlan plan);
+
+    void clear();
+    size_t size() const { return plans.size(); }
+
+private:
+    struct KeyHash {
+        size_t operator()(const PlanKey& key) const;
+    };
+
+    std::list<TranspositionPlan> plans;  // в начале - использованные последними
+    std::unordered_map<PlanKey, std::list<TranspositionPlan>::iterator, KeyHash> index;
+};
+
+// Кэш текущего потока: планы не делятся между потоками, и обращение к ним
+// обходится без блокировок.
+PlanCache& threadPlanCache();
+
+#endif
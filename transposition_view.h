@@ -0,0 +1,167 @@
+#ifndef TRANSPOSITION_VIEW_H
+#define TRANSPOSITION_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Ленивое представление результата перестановочного шифра поверх исходного
+// буфера: элемент i вычисляется по формуле в момент обращения, выходной
+// буфер не создаётся. Подходит, когда нужна лишь часть результата -
+// префикс, поиск, выборка.
+//
+// Элементы совпадают с результатом transformSkytale* / *Table* для тех же
+// данных, включая символы дополнения. Ограничение табличного шифра над
+// текстом: удаление пробелов не выполняется, вход должен быть уже без них.
+
+// Скитала: матрица key x columns, строки открытого текста - столбцы шифртекста.
+struct SkytaleIndex {
+    uint64_t key = 1;
+    uint64_t columns = 0;
+    bool encrypt = true;
+
+    uint64_t operator()(uint64_t i) const {
+        return encrypt ? (i % key) * columns + i / key : (i % columns) * key + i / columns;
+    }
+};
+
+// Табличный шифр: столбец j открытого текста становится столбцом columnOrder[j] - 1.
+struct TableIndex {
+    uint64_t keyLength = 1;
+    uint64_t rows = 0;
+    bool encrypt = true;
+    std::vector<uint64_t> order;  // при шифровании - обратная перестановка столбцов
+
+    uint64_t operator()(uint64_t i) const {
+        return encrypt ? order[i % keyLength] * rows + i / keyLength : (i % rows) * keyLength + (order[i / rows] - 1);
+    }
+};
+
+template <typename T, typename Index>
+class TranspositionView {
+public:
+    class iterator {
+    public:
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using reference = T;
+        using pointer = void;
+
+        iterator() = default;
+        iterator(const TranspositionView* view, size_t position) : view(view), position(position) {}
+
+        T operator*() const { return (*view)[position]; }
+        T operator[](difference_type n) const { return (*view)[position + n]; }
+
+        iterator& operator++() { ++position; return *this; }
+        iterator operator++(int) { iterator old = *this; ++position; return old; }
+        iterator& operator--() { --position; return *this; }
+        iterator operator--(int) { iterator old = *this; --position; return old; }
+        iterator& operator+=(difference_type n) { position += n; return *this; }
+        iterator& operator-=(difference_type n) { position -= n; return *this; }
+
+        friend iterator operator+(iterator it, difference_type n) { return it += n; }
+        friend iterator operator+(difference_type n, iterator it) { return it += n; }
+        friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const iterator& a, const iterator& b) {
+            return static_cast<difference_type>(a.position) - static_cast<difference_type>(b.position);
+        }
+        friend bool operator==(const iterator& a, const iterator& b) { return a.position == b.position; }
+        friend auto operator<=>(const iterator& a, const iterator& b) { return a.position <=> b.position; }
+
+    private:
+        const TranspositionView* view = nullptr;
+        size_t position = 0;
+    };
+
+    TranspositionView(std::span<const T> source, Index index, size_t length, T pad)
+        : source(source), index(std::move(index)), length(length), pad(pad) {}
+
+    T operator[](size_t i) const {
+        uint64_t j = index(i);
+        return j < source.size() ? source[j] : pad;
+    }
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, length); }
+
+    // Отбрасывание дополнения в конце (как при расшифровании таблицы):
+    // просматриваются только хвостовые элементы.
+    void trimPadding() {
+        while (length > 0 && (*this)[length - 1] == pad) {
+            length--;
+        }
+    }
+
+private:
+    std::span<const T> source;
+    Index index;
+    size_t length;
+    T pad;
+};
+
+static_assert(std::random_access_iterator<TranspositionView<unsigned char, SkytaleIndex>::iterator>);
+
+template <typename T>
+constexpr T skytaleViewPad() {
+    if constexpr (sizeof(T) == 1) return T(0);
+    else return T(L' ');
+}
+
+template <typename T>
+constexpr T tableViewPad() {
+    if constexpr (sizeof(T) == 1) return T(0);
+    else return T(L'x');
+}
+
+// Результат Скиталы с ключом key для data.
+template <typename T>
+TranspositionView<T, SkytaleIndex> skytaleView(std::span<const T> data, uint64_t key, bool encrypt) {
+    uint64_t length = data.size();
+    if (key == 0 || length == 0) {
+        // Как и transformSkytale*: без ключа данные не меняются
+        return TranspositionView<T, SkytaleIndex>(data, SkytaleIndex{ 1, length, true }, data.size(), skytaleViewPad<T>());
+    }
+    uint64_t columns = (length + key - 1) / key;
+    size_t size = static_cast<size_t>(encrypt ? key * columns : length);
+    return TranspositionView<T, SkytaleIndex>(data, SkytaleIndex{ key, columns, encrypt }, size, skytaleViewPad<T>());
+}
+
+// Результат табличного шифра с порядком столбцов columnOrder (getColumnOrder).
+template <typename T>
+TranspositionView<T, TableIndex> tableView(std::span<const T> data, const std::vector<uint64_t>& columnOrder, bool encrypt) {
+    uint64_t keyLength = columnOrder.size();
+    uint64_t length = data.size();
+    if (keyLength == 0) {
+        return TranspositionView<T, TableIndex>(data, TableIndex{ 1, length, true, { 0 } }, data.size(), tableViewPad<T>());
+    }
+
+    TableIndex index;
+    index.keyLength = keyLength;
+    index.encrypt = encrypt;
+    if (encrypt) {
+        index.rows = (length + keyLength - 1) / keyLength;
+        index.order.resize(columnOrder.size());
+        for (uint64_t j = 0; j < keyLength; j++) {
+            index.order[columnOrder[j] - 1] = j;
+        }
+        size_t size = static_cast<size_t>(index.rows * keyLength);
+        return TranspositionView<T, TableIndex>(data, std::move(index), size, tableViewPad<T>());
+    }
+
+    index.rows = length / keyLength;
+    index.order = columnOrder;
+    size_t size = static_cast<size_t>(index.rows * keyLength);
+    TranspositionView<T, TableIndex> view(data, std::move(index), size, tableViewPad<T>());
+    view.trimPadding();
+    return view;
+}
+
+#endif